@@ -6,11 +6,10 @@
 #include <chrono>
 #include <cstdint>
 #include <iostream>
-#if __APPLE__
-#include <dispatch/dispatch.h>
-#endif
+#include <vector>
 
 #include "record_bits.h"
+#include "record_parallel.h"
 
 namespace
 {
@@ -300,30 +299,24 @@ int main(int argc, char **argv)
           }
         });
     Printf("Perf(nano sec): {} size={}", count, perfTest.size());
-#if __APPLE__
-    auto jgroup = dispatch_group_create();
-    auto jqueue = dispatch_queue_create("PerfTest", DISPATCH_QUEUE_CONCURRENT);
+    // 並列(ワーカーごとに書いて連結、スレッドは使い回す)
+    std::vector<size_t> offsets;
+    record::WorkerPool pool;
     count = MeasureTime(
         [&]()
         {
           for (int i = 0; i < 2000; i++)
           {
             perfTest.reset();
-            for (const auto &tes : testArray)
+            if (!record::serializeParallel(pool, perfTest, testArray.data(),
+                                           testArray.size(), offsets))
             {
-              dispatch_group_async(jgroup, jqueue, ^{
-                record::Serializer local{1000};
-                if (!tes.serialize(local))
-                {
-                  Printf("buffer overflow");
-                }
-              });
+              Printf("buffer overflow");
+              break;
             }
           }
         });
-    dispatch_group_wait(jgroup, DISPATCH_TIME_FOREVER);
-    Printf("Perf(nano sec): {}", count);
-#endif
+    Printf("Perf(nano sec): {} size={}", count, perfTest.size());
   }
 
   return 0;
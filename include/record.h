@@ -3,20 +3,90 @@
 //
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <typeinfo>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 namespace record
 {
 
 class Serializer;
+class ValueLink;
+
+//
+// 差分フォーマット(読み書きで揃える)
+// Plain: 従来形式
+// RunLength: 変化なしフィールド/要素の連続をまとめて書く
+//            (先頭に形式番号を付けるので、Plainと取り違えて読むと失敗する)
+//
+enum class DiffFormat : uint8_t
+{
+  Plain,
+  RunLength,
+};
+
+//
+// 配列の要素フォーマット
+// Tagged: 要素ごとにサイズ種別を付ける
+// Packed: PackBlock要素ごとに最小値と共通ビット幅で詰める(密な数値配列向け)
+//
+enum class ArrayFormat : uint8_t
+{
+  Tagged,
+  Packed,
+};
 
 //
 //
 //
 class ValueInterface
 {
+  friend class ValueLink;
+
+  // 所属ValueLinkへの相対位置と番号(変更通知用)
+  // 通知するのはValueLinkがdirty trackingかエンコードキャッシュを使っている
+  // 間だけで、それ以外は0(setterはフィールドの外に書き込まない)
+  // レコードごとコピーしても壊れないようにポインタは持たない
+  // (int32に収まらないほど離れている場合も0で、通知しない)
+  int32_t linkOffset_ = 0;
+  uint32_t linkIndex_ = 0;
+
+  [[nodiscard]] bool linked() const { return linkOffset_ != 0; }
+  [[nodiscard]] ValueLink *link() const;
+
+protected:
+  // 値の変更を所属ValueLinkへ通知
+  void markDirty();
+  // 値を持つmemberの範囲(rawBytes用、vtableとlink情報の後ろだけを指す)
+  template <class T>
+  [[nodiscard]] auto valueBytes(size_t size, const T &member) const
+  {
+    static_assert(std::is_trivially_copyable_v<T>,
+                  "raw bytes must be trivially copyable");
+    auto begin = static_cast<size_t>(reinterpret_cast<const char *>(&member) -
+                                     reinterpret_cast<const char *>(this));
+    return RawBytes{size, begin, begin + sizeof(T)};
+  }
+  // 動的型がTそのものか(rawBytes用、派生型はメンバーや処理を足しうるので
+  // 派生側で明示的に有効にしない限りバイト列として扱わない)
+  template <class T>
+  [[nodiscard]] bool isExactly() const
+  {
+    return typeid(*this) == typeid(T);
+  }
+
 public:
   //
   // Base Bits: 初期識別用ビット数
@@ -34,10 +104,17 @@ public:
   static constexpr size_t ByteBits = 8;
   // array size descriptor
   static constexpr size_t ArraySizeBits = 3;
+  // RunLength差分: 連続スキップ数(1〜16)
+  static constexpr size_t RunBits = 4;
+  static constexpr size_t MaxRun = 1 << RunBits;
 
 public:
   ValueInterface() = default;
-  virtual ~ValueInterface() = default;
+  // コピーは通知しない状態から始める(コピー先が同じValueLinkに届くとは限らない)
+  ValueInterface(const ValueInterface &other) : linkIndex_(other.linkIndex_) {}
+  // 代入は値だけで、所属ValueLinkとの関係はそのまま
+  ValueInterface &operator=(const ValueInterface &) { return *this; }
+  virtual ~ValueInterface();
 
   // シリアライズ時に同じ値かどうかのチェック
   [[nodiscard]] virtual bool
@@ -59,13 +136,55 @@ public:
   }
   virtual bool deserialize(Serializer &) = 0;
   virtual bool deserializeDiff(Serializer &) = 0;
+  // 変化なしの差分を出力
+  virtual bool serializeUnchanged(Serializer &ser) const;
+  // DiffFormat::RunLength用(配列以外は通常の差分と同じ)
+  virtual bool serializeRunLengthDiff(Serializer &ser,
+                                      const ValueInterface &other) const
+  {
+    return serializeDiff(ser, other);
+  }
+  virtual bool deserializeRunLengthDiff(Serializer &ser)
+  {
+    return deserializeDiff(ser);
+  }
+  // serialize/serializeDiffで書くビット数を書かずに求める(書けない場合は0)
+  // 既定は一時バッファに書いて数える
+  [[nodiscard]] virtual size_t measureBits() const;
+  [[nodiscard]] virtual size_t
+  measureDiffBits(const ValueInterface &other) const;
+  // serializeで書いたものを値を作らずに読み飛ばす(タグと長さだけ読む)
+  // 既定は未対応(false)
+  virtual bool skip(Serializer &) const { return false; }
+  // serializeDiff/serializeRunLengthDiffで書いたものの読み飛ばし
+  // (既定はserializeと同じ形式とみなす)
+  virtual bool skipDiff(Serializer &ser) const { return skip(ser); }
+  virtual bool skipRunLengthDiff(Serializer &ser) const
+  {
+    return skipDiff(ser);
+  }
 
   // コピー
   virtual void copy([[maybe_unused]] const ValueInterface &other) {}
   [[nodiscard]] virtual const void *typeTag() const = 0;
+
+  //
+  // バイト列としてコピー/比較できる型の配置(ValueLinkの一括コピー/比較用)
+  // size: オブジェクトのバイト数(0なら不可)
+  // begin, end: 値メンバーの範囲(先頭からのバイト数、値を持たなければ同じ)
+  // (vtableとlinkOffset_/linkIndex_、パディングはコピーも比較もしない)
+  //
+  struct RawBytes
+  {
+    size_t size = 0;
+    size_t begin = 0;
+    size_t end = 0;
+  };
+  [[nodiscard]] virtual RawBytes rawBytes() const { return {}; }
   // 各型チェック
   [[nodiscard]] virtual bool isBool() const { return false; }
   [[nodiscard]] virtual bool isSeparator() const { return false; }
+  [[nodiscard]] virtual bool isArray() const { return false; }
   [[nodiscard]] virtual size_t getByteSize() const { return 1; }
   [[nodiscard]] virtual size_t getArraySize() const { return 1; }
 };
@@ -80,27 +199,446 @@ template <class T>
   return static_cast<const T *>(&other);
 }
 
+//
+// レコード型ごとのフィールド配置(ValueLinkからのオフセット列)
+// RecordLayout::Scopeの中で作られたレコードは、最初のインスタンスで作った
+// 配置を共有し、インスタンスごとのフィールド一覧を持たない
+//
+class RecordLayout
+{
+  friend class ValueLink;
+
+  // 全フィールドの値をまとめてmemcpy/memcmpできる場合の範囲(ValueLinkからの相対)
+  struct Bulk
+  {
+    bool valid = false;
+    int32_t begin = 0;
+    // 値の区間(beginからの相対位置とバイト数、vtable・link情報・パディングは含まない)
+    std::vector<std::pair<uint32_t, uint32_t>> runs;
+  };
+
+  std::vector<int32_t> offsets_;
+  std::atomic<bool> sealed_{false};
+  std::mutex mutex_;
+  // 最初の一括コピー/比較で調べる
+  Bulk bulk_;
+  std::once_flag bulkOnce_;
+  static inline thread_local RecordLayout *current_ = nullptr;
+
+  // 構築中のValueLinkが受け取る(入れ子のレコードには渡さない)
+  static RecordLayout *take() { return std::exchange(current_, nullptr); }
+
+public:
+  //
+  // 範囲内で構築するレコードにこのレイアウトを使わせる
+  // (未完成なら最初のインスタンスの構築で作り、終わったら確定)
+  //
+  class Scope
+  {
+    RecordLayout &layout_;
+    RecordLayout *prev_;
+    std::unique_lock<std::mutex> lock_;
+
+  public:
+    explicit Scope(RecordLayout &layout) : layout_(layout), prev_(current_)
+    {
+      if (!layout_.sealed())
+      {
+        lock_ = std::unique_lock<std::mutex>(layout_.mutex_);
+      }
+      current_ = &layout_;
+    }
+    ~Scope()
+    {
+      current_ = prev_;
+      if (lock_.owns_lock())
+      {
+        layout_.sealed_ = true;
+      }
+    }
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+  };
+
+  // 型ごとのレイアウト
+  template <class Record>
+  static RecordLayout &of()
+  {
+    static RecordLayout layout;
+    return layout;
+  }
+
+  [[nodiscard]] bool sealed() const { return sealed_; }
+  [[nodiscard]] size_t size() const { return offsets_.size(); }
+};
+
+//
+// フィールドごとの書き込み統計(RECORD_STATS定義時のみ集計)
+// 失敗して巻き戻した書き込みも含む
+// (集計中は同じレコードのserializeを複数スレッドから同時に呼ばないこと)
+//
+struct FieldStats
+{
+  // 書き込んだビット数の合計
+  uint64_t bits = 0;
+  // 書き込み回数(丸ごと+差分)
+  uint64_t writes = 0;
+  // うち差分の回数と、そのうち変化なしの回数
+  uint64_t diffs = 0;
+  uint64_t zeroDiffs = 0;
+};
+
+//
+// レコード内のフィールド位置(ValueLink::buildFieldIndexで作る)
+// 古いバージョンのレコードは後ろのフィールドが無い(size()が少ない)
+//
+struct FieldIndex
+{
+  // レコードの先頭/終端(終端マークの後ろ)のビット位置
+  size_t begin = 0;
+  size_t end = 0;
+  // 各フィールドの先頭(beginからの相対ビット位置)
+  std::vector<uint32_t> offsets;
+
+  [[nodiscard]] size_t size() const { return offsets.size(); }
+  [[nodiscard]] size_t position(size_t field) const
+  {
+    return begin + offsets[field];
+  }
+};
+
 //
 // 変数をつなげて管理
 //
 class ValueLink
 {
-  using ValueContainer = std::vector<ValueInterface *>;
-  ValueContainer list_;
+  using OffsetList = std::vector<std::intptr_t>;
+  using BitMap = std::vector<uint64_t>;
+  static constexpr size_t MapBits = 64;
+
+  // フィールドの位置(ValueLinkからのオフセットなのでレコードをコピーしても有効)
+  // 別に確保したフィールドでも届くように64bit
+  OffsetList own_;
+  // 型ごとに共有するレイアウト(RecordPoolで作ったレコードのみ)
+  RecordLayout *layout_;
+  uint32_t count_ = 0;
+  // 変更のあったフィールド(dirty tracking有効時のみ)
+  BitMap dirty_;
+  // 変化なしの差分がBBZeroだけになるフィールド
+  BitMap plain_;
+  // 常にdirty扱いにするフィールド(バージョンセパレータと変更通知が届かないもの)
+  BitMap sticky_;
+  // 破棄を通知してきたフィールド(通知を止める時に触らない)
+  BitMap released_;
+  bool tracking_ = false;
+  // 変更通知が届かないフィールドがある(世代番号で変更を追えない)
+  bool unlinked_ = false;
+  // フィールドが変更されるたびに進む世代番号
+  uint64_t generation_ = 0;
+  // エンコードキャッシュ(最後にserializeしたビット列とその世代)
+  // 作り直しは1スレッドだけが行い、書き終えてから世代を公開する
+  // (その間、他のスレッドはキャッシュを使わずにエンコードする)
+  struct EncodeCache
+  {
+    std::vector<uint64_t> words;
+    size_t bits = 0;
+    // 中身の世代+1(0は無効)
+    std::atomic<uint64_t> stamp{0};
+    std::atomic<bool> filling{false};
+
+    EncodeCache() = default;
+    // レコードをコピーしてもキャッシュは引き継がない
+    EncodeCache(const EncodeCache &) {}
+    EncodeCache &operator=(const EncodeCache &)
+    {
+      stamp = 0;
+      return *this;
+    }
+  };
+  mutable EncodeCache cache_;
+  bool caching_ = false;
+#if defined(RECORD_STATS)
+  mutable std::vector<FieldStats> stats_;
+#endif
+
+  bool serializeFields(Serializer &ser) const;
+  bool serializeCached(Serializer &ser) const;
+  [[nodiscard]] size_t measureFields() const;
+
+  // 統計の記録(RECORD_STATS未定義なら何もしない)
+  void countField([[maybe_unused]] size_t index,
+                  [[maybe_unused]] size_t bits) const
+  {
+#if defined(RECORD_STATS)
+    stats_.resize(std::max<size_t>(stats_.size(), count_));
+    stats_[index].bits += bits;
+    stats_[index].writes++;
+#endif
+  }
+  void countDiff([[maybe_unused]] size_t index, [[maybe_unused]] size_t bits,
+                 [[maybe_unused]] const ValueInterface &from,
+                 [[maybe_unused]] const ValueInterface &to) const
+  {
+#if defined(RECORD_STATS)
+    countField(index, bits);
+    stats_[index].diffs++;
+    stats_[index].zeroDiffs += from.equal(to) ? 1 : 0;
+#endif
+  }
+
+  static bool testBit(const BitMap &map, size_t index)
+  {
+    return (map[index / MapBits] >> (index % MapBits)) & 1ULL;
+  }
+
+  [[nodiscard]] std::intptr_t fieldOffset(size_t index) const
+  {
+    return layout_ != nullptr ? layout_->offsets_[index] : own_[index];
+  }
+  [[nodiscard]] ValueInterface *field(size_t index) const
+  {
+    auto base = reinterpret_cast<std::intptr_t>(this);
+    return reinterpret_cast<ValueInterface *>(base + fieldOffset(index));
+  }
+
+  // 共有レイアウトへの追加/照合(このインスタンスの配置と合わなければfalse)
+  bool addLayout(std::intptr_t offset, size_t index)
+  {
+    auto &offsets = layout_->offsets_;
+    if (offset < INT32_MIN || offset > INT32_MAX)
+    {
+      return false;
+    }
+    if (!layout_->sealed() && offsets.size() == index)
+    {
+      // 最初のインスタンスでレイアウトを作る
+      offsets.push_back(static_cast<int32_t>(offset));
+      return true;
+    }
+    return index < offsets.size() && offsets[index] == offset;
+  }
+  // フィールドからの相対位置が通知に使える範囲か
+  static bool reachable(std::intptr_t back)
+  {
+    return back >= INT32_MIN && back <= INT32_MAX;
+  }
+  // 変更通知を受けるか(dirty trackingかエンコードキャッシュ)
+  [[nodiscard]] bool notified() const { return tracking_ || caching_; }
+  // 全フィールドの通知の開始/停止(破棄済みのフィールドには触らない)
+  void linkFields(bool enable);
+
+  // 共有レイアウトをやめて、ここまでの配置を自前で持つ
+  void detachLayout(size_t count)
+  {
+    const auto &offsets = layout_->offsets_;
+    own_.assign(offsets.begin(), offsets.begin() + count);
+    layout_ = nullptr;
+  }
+
+  // フィールドの列挙
+  class FieldIterator
+  {
+    const ValueLink *link_;
+    size_t index_;
+
+  public:
+    FieldIterator(const ValueLink *link, size_t index)
+        : link_(link), index_(index)
+    {
+    }
+    ValueInterface *operator*() const { return link_->field(index_); }
+    FieldIterator &operator++()
+    {
+      index_++;
+      return *this;
+    }
+    FieldIterator operator++(int)
+    {
+      auto prev = *this;
+      index_++;
+      return prev;
+    }
+    bool operator!=(const FieldIterator &other) const
+    {
+      return index_ != other.index_;
+    }
+  };
+  struct FieldRange
+  {
+    const ValueLink *link_;
+    [[nodiscard]] FieldIterator begin() const { return {link_, 0}; }
+    [[nodiscard]] FieldIterator end() const { return {link_, link_->size()}; }
+  };
+  [[nodiscard]] FieldRange fields() const { return {this}; }
 
-  bool checkTerminate(Serializer &ser);
+  // Plain形式のレコード走査(indexがあれば各フィールドの位置を入れる)
+  bool scanRecord(Serializer &ser, bool diff, FieldIndex *index) const;
+
+  // 一括コピー/比較の配置(使えなければnullptr)
+  [[nodiscard]] const RecordLayout::Bulk *bulkLayout() const;
+  [[nodiscard]] RecordLayout::Bulk analyzeBulk() const;
+  bool copyBulk(const ValueLink &other);
 
 public:
-  ValueLink() = default;
+  // RecordLayout::Scopeの中で作られたら共有レイアウトを使う
+  ValueLink() : layout_(RecordLayout::take()) {}
+  // コピーはdirty trackingとキャッシュを引き継がない(フィールドも通知しない)
+  ValueLink(const ValueLink &other)
+      : own_(other.own_), layout_(other.layout_), count_(other.count_),
+        unlinked_(other.unlinked_)
+  {
+  }
+  // 代入は配置も通知の状態もそのまま
+  // (続くフィールドの代入は通知しないので、全フィールド変更扱いにする)
+  ValueLink &operator=(const ValueLink &other)
+  {
+    if (this != &other)
+    {
+      generation_++;
+      markAllDirty();
+    }
+    return *this;
+  }
+  // 残っているフィールド(レコードの外に確保したもの)の通知を止める
+  ~ValueLink()
+  {
+    if (notified())
+    {
+      linkFields(false);
+    }
+  }
+
+  // 終端書き込み/チェック
+  static bool writeTerminate(Serializer &ser);
+  static bool checkTerminate(Serializer &ser);
 
   // 追加
-  void add(ValueInterface *val) { list_.push_back(val); }
+  // (共有レイアウトと配置が違うインスタンスは自前の一覧に切り替える)
+  void add(ValueInterface *val)
+  {
+    auto offset = reinterpret_cast<std::intptr_t>(val) -
+                  reinterpret_cast<std::intptr_t>(this);
+    auto back = -offset;
+    val->linkOffset_ =
+        notified() && reachable(back) ? static_cast<int32_t>(back) : 0;
+    val->linkIndex_ = count_++;
+    unlinked_ = unlinked_ || !reachable(back);
+    if (layout_ != nullptr && !addLayout(offset, val->linkIndex_))
+    {
+      detachLayout(val->linkIndex_);
+    }
+    if (layout_ == nullptr)
+    {
+      own_.push_back(offset);
+    }
+    generation_++;
+    if (notified())
+    {
+      released_.resize((count_ + MapBits - 1) / MapBits, 0);
+    }
+    if (tracking_)
+    {
+      dirty_.resize((count_ + MapBits - 1) / MapBits, 0);
+      plain_.resize(dirty_.size(), 0);
+      sticky_.resize(dirty_.size(), 0);
+      if (!val->linked())
+      {
+        auto index = val->linkIndex_;
+        sticky_[index / MapBits] |= 1ULL << (index % MapBits);
+      }
+      markDirty(val->linkIndex_);
+    }
+  }
+
+  // serialize/serializeDiffで書くビット数(書き込みはしない)
+  // フィールド数が違う場合は0
+  [[nodiscard]] size_t measureBits() const;
+  [[nodiscard]] size_t measureDiffBits(const ValueLink &other) const;
+
+  // フィールドごとの書き込み統計(RECORD_STATS未定義なら空)
+  [[nodiscard]] std::vector<FieldStats> fieldStats() const
+  {
+#if defined(RECORD_STATS)
+    auto stats = stats_;
+    stats.resize(count_);
+    return stats;
+#else
+    return {};
+#endif
+  }
+  void resetFieldStats()
+  {
+#if defined(RECORD_STATS)
+    stats_.clear();
+#endif
+  }
+
+  //
+  // dirty tracking
+  // 有効にすると各フィールドの変更をビットマップに記録する
+  // (有効化した時点では全フィールド変更扱い)
+  // 有効な間(とエンコードキャッシュ使用中)はsetterがValueLinkに書き込むので、
+  // 同じレコードの別々のフィールドを複数スレッドから同時に変更しないこと
+  //
+  void enableDirtyTracking();
+  [[nodiscard]] bool isDirtyTracking() const { return tracking_; }
+  void markDirty(size_t index)
+  {
+    generation_++;
+    if (tracking_)
+    {
+      dirty_[index / MapBits] |= 1ULL << (index % MapBits);
+    }
+  }
+  void markAllDirty();
+  // フィールドの破棄(以後そのフィールドには触らない)
+  void releaseField(size_t index)
+  {
+    if (index / MapBits < released_.size())
+    {
+      released_[index / MapBits] |= 1ULL << (index % MapBits);
+    }
+  }
+  void clearDirty() { dirty_ = sticky_; }
+  [[nodiscard]] bool isDirty(size_t index) const
+  {
+    return !tracking_ || testBit(dirty_, index);
+  }
+  [[nodiscard]] size_t size() const { return count_; }
+
+  //
+  // エンコードキャッシュ
+  // 有効にするとserializeは世代が変わっていなければ前回のビット列を連結するだけになる
+  // (非constのat()/data()で得た参照を後から書き換えた場合は世代が進まないので注意)
+  // 変更通知の届かないフィールドがあるレコードではキャッシュしない
+  // 同じレコードのserializeを複数スレッドから呼んでもよい
+  // (値の変更とは同時に呼ばないこと。キャッシュを使わない場合と同じ)
+  //
+  void enableEncodeCache()
+  {
+    caching_ = true;
+    cache_.stamp = 0;
+    linkFields(true);
+  }
+  void disableEncodeCache()
+  {
+    caching_ = false;
+    cache_.stamp = 0;
+    cache_.words.clear();
+    if (!tracking_)
+    {
+      linkFields(false);
+    }
+  }
+  [[nodiscard]] bool isEncodeCaching() const { return caching_; }
+  // 変更のたびに進む世代番号(dirty trackingかキャッシュが有効な間のみ)
+  [[nodiscard]] uint64_t generation() const { return generation_; }
 
   // データーバージョン
   [[nodiscard]] uint32_t getDataVersion() const
   {
     uint32_t version = 0;
-    for (const auto *val : list_)
+    for (const auto *val : fields())
     {
       if (val->isSeparator())
       {
@@ -110,18 +648,41 @@ public:
     return version;
   }
 
+  //
+  // 一括コピー/比較
+  // 同じRecordLayoutを共有するレコード(RecordPoolやRecordLayout::Scopeで作ったもの)で、
+  // 全フィールドがValue/ValueBits/ValueBool/整数のValueArray/ValueVersionで
+  // 隙間なく並んでいれば、copy/equalはフィールドごとの仮想呼び出しをせず
+  // 値メンバーのmemcpy/memcmpで済ませる(結果はフィールドごとの場合と同じ)
+  //
+  [[nodiscard]] bool isBulkCopyable() const { return bulkLayout() != nullptr; }
+
   // 比較
   [[nodiscard]] bool equal(const ValueLink &other) const
   {
-    if (list_.size() != other.list_.size())
+    if (size() != other.size())
     {
       return false;
     }
+    const auto *bulk = layout_ == other.layout_ ? bulkLayout() : nullptr;
+    if (bulk != nullptr)
+    {
+      const auto *lhs = reinterpret_cast<const char *>(this) + bulk->begin;
+      const auto *rhs = reinterpret_cast<const char *>(&other) + bulk->begin;
+      for (const auto &[offset, bytes] : bulk->runs)
+      {
+        if (std::memcmp(lhs + offset, rhs + offset, bytes) != 0)
+        {
+          return false;
+        }
+      }
+      return true;
+    }
 
-    auto beg0 = list_.begin();
-    auto beg1 = other.list_.begin();
+    auto beg0 = fields().begin();
+    auto beg1 = other.fields().begin();
     bool result = true;
-    for (; beg0 != list_.end(); beg0++, beg1++)
+    for (; beg0 != fields().end(); beg0++, beg1++)
     {
       if (!(*beg0)->equal(**beg1))
       {
@@ -135,31 +696,61 @@ public:
   // コピー
   void copy(const ValueLink &other)
   {
-    if (list_.size() != other.list_.size())
+    if (size() != other.size())
+    {
+      return;
+    }
+    if (layout_ == other.layout_ && copyBulk(other))
     {
       return;
     }
 
-    auto beg0 = list_.begin();
-    auto beg1 = other.list_.begin();
-    for (; beg0 != list_.end(); beg0++, beg1++)
+    auto beg0 = fields().begin();
+    auto beg1 = other.fields().begin();
+    for (; beg0 != fields().end(); beg0++, beg1++)
     {
       (*beg0)->copy(**beg1);
     }
   }
 
+  // 変更フィールドのみコピー
+  void copyDirty(const ValueLink &other);
+
   // シリアライズ
   bool serialize(Serializer &ser) const;
   bool serializeDiff(Serializer &ser, const ValueLink &other) const;
+  bool serializeDiff(Serializer &ser, const ValueLink &other,
+                     DiffFormat format) const;
   bool serializeDiffAndCopy(Serializer &ser, const ValueLink &other);
+  bool serializeDiffAndCopy(Serializer &ser, const ValueLink &other,
+                            DiffFormat format);
+  // dirtyなフィールドだけbaseと比較した差分(=base.serializeDiff(ser,*this))
+  bool serializeDirty(Serializer &ser, const ValueLink &base) const;
+  bool serializeDirty(Serializer &ser, const ValueLink &base,
+                      DiffFormat format) const;
   bool deserialize(Serializer &ser);
   bool deserializeDiff(Serializer &ser);
+  bool deserializeDiff(Serializer &ser, DiffFormat format);
 
-  // 必要ビットサイズ
+  // serializeで書いたレコードを値を作らずに走査してフィールド位置を求める
+  // 成功時はserの位置がレコードの後ろになる(失敗時は戻す)
+  bool buildFieldIndex(Serializer &ser, FieldIndex &index) const;
+  // レコード/フィールドを値を作らずに読み飛ばす(失敗時は位置を戻す)
+  // skipRecordはserialize、skipDiffRecordはserializeDiffで書いたもの
+  bool skipRecord(Serializer &ser) const;
+  bool skipDiffRecord(Serializer &ser) const;
+  bool skipDiffRecord(Serializer &ser, DiffFormat format) const;
+  bool skipField(Serializer &ser, size_t number) const;
+  // number番目のフィールドだけ読み込む(他のフィールドは変更しない)
+  // 成功時はserの位置がそのフィールドの後ろになる
+  bool deserializeField(Serializer &ser, const FieldIndex &index,
+                        size_t number);
+
+  // 必要ビットサイズの上限(値によらない見積もり)
   [[nodiscard]] size_t getTotalBitSize() const
   {
     size_t bitSize = ValueInterface::BaseBits;
-    for (const auto &val : list_)
+    for (const auto &val : fields())
     {
       bitSize += ValueInterface::BaseBits;
       if (!val->isBool() && !val->isSeparator())
@@ -183,14 +774,41 @@ public:
     }
     return bitSize;
   }
-  // 必要バイトサイズ
+  // 必要バイトサイズ(現在の値での正確なサイズ)
   [[nodiscard]] size_t needTotalSize() const
   {
     constexpr auto ByteBits = ValueInterface::ByteBits;
-    return (getTotalBitSize() + ByteBits - 1) / ByteBits;
+    return (measureBits() + ByteBits - 1) / ByteBits;
   }
 };
 
+//
+inline ValueLink *ValueInterface::link() const
+{
+  return reinterpret_cast<ValueLink *>(
+      const_cast<char *>(reinterpret_cast<const char *>(this)) + linkOffset_);
+}
+
+//
+inline void ValueInterface::markDirty()
+{
+  if (!linked())
+  {
+    // 通知していない(ValueLink側で変更を追わないか、常に変更扱いにしている)
+    return;
+  }
+  link()->markDirty(linkIndex_);
+}
+
+//
+inline ValueInterface::~ValueInterface()
+{
+  if (linked())
+  {
+    link()->releaseField(linkIndex_);
+  }
+}
+
 //
 // version separator
 //
@@ -207,14 +825,36 @@ public:
   }
   [[nodiscard]] const void *typeTag() const override { return typeTagValue(); }
 
+  // 値を持たないので区切り同士は常に同じ
+  [[nodiscard]] bool equal(const ValueInterface &other) const override
+  {
+    return valueCast<ValueVersion>(other) != nullptr;
+  }
+
   //
   bool serialize(Serializer &ser) const override;
   bool serializeDiff(Serializer &ser, const ValueInterface &) const override;
+  bool serializeDiff(Serializer &ser, const ValueVersion &) const;
+  bool serializeUnchanged(Serializer &ser) const override;
   bool deserialize(Serializer &ser) override;
   bool deserializeDiff(Serializer &ser) override;
+  [[nodiscard]] size_t measureBits() const override { return BaseBits; }
+  [[nodiscard]] size_t measureDiffBits(const ValueInterface &) const override
+  {
+    return BaseBits;
+  }
+  bool skip(Serializer &ser) const override;
 
   //
   [[nodiscard]] bool isSeparator() const override { return true; }
+  [[nodiscard]] RawBytes rawBytes() const override
+  {
+    if (!isExactly<ValueVersion>())
+    {
+      return {};
+    }
+    return {sizeof(*this), 0, 0};
+  }
   [[nodiscard]] size_t getByteSize() const override { return 0; }
   [[nodiscard]] size_t getArraySize() const override { return 0; }
 };
@@ -238,30 +878,55 @@ public:
   [[nodiscard]] const void *typeTag() const override { return typeTagValue(); }
 
   //
+  [[nodiscard]] bool equal(const ValueBool &other) const
+  {
+    return val_ == other.val_;
+  }
   [[nodiscard]] bool equal(const ValueInterface &other) const override
   {
     if (auto *oval = valueCast<ValueBool>(other))
     {
-      return val_ == oval->val_;
+      return equal(*oval);
     }
     return false;
   }
+  void copy(const ValueBool &other)
+  {
+    val_ = other.val_;
+    markDirty();
+  }
   void copy(const ValueInterface &other) override
   {
     if (auto *oval = valueCast<ValueBool>(other))
     {
-      val_ = oval->val_;
+      copy(*oval);
     }
   }
   [[nodiscard]] bool isBool() const override { return true; }
+  [[nodiscard]] RawBytes rawBytes() const override
+  {
+    if (!isExactly<ValueBool>())
+    {
+      return {};
+    }
+    return valueBytes(sizeof(*this), val_);
+  }
   [[nodiscard]] size_t getByteSize() const override { return 0; }
   [[nodiscard]] size_t getArraySize() const override { return 0; }
 
   //
   bool serialize(Serializer &ser) const override;
   bool serializeDiff(Serializer &ser, const ValueInterface &) const override;
+  bool serializeDiff(Serializer &ser, const ValueBool &other) const;
+  bool serializeUnchanged(Serializer &ser) const override;
   bool deserialize(Serializer &ser) override;
   bool deserializeDiff(Serializer &ser) override;
+  [[nodiscard]] size_t measureBits() const override { return BaseBits; }
+  [[nodiscard]] size_t measureDiffBits(const ValueInterface &) const override
+  {
+    return BaseBits;
+  }
+  bool skip(Serializer &ser) const override;
 
   //
   explicit operator bool() const { return val_; }
@@ -270,6 +935,7 @@ public:
   bool operator=(bool val)
   {
     val_ = val;
+    markDirty();
     return val;
   }
   bool operator==(bool val) const { return val_ == val; }
@@ -279,15 +945,127 @@ public:
 //
 // string
 //
+//
+// 文字列辞書(読み書きの両側で同じ内容を持つ)
+// 登録済みの文字列は番号だけで送られる
+//
+class StringDictionary
+{
+  // string_viewのまま検索できるようにする
+  struct Hash
+  {
+    using is_transparent = void;
+    size_t operator()(std::string_view str) const
+    {
+      return std::hash<std::string_view>{}(str);
+    }
+  };
+
+  std::vector<std::string> list_;
+  std::unordered_map<std::string, uint32_t, Hash, std::equal_to<>> index_;
+
+public:
+  // 登録(既にあればその番号)
+  uint32_t add(const std::string &str)
+  {
+    auto [it, inserted] =
+        index_.try_emplace(str, static_cast<uint32_t>(list_.size()));
+    if (inserted)
+    {
+      list_.push_back(str);
+    }
+    return it->second;
+  }
+  [[nodiscard]] bool find(std::string_view str, uint32_t &index) const
+  {
+    auto it = index_.find(str);
+    if (it == index_.end())
+    {
+      return false;
+    }
+    index = it->second;
+    return true;
+  }
+  [[nodiscard]] const std::string *at(size_t index) const
+  {
+    return index < list_.size() ? &list_[index] : nullptr;
+  }
+  [[nodiscard]] size_t size() const { return list_.size(); }
+};
+
+//
+// 文字列の読み書き(ValueString / ValueFixedString 共通)
+// BBOther: 長さ + バイト列
+// BBOne: 1bitの種別に続いて 0:前後の一致部分以外の差し替え(差分のみ) /
+// 1:辞書番号
+// 差し替えは書き込み側で有効にした時だけ使う(既定の差分は従来通り丸ごと)
+//
+class StringCodec
+{
+  static constexpr size_t BaseBits = ValueInterface::BaseBits;
+  static constexpr size_t SizeBits = ValueInterface::SizeBits;
+  static constexpr size_t ByteBits = ValueInterface::ByteBits;
+  // SizeBitsに収まらない長さは継続ビット付きの7bit単位で続ける
+  static constexpr size_t LongLengthTag = (1ULL << SizeBits) - 1;
+  static constexpr size_t LengthGroupBits = 7;
+  static constexpr uint32_t PatchSplice = 0;
+  static constexpr uint32_t PatchDictionary = 1;
+
+  // 差し替え差分(前後の一致部分と中央の長さ)
+  struct Splice
+  {
+    size_t prefix;
+    size_t suffix;
+    size_t mid;
+  };
+
+  static bool writeLength(Serializer &ser, size_t len);
+  static bool readLength(Serializer &ser, size_t &len);
+  static size_t lengthBits(size_t len);
+  static Splice splice(std::string_view from, std::string_view to);
+  // 差し替えの方が小さければtrue
+  static bool useSplice(const Splice &patch, size_t len);
+  template <class Storage>
+  static bool readImpl(Serializer &ser, Storage &storage,
+                       const StringDictionary *dict, bool diff, bool &changed);
+
+public:
+  static bool write(Serializer &ser, std::string_view value,
+                    const StringDictionary *dict);
+  // allowSplice: 差し替えの方が小さければ使う
+  static bool writeDiff(Serializer &ser, std::string_view from,
+                        std::string_view to, const StringDictionary *dict,
+                        bool allowSplice);
+  // write/writeDiffで書くビット数
+  static size_t measure(std::string_view value, const StringDictionary *dict);
+  static size_t measureDiff(std::string_view from, std::string_view to,
+                            const StringDictionary *dict, bool allowSplice);
+  // diff: 変更なし/差し替えも受け付ける
+  // changed: 値を書き換えたか
+  static bool read(Serializer &ser, std::string &value,
+                   const StringDictionary *dict, bool diff, bool &changed);
+  // 固定長バッファへ(len: 現在の長さ/読み込んだ長さ)
+  static bool read(Serializer &ser, char *data, size_t &len, size_t capacity,
+                   const StringDictionary *dict, bool diff, bool &changed);
+  // 読み飛ばし(文字列本体は読まない)
+  static bool skip(Serializer &ser, bool diff);
+};
+
+//
+// 文字列
+//
 class ValueString : public ValueInterface
 {
   std::string val_;
+  const StringDictionary *dict_ = nullptr;
+  bool splice_ = false;
 
 public:
   ValueString(std::string init, ValueLink &link) : val_(std::move(init))
   {
     link.add(this);
   }
+  ValueString(const ValueString &) = default;
   ~ValueString() override = default;
 
   static const void *typeTagValue()
@@ -298,29 +1076,71 @@ public:
   [[nodiscard]] const void *typeTag() const override { return typeTagValue(); }
 
   //
-  [[nodiscard]] bool equal(const ValueInterface &other) const override
+  [[nodiscard]] bool equal(const ValueString &other) const
+  {
+    return val_ == other.val_;
+  }
+  [[nodiscard]] bool equal(const ValueInterface &other) const override
   {
     if (auto *oval = valueCast<ValueString>(other))
     {
-      return val_ == oval->val_;
+      return equal(*oval);
     }
     return false;
   }
+  void copy(const ValueString &other)
+  {
+    val_ = other.val_;
+    markDirty();
+  }
   void copy(const ValueInterface &other) override
   {
     if (auto *oval = valueCast<ValueString>(other))
     {
-      val_ = oval->val_;
+      copy(*oval);
     }
   }
   [[nodiscard]] size_t getByteSize() const override { return val_.size(); }
 
+  // 辞書の指定(nullptrで解除、辞書は呼び出し側で保持)
+  // エンコードが変わるので変更扱いで通知する
+  // (設定済みの辞書へ登録を足した場合も、同じ辞書でもう一度呼ぶこと)
+  void setDictionary(const StringDictionary *dict)
+  {
+    dict_ = dict;
+    markDirty();
+  }
+  // 差分で前後の一致部分を除いた中央だけを送る(読み込み側の設定は不要)
+  void setSpliceDiff(bool enable) { splice_ = enable; }
+
   //
   bool serialize(Serializer &ser) const override;
   bool serializeDiff(Serializer &ser,
                      const ValueInterface &other) const override;
+  bool serializeDiff(Serializer &ser, const ValueString &other) const;
   bool deserialize(Serializer &ser) override;
   bool deserializeDiff(Serializer &ser) override;
+  bool skip(Serializer &ser) const override
+  {
+    return StringCodec::skip(ser, false);
+  }
+  bool skipDiff(Serializer &ser) const override
+  {
+    return StringCodec::skip(ser, true);
+  }
+  [[nodiscard]] size_t measureBits() const override
+  {
+    return StringCodec::measure(val_, dict_);
+  }
+  [[nodiscard]] size_t
+  measureDiffBits(const ValueInterface &other) const override
+  {
+    if (const auto *oval = valueCast<ValueString>(other))
+    {
+      return StringCodec::measureDiff(val_, oval->val_, dict_, splice_);
+    }
+    return 0;
+  }
 
   //
   explicit operator std::string() const { return val_; }
@@ -329,17 +1149,230 @@ public:
   ValueString &operator=(const ValueString &other)
   {
     val_ = other.val_;
+    markDirty();
     return *this;
   }
   ValueString &operator=(const std::string &value)
   {
     val_ = value;
+    markDirty();
     return *this;
   }
   bool operator==(const ValueString &other) const { return val_ == other.val_; }
   bool operator!=(const ValueString &other) const { return !(*this == other); }
 };
 
+//
+// 固定容量の文字列(最大Nバイトを内部に持つ)
+// 読み込み/コピーでメモリ確保しない。ValueStringと同じフォーマット
+// (Nを超える文字列は代入時に切り詰め、読み込み時は失敗)
+//
+template <size_t N>
+class ValueFixedString : public ValueInterface
+{
+  std::array<char, N> buf_{};
+  size_t len_ = 0;
+  const StringDictionary *dict_ = nullptr;
+  bool splice_ = false;
+
+  void assign(std::string_view value)
+  {
+    len_ = std::min(value.size(), N);
+    std::copy_n(value.data(), len_, buf_.data());
+  }
+
+public:
+  ValueFixedString(std::string_view init, ValueLink &link)
+  {
+    assign(init);
+    link.add(this);
+  }
+  ValueFixedString(const ValueFixedString &) = default;
+  ~ValueFixedString() override = default;
+
+  static const void *typeTagValue()
+  {
+    static const int tag = 0;
+    return &tag;
+  }
+  [[nodiscard]] const void *typeTag() const override { return typeTagValue(); }
+
+  //
+  [[nodiscard]] bool equal(const ValueFixedString<N> &other) const
+  {
+    return view() == other.view();
+  }
+  [[nodiscard]] bool equal(const ValueInterface &other) const override
+  {
+    if (auto *oval = valueCast<ValueFixedString<N>>(other))
+    {
+      return equal(*oval);
+    }
+    return false;
+  }
+  void copy(const ValueFixedString<N> &other)
+  {
+    assign(other.view());
+    markDirty();
+  }
+  void copy(const ValueInterface &other) override
+  {
+    if (auto *oval = valueCast<ValueFixedString<N>>(other))
+    {
+      copy(*oval);
+    }
+  }
+  [[nodiscard]] size_t getByteSize() const override { return len_; }
+
+  // 辞書の指定(nullptrで解除、辞書は呼び出し側で保持)
+  // エンコードが変わるので変更扱いで通知する
+  // (設定済みの辞書へ登録を足した場合も、同じ辞書でもう一度呼ぶこと)
+  void setDictionary(const StringDictionary *dict)
+  {
+    dict_ = dict;
+    markDirty();
+  }
+  // 差分で前後の一致部分を除いた中央だけを送る(読み込み側の設定は不要)
+  void setSpliceDiff(bool enable) { splice_ = enable; }
+
+  //
+  bool serialize(Serializer &ser) const override
+  {
+    return StringCodec::write(ser, view(), dict_);
+  }
+  bool serializeDiff(Serializer &ser, const ValueFixedString<N> &other) const
+  {
+    return StringCodec::writeDiff(ser, view(), other.view(), dict_, splice_);
+  }
+  bool serializeDiff(Serializer &ser,
+                     const ValueInterface &other) const override
+  {
+    if (auto *oval = valueCast<ValueFixedString<N>>(other))
+    {
+      return serializeDiff(ser, *oval);
+    }
+    return false;
+  }
+  [[nodiscard]] size_t measureBits() const override
+  {
+    return StringCodec::measure(view(), dict_);
+  }
+  [[nodiscard]] size_t
+  measureDiffBits(const ValueInterface &other) const override
+  {
+    if (auto *oval = valueCast<ValueFixedString<N>>(other))
+    {
+      return StringCodec::measureDiff(view(), oval->view(), dict_,
+                                      splice_);
+    }
+    return 0;
+  }
+  bool skip(Serializer &ser) const override
+  {
+    return StringCodec::skip(ser, false);
+  }
+  bool skipDiff(Serializer &ser) const override
+  {
+    return StringCodec::skip(ser, true);
+  }
+  bool deserialize(Serializer &ser) override
+  {
+    bool changed;
+    auto result =
+        StringCodec::read(ser, buf_.data(), len_, N, dict_, false, changed);
+    if (changed)
+    {
+      markDirty();
+    }
+    return result;
+  }
+  bool deserializeDiff(Serializer &ser) override
+  {
+    bool changed;
+    auto result =
+        StringCodec::read(ser, buf_.data(), len_, N, dict_, true, changed);
+    if (changed)
+    {
+      markDirty();
+    }
+    return result;
+  }
+
+  //
+  static constexpr size_t capacity() { return N; }
+  [[nodiscard]] size_t size() const { return len_; }
+  [[nodiscard]] std::string_view view() const { return {buf_.data(), len_}; }
+  std::string_view operator()() const { return view(); }
+  explicit operator std::string() const { return std::string(view()); }
+  bool operator!() const { return len_ == 0; }
+  ValueFixedString &operator=(const ValueFixedString &other)
+  {
+    copy(other);
+    return *this;
+  }
+  ValueFixedString &operator=(std::string_view value)
+  {
+    assign(value);
+    markDirty();
+    return *this;
+  }
+  bool operator==(const ValueFixedString &other) const { return equal(other); }
+  bool operator!=(const ValueFixedString &other) const
+  {
+    return !(*this == other);
+  }
+};
+
+//
+// 浮動小数点の固定小数点量子化
+// [minValue, maxValue] を precision 刻みの整数コードにして送る(範囲外は端に丸める)
+// 読み書きの両側で同じ設定にすること
+// precisionは型の分解能より粗くすること(復元値から同じコードに戻るように)
+//
+class FloatQuantize
+{
+  double min_ = 0.0;
+  double step_ = 0.0;
+  double inverse_ = 0.0;
+  uint64_t maxCode_ = 0;
+  size_t bits_ = 0;
+
+public:
+  FloatQuantize() = default;
+  FloatQuantize(double minValue, double maxValue, double precision)
+  {
+    if (precision > 0.0 && maxValue > minValue)
+    {
+      min_ = minValue;
+      step_ = precision;
+      inverse_ = 1.0 / precision;
+      maxCode_ = uint64_t((maxValue - minValue) * inverse_ + 0.5);
+      // writeNumberの半分/1/4の幅が偶数になるよう8bit単位
+      bits_ = std::max<size_t>((std::bit_width(maxCode_) + 7ULL) & ~7ULL, 8);
+    }
+  }
+
+  // 無効(precision<=0など)なら量子化しない
+  [[nodiscard]] bool enabled() const { return step_ > 0.0; }
+  // コードの最大ビット数
+  [[nodiscard]] size_t bits() const { return bits_; }
+
+  [[nodiscard]] uint64_t encode(double value) const
+  {
+    // NaNも下端にする
+    if (!(value > min_))
+    {
+      return 0;
+    }
+    auto code = (value - min_) * inverse_ + 0.5;
+    return code < double(maxCode_) ? uint64_t(code) : maxCode_;
+  }
+  [[nodiscard]] double decode(uint64_t code) const
+  {
+    return min_ + double(std::min(code, maxCode_)) * step_;
+  }
+};
+
 //
 // number base
 //
@@ -348,21 +1381,165 @@ class ValueNumber : public ValueInterface
 public:
   ~ValueNumber() override = default;
 
+  // 配列要素のサイズ種別(ArraySizeBits)ごとのビット数
+  static constexpr std::array<uint8_t, 8> ArrayBitList = {2,  4,  8,  16,
+                                                         24, 32, 48, 64};
+
 protected:
   using IntType = int64_t;
   using UIntType = uint64_t;
 
+  // 符号付きの差分(to - from)とその適用
+  // 64bit未満は広げて正確に、64bitは2の補数で巻き戻す(どちらもaddDiffで戻る)
+  template <class T>
+  static IntType signedDiff(T from, T to)
+  {
+    if constexpr (sizeof(T) < sizeof(IntType))
+    {
+      return IntType(to) - IntType(from);
+    }
+    else
+    {
+      return IntType(UIntType(to) - UIntType(from));
+    }
+  }
+  template <class T>
+  static T addDiff(T value, IntType diff)
+  {
+    return T(UIntType(value) + UIntType(diff));
+  }
+
+  // 有効ビット幅 -> サイズ種別
+  static constexpr std::array<uint8_t, 65> ArrayTypeTable = [] {
+    std::array<uint8_t, 65> table{};
+    uint8_t type = 0;
+    for (size_t width = 0; width < table.size(); width++)
+    {
+      while (ArrayBitList[type] < width)
+      {
+        type++;
+      }
+      table[width] = type;
+    }
+    return table;
+  }();
+  // 分岐なしでサイズ種別を求める(配列全体をまとめて分類できるように)
+  static constexpr uint8_t arrayValueType(UIntType num)
+  {
+    return ArrayTypeTable[std::bit_width(num)];
+  }
+  static constexpr uint8_t arrayValueType(IntType num)
+  {
+    return arrayValueType(zigZag(num));
+  }
+  // 符号付きはジグザグ符号化(0,-1,1,-2,... -> 0,1,2,3,...)して書く
+  // 絶対値の小さい値ほど短くなるので、小さな差分が少ないビット数で済む
+  static constexpr UIntType zigZag(IntType num)
+  {
+    return (UIntType(num) << 1ULL) ^ UIntType(num >> 63);
+  }
+  static constexpr IntType unZigZag(UIntType code)
+  {
+    return IntType(code >> 1ULL) ^ -IntType(code & 1ULL);
+  }
+
+  // 浮動小数点のビット列
+  template <class FType>
+  using FloatBits =
+      std::conditional_t<sizeof(FType) == sizeof(uint32_t), uint32_t, uint64_t>;
+  template <class FType>
+  static constexpr UIntType floatBits(FType value)
+  {
+    return std::bit_cast<FloatBits<FType>>(value);
+  }
+  template <class FType>
+  static constexpr FType bitsFloat(UIntType bits)
+  {
+    return std::bit_cast<FType>(FloatBits<FType>(bits));
+  }
+
+  // writeNumberで値に使うビット数
+  // 符号なしは型の幅(bits)の1/2、1/4に収まればその幅
+  // 符号付きはジグザグ符号化した値が収まる幅(2bit単位)
+  static constexpr size_t numberWidth(UIntType num, size_t bits)
+  {
+    auto halfBit = bits >> 1ULL;
+    if (num < (1ULL << halfBit))
+    {
+      auto quarterBit = halfBit >> 1ULL;
+      return num < (1ULL << quarterBit) ? quarterBit : halfBit;
+    }
+    return bits;
+  }
+  static constexpr size_t numberWidth(IntType num)
+  {
+    return std::max<size_t>((std::bit_width(zigZag(num)) + 1ULL) & ~1ULL, 2);
+  }
+  // writeNumberで書くビット数(0はBaseBitsのみ)
+  static constexpr size_t numberBits(UIntType num, size_t bits)
+  {
+    return num == 0 ? BaseBits : BaseBits + SizeBits + numberWidth(num, bits);
+  }
+  static constexpr size_t numberBits(IntType num)
+  {
+    return num == 0 ? BaseBits : BaseBits + SizeBits + numberWidth(num);
+  }
+
   static bool writeNumber(Serializer &ser, UIntType num, size_t bits);
   static bool writeNumber(Serializer &ser, IntType num, size_t bits);
   static bool readNumber(Serializer &ser, UIntType &num);
   static bool readNumber(Serializer &ser, IntType &num);
+  // 数値/配列要素/配列全体を値を作らずに読み飛ばす
+  static bool skipNumber(Serializer &ser);
+  static bool skipArrayValue(Serializer &ser);
+  static bool skipTaggedArray(Serializer &ser);
+  static bool skipPackedArray(Serializer &ser);
 
   static bool writeArrayHeader(Serializer &ser, size_t num);
   static bool readArrayHeader(Serializer &ser, size_t &num);
+  // 配列ヘッダー(Tagged/Packed共通)とサイズ種別付き要素のビット数
+  static constexpr size_t ArrayHeaderBits = BaseBits + SizeBits + ByteBits;
+  static constexpr size_t arrayValueBits(uint8_t type)
+  {
+    return ArraySizeBits + ArrayBitList[type];
+  }
+  // Packed配列: サイズ欄にPackedArrayTagを入れて区別する
+  static constexpr size_t PackedArrayTag = (1ULL << SizeBits) - 1;
+  static constexpr size_t PackBlock = 16;
+  static constexpr size_t PackWidthBits = 7;
+  static bool writePackedHeader(Serializer &ser, size_t num);
+  static bool readPackedHeader(Serializer &ser, size_t &num);
+  // 共通ビット幅 + 各要素のオフセット
+  static bool writePackedBlock(Serializer &ser, const UIntType *offsets,
+                               size_t num);
+  static bool readPackedBlock(Serializer &ser, UIntType *offsets, size_t num);
+  static bool writeUnchangedArray(Serializer &ser, size_t num);
+  // RunLength差分の要素スキップ
+  static bool writeElementRun(Serializer &ser, size_t run);
+  static bool writeElementMark(Serializer &ser);
+  static bool readElementRun(Serializer &ser, size_t &run);
   static bool writeArrayValue(Serializer &ser, UIntType num);
   static bool writeArrayValue(Serializer &ser, IntType num);
+  // サイズ種別を求め済みの要素書き込み(種別と値を1回で書く)
+  static bool writeArrayValue(Serializer &ser, UIntType num, uint8_t type);
+  static bool writeArrayValue(Serializer &ser, IntType num, uint8_t type);
   static bool readArrayValue(Serializer &ser, UIntType &num);
   static bool readArrayValue(Serializer &ser, IntType &num);
+  // 浮動小数点のXOR差分: 0ならBBZero、それ以外はBBOther +
+  // 末尾の0の数(XorShiftBits) + 有効ビット数-1(XorShiftBits) + 有効ビット(先頭の1を除く)
+  static constexpr size_t XorShiftBits = 6;
+  static bool writeXorDiff(Serializer &ser, UIntType diff);
+  static bool readXorDiff(Serializer &ser, UIntType &diff);
+  static bool skipXorDiff(Serializer &ser);
+  static constexpr size_t xorDiffBits(UIntType diff)
+  {
+    if (diff == 0)
+    {
+      return BaseBits;
+    }
+    auto body = diff >> std::countr_zero(diff);
+    return BaseBits + XorShiftBits * 2 + std::bit_width(body) - 1;
+  }
 };
 
 //
@@ -371,11 +1548,15 @@ protected:
 template <class NType>
 class Value : public ValueNumber
 {
+  static_assert(std::is_integral_v<NType>,
+                "use ValueFloat/ValueDouble for floating point");
+
 protected:
   NType num_;
 
 public:
   Value(NType num, ValueLink &link) : num_(num) { link.add(this); }
+  Value(const Value &) = default;
   ~Value() override = default;
 
   static const void *typeTagValue()
@@ -386,20 +1567,37 @@ public:
   [[nodiscard]] const void *typeTag() const override { return typeTagValue(); }
 
   //
+  [[nodiscard]] bool equal(const Value<NType> &other) const
+  {
+    return num_ == other.num_;
+  }
   [[nodiscard]] bool equal(const ValueInterface &other) const override
   {
     if (auto *oval = valueCast<Value<NType>>(other))
     {
-      return num_ == oval->num_;
+      return equal(*oval);
     }
     return false;
   }
+  void copy(const Value<NType> &other)
+  {
+    num_ = other.num_;
+    markDirty();
+  }
   void copy(const ValueInterface &other) override
   {
     if (auto *oval = valueCast<Value<NType>>(other))
     {
-      num_ = oval->num_;
+      copy(*oval);
+    }
+  }
+  [[nodiscard]] RawBytes rawBytes() const override
+  {
+    if (!isExactly<Value<NType>>())
+    {
+      return {};
     }
+    return valueBytes(sizeof(*this), num_);
   }
   [[nodiscard]] size_t getByteSize() const override { return sizeof(NType); }
 
@@ -417,29 +1615,67 @@ public:
       return writeNumber(ser, val, sizeof(NType) * ByteBits);
     }
   }
-  bool serializeDiff(Serializer &ser,
-                     const ValueInterface &other) const override
+  bool serializeDiff(Serializer &ser, const Value<NType> &other) const
   {
-    if (auto *oval = valueCast<Value<NType>>(other))
+    if constexpr (std::is_signed_v<NType>)
     {
-      if constexpr (std::is_signed_v<NType>)
-      {
-        IntType diff = oval->num_ - num_;
-        return writeNumber(ser, diff, sizeof(NType) * ByteBits);
-      }
-      else
+      IntType diff = signedDiff(num_, other.num_);
+      return writeNumber(ser, diff, sizeof(NType) * ByteBits);
+    }
+    else
+    {
+      if (other.num_ >= num_)
       {
-        if (oval->num_ >= num_)
-        {
-          UIntType diff = (oval->num_ - num_) << 1ULL;
-          return writeNumber(ser, diff, sizeof(NType) * ByteBits);
-        }
-        UIntType diff = (num_ - oval->num_) << 1ULL | 1ULL;
+        UIntType diff = (other.num_ - num_) << 1ULL;
         return writeNumber(ser, diff, sizeof(NType) * ByteBits);
       }
+      UIntType diff = (num_ - other.num_) << 1ULL | 1ULL;
+      return writeNumber(ser, diff, sizeof(NType) * ByteBits);
+    }
+  }
+  bool serializeDiff(Serializer &ser,
+                     const ValueInterface &other) const override
+  {
+    if (auto *oval = valueCast<Value<NType>>(other))
+    {
+      return serializeDiff(ser, *oval);
     }
     return false;
   }
+  [[nodiscard]] size_t measureBits() const override
+  {
+    if constexpr (std::is_signed_v<NType>)
+    {
+      return numberBits(IntType(num_));
+    }
+    else
+    {
+      return numberBits(UIntType(num_), sizeof(NType) * ByteBits);
+    }
+  }
+  [[nodiscard]] size_t measureDiffBits(const Value<NType> &other) const
+  {
+    if constexpr (std::is_signed_v<NType>)
+    {
+      return numberBits(signedDiff(num_, other.num_));
+    }
+    else
+    {
+      UIntType diff = other.num_ >= num_ ? (other.num_ - num_) << 1ULL
+                                         : (num_ - other.num_) << 1ULL | 1ULL;
+      return numberBits(diff, sizeof(NType) * ByteBits);
+    }
+  }
+  [[nodiscard]] size_t
+  measureDiffBits(const ValueInterface &other) const override
+  {
+    if (auto *oval = valueCast<Value<NType>>(other))
+    {
+      return measureDiffBits(*oval);
+    }
+    return 0;
+  }
+  bool skip(Serializer &ser) const override { return skipNumber(ser); }
   bool deserialize(Serializer &ser) override
   {
     if constexpr (std::is_signed_v<NType>)
@@ -448,6 +1684,7 @@ public:
       if (readNumber(ser, val))
       {
         num_ = val;
+        markDirty();
         return true;
       }
     }
@@ -457,6 +1694,7 @@ public:
       if (readNumber(ser, val))
       {
         num_ = val;
+        markDirty();
         return true;
       }
     }
@@ -469,7 +1707,8 @@ public:
       IntType diff;
       if (readNumber(ser, diff))
       {
-        num_ += diff;
+        num_ = addDiff(num_, diff);
+        markDirty();
         return true;
       }
     }
@@ -486,6 +1725,7 @@ public:
         {
           num_ += diff >> 1ULL;
         }
+        markDirty();
         return true;
       }
     }
@@ -498,11 +1738,13 @@ public:
   Value &operator=(const Value<NType> &other)
   {
     num_ = other.num_;
+    markDirty();
     return *this;
   }
   Value &operator=(NType num)
   {
     num_ = num;
+    markDirty();
     return *this;
   }
   bool operator==(const Value<NType> &other) const
@@ -524,17 +1766,20 @@ class ValueBits : public Value<NType>
 {
 public:
   ValueBits(NType init, ValueLink &link) : Value<NType>(init, link) {}
+  ValueBits(const ValueBits &) = default;
   ~ValueBits() override = default;
 
   //
   ValueBits &operator=(const ValueBits<NType> &other)
   {
     Value<NType>::num_ = other.num_;
+    Value<NType>::markDirty();
     return *this;
   }
   ValueBits &operator=(NType num)
   {
     Value<NType>::num_ = num;
+    Value<NType>::markDirty();
     return *this;
   }
 
@@ -557,6 +1802,7 @@ public:
     {
       Value<NType>::num_ &= ~bitMask;
     }
+    Value<NType>::markDirty();
   }
   [[nodiscard]] bool get(NType bit) const
   {
@@ -567,19 +1813,41 @@ public:
     auto bitMask = 1 << bit;
     return (Value<NType>::num_ & bitMask) != 0;
   }
+
+  // メンバーを足していないのでValueと同じくバイト列として扱える
+  [[nodiscard]] ValueInterface::RawBytes rawBytes() const override
+  {
+    if (!this->template isExactly<ValueBits<NType>>())
+    {
+      return {};
+    }
+    return this->valueBytes(sizeof(*this), Value<NType>::num_);
+  }
 };
 
 //
-// array numbers
+// floating point
+// 差分は前の値とのビット列のXOR(近い値ほど上位・下位に0が並ぶ)
+// setQuantizeで量子化すると整数コードとその差分で送る
 //
-template <class NType, size_t Size>
-class ValueArray : public ValueNumber
+template <class FType>
+class ValueReal : public ValueNumber
 {
-  std::array<NType, Size> array_;
+  static_assert(std::is_floating_point_v<FType> &&
+                    (sizeof(FType) == sizeof(uint32_t) ||
+                     sizeof(FType) == sizeof(uint64_t)),
+                "float or double only");
+
+  FType num_;
+  FloatQuantize quantize_;
+
+  [[nodiscard]] UIntType code() const { return quantize_.encode(num_); }
+  void decode(UIntType code) { num_ = FType(quantize_.decode(code)); }
 
 public:
-  ValueArray(NType init, ValueLink &link) : array_{init} { link.add(this); }
-  ~ValueArray() override = default;
+  ValueReal(FType num, ValueLink &link) : num_(num) { link.add(this); }
+  ValueReal(const ValueReal &) = default;
+  ~ValueReal() override = default;
 
   static const void *typeTagValue()
   {
@@ -588,138 +1856,652 @@ public:
   }
   [[nodiscard]] const void *typeTag() const override { return typeTagValue(); }
 
+  // 量子化の設定(デフォルト構築のFloatQuantizeで解除)
+  // エンコードが変わるので値の変更と同じく通知する
+  void setQuantize(const FloatQuantize &quantize)
+  {
+    quantize_ = quantize;
+    markDirty();
+  }
+  [[nodiscard]] const FloatQuantize &getQuantize() const { return quantize_; }
+
   //
+  // ビット列で比較する(-0.0と0.0は別、NaNは同じNaNと等しい)
+  [[nodiscard]] bool equal(const ValueReal<FType> &other) const
+  {
+    return floatBits(num_) == floatBits(other.num_);
+  }
   [[nodiscard]] bool equal(const ValueInterface &other) const override
   {
-    if (auto *oval = valueCast<ValueArray<NType, Size>>(other))
+    if (auto *oval = valueCast<ValueReal<FType>>(other))
     {
-      for (size_t i = 0; i < Size; i++)
-      {
-        if (at(i) != oval->at(i))
-        {
-          return false;
-        }
-      }
-      return true;
+      return equal(*oval);
     }
     return false;
   }
+  void copy(const ValueReal<FType> &other)
+  {
+    num_ = other.num_;
+    markDirty();
+  }
   void copy(const ValueInterface &other) override
   {
-    if (auto *oval = valueCast<ValueArray<NType, Size>>(other))
+    if (auto *oval = valueCast<ValueReal<FType>>(other))
     {
-      array_ = oval->array_;
+      copy(*oval);
     }
   }
-  [[nodiscard]] size_t getByteSize() const override { return sizeof(NType); }
-  [[nodiscard]] size_t getArraySize() const override { return Size; }
+  [[nodiscard]] size_t getByteSize() const override { return sizeof(FType); }
 
   //
   bool serialize(Serializer &ser) const override
   {
-    if (!writeArrayHeader(ser, Size))
+    if (quantize_.enabled())
     {
-      return false;
+      return writeNumber(ser, code(), quantize_.bits());
     }
-    for (auto item : array_)
+    return writeNumber(ser, floatBits(num_), sizeof(FType) * ByteBits);
+  }
+  bool serializeDiff(Serializer &ser, const ValueReal<FType> &other) const
+  {
+    if (quantize_.enabled())
     {
-      if constexpr (std::is_signed_v<NType>)
+      IntType diff = IntType(other.code() - code());
+      return writeNumber(ser, diff, sizeof(IntType) * ByteBits);
+    }
+    return writeXorDiff(ser, floatBits(num_) ^ floatBits(other.num_));
+  }
+  bool serializeDiff(Serializer &ser,
+                     const ValueInterface &other) const override
+  {
+    if (auto *oval = valueCast<ValueReal<FType>>(other))
+    {
+      return serializeDiff(ser, *oval);
+    }
+    return false;
+  }
+  [[nodiscard]] size_t measureBits() const override
+  {
+    if (quantize_.enabled())
+    {
+      return numberBits(code(), quantize_.bits());
+    }
+    return numberBits(floatBits(num_), sizeof(FType) * ByteBits);
+  }
+  [[nodiscard]] size_t measureDiffBits(const ValueReal<FType> &other) const
+  {
+    if (quantize_.enabled())
+    {
+      return numberBits(IntType(other.code() - code()));
+    }
+    return xorDiffBits(floatBits(num_) ^ floatBits(other.num_));
+  }
+  [[nodiscard]] size_t
+  measureDiffBits(const ValueInterface &other) const override
+  {
+    if (auto *oval = valueCast<ValueReal<FType>>(other))
+    {
+      return measureDiffBits(*oval);
+    }
+    return 0;
+  }
+  bool skip(Serializer &ser) const override { return skipNumber(ser); }
+  bool skipDiff(Serializer &ser) const override
+  {
+    return quantize_.enabled() ? skipNumber(ser) : skipXorDiff(ser);
+  }
+  bool deserialize(Serializer &ser) override
+  {
+    UIntType val;
+    if (!readNumber(ser, val))
+    {
+      return false;
+    }
+    if (quantize_.enabled())
+    {
+      decode(val);
+    }
+    else
+    {
+      num_ = bitsFloat<FType>(val);
+    }
+    markDirty();
+    return true;
+  }
+  bool deserializeDiff(Serializer &ser) override
+  {
+    if (quantize_.enabled())
+    {
+      IntType diff;
+      if (!readNumber(ser, diff))
       {
-        IntType value = item;
-        if (!writeArrayValue(ser, value))
-        {
-          return false;
-        }
+        return false;
+      }
+      decode(code() + UIntType(diff));
+    }
+    else
+    {
+      UIntType diff;
+      if (!readXorDiff(ser, diff))
+      {
+        return false;
+      }
+      num_ = bitsFloat<FType>(floatBits(num_) ^ diff);
+    }
+    markDirty();
+    return true;
+  }
+
+  //
+  explicit operator FType() const { return num_; }
+  FType operator()() const { return num_; }
+  ValueReal &operator=(const ValueReal<FType> &other)
+  {
+    copy(other);
+    return *this;
+  }
+  ValueReal &operator=(FType num)
+  {
+    num_ = num;
+    markDirty();
+    return *this;
+  }
+  bool operator==(const ValueReal<FType> &other) const
+  {
+    return num_ == other.num_;
+  }
+  bool operator==(FType num) const { return num_ == num; }
+  bool operator!=(const ValueReal<FType> &other) const
+  {
+    return !(*this == other);
+  }
+  bool operator!=(FType num) const { return num_ != num; }
+};
+
+using ValueFloat = ValueReal<float>;
+using ValueDouble = ValueReal<double>;
+
+//
+// array numbers
+//
+template <class NType, size_t Size, ArrayFormat Format = ArrayFormat::Tagged>
+class ValueArray : public ValueNumber
+{
+  static constexpr bool IsFloat = std::is_floating_point_v<NType>;
+  struct NoQuantize
+  {
+  };
+
+  std::array<NType, Size> array_;
+  // 浮動小数点の配列のみ(全要素共通)
+  [[no_unique_address]] std::conditional_t<IsFloat, FloatQuantize, NoQuantize>
+      quantize_;
+
+  // 配列要素の書き込み型(浮動小数点はビット列か量子化コード)
+  using ElementType =
+      std::conditional_t<std::is_signed_v<NType> && !IsFloat, IntType,
+                         UIntType>;
+
+  // 要素 <-> 書き込み値
+  ElementType encodeValue(NType num) const
+  {
+    if constexpr (IsFloat)
+    {
+      return quantize_.enabled() ? quantize_.encode(num) : floatBits(num);
+    }
+    else
+    {
+      return num;
+    }
+  }
+  NType decodeValue(ElementType val) const
+  {
+    if constexpr (IsFloat)
+    {
+      return quantize_.enabled() ? NType(quantize_.decode(val))
+                                 : bitsFloat<NType>(val);
+    }
+    else
+    {
+      return NType(val);
+    }
+  }
+  // 要素の差分(from -> to)
+  ElementType diffValue(NType from, NType to) const
+  {
+    if constexpr (IsFloat)
+    {
+      if (quantize_.enabled())
+      {
+        return zigZag(IntType(encodeValue(to) - encodeValue(from)));
+      }
+      return floatBits(from) ^ floatBits(to);
+    }
+    else if constexpr (std::is_signed_v<NType>)
+    {
+      return signedDiff(from, to);
+    }
+    else
+    {
+      if (to >= from)
+      {
+        return UIntType(to - from) << 1ULL;
+      }
+      return UIntType(from - to) << 1ULL | 1ULL;
+    }
+  }
+  // 全要素の書き込み値/差分
+  std::array<ElementType, Size> encodeValues() const
+  {
+    std::array<ElementType, Size> values;
+    for (size_t i = 0; i < Size; i++)
+    {
+      values[i] = encodeValue(array_[i]);
+    }
+    return values;
+  }
+  std::array<ElementType, Size>
+  diffValues(const ValueArray<NType, Size, Format> &other) const
+  {
+    std::array<ElementType, Size> values;
+    for (size_t i = 0; i < Size; i++)
+    {
+      values[i] = diffValue(at(i), other.at(i));
+    }
+    return values;
+  }
+  // 全要素のサイズ種別を先にまとめて求めてから書き出す
+  static bool writeTaggedValues(Serializer &ser,
+                                const std::array<ElementType, Size> &values)
+  {
+    std::array<uint8_t, Size> types;
+    for (size_t i = 0; i < Size; i++)
+    {
+      types[i] = arrayValueType(values[i]);
+    }
+    for (size_t i = 0; i < Size; i++)
+    {
+      if (!writeArrayValue(ser, values[i], types[i]))
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+  // 要素の差分適用
+  void applyDiff(NType &item, ElementType val) const
+  {
+    if constexpr (IsFloat)
+    {
+      if (quantize_.enabled())
+      {
+        item = decodeValue(encodeValue(item) + UIntType(unZigZag(val)));
       }
       else
       {
-        UIntType value = item;
-        if (!writeArrayValue(ser, value))
+        item = bitsFloat<NType>(floatBits(item) ^ val);
+      }
+    }
+    else if constexpr (std::is_signed_v<NType>)
+    {
+      item = addDiff(item, IntType(val));
+    }
+    else if (val & 1)
+    {
+      item -= val >> 1ULL;
+    }
+    else
+    {
+      item += val >> 1ULL;
+    }
+  }
+  // 要素の差分読み込みと適用
+  bool readDiffValue(Serializer &ser, NType &item) const
+  {
+    ElementType val;
+    if (!readArrayValue(ser, val))
+    {
+      return false;
+    }
+    applyDiff(item, val);
+    return true;
+  }
+
+  // ブロックごとに 最小値(サイズ種別付き) + 共通ビット幅 + 最小値からの差
+  static bool writePackedValues(Serializer &ser,
+                                const std::array<ElementType, Size> &values)
+  {
+    std::array<UIntType, PackBlock> offsets;
+    for (size_t top = 0; top < Size; top += PackBlock)
+    {
+      auto num = std::min(PackBlock, Size - top);
+      auto *block = values.data() + top;
+      auto base = *std::min_element(block, block + num);
+      for (size_t i = 0; i < num; i++)
+      {
+        offsets[i] = UIntType(block[i]) - UIntType(base);
+      }
+      if (!writeArrayValue(ser, base) ||
+          !writePackedBlock(ser, offsets.data(), num))
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+  static bool readPackedValues(Serializer &ser,
+                               std::array<ElementType, Size> &values)
+  {
+    std::array<UIntType, PackBlock> offsets;
+    for (size_t top = 0; top < Size; top += PackBlock)
+    {
+      auto num = std::min(PackBlock, Size - top);
+      ElementType base;
+      if (!readArrayValue(ser, base) ||
+          !readPackedBlock(ser, offsets.data(), num))
+      {
+        return false;
+      }
+      for (size_t i = 0; i < num; i++)
+      {
+        values[top + i] = ElementType(UIntType(base) + offsets[i]);
+      }
+    }
+    return true;
+  }
+  // Formatに応じたヘッダーと全要素の書き込み/読み込み
+  static bool writeElements(Serializer &ser,
+                            const std::array<ElementType, Size> &values)
+  {
+    if constexpr (Format == ArrayFormat::Packed)
+    {
+      return writePackedHeader(ser, Size) && writePackedValues(ser, values);
+    }
+    else
+    {
+      return writeArrayHeader(ser, Size) && writeTaggedValues(ser, values);
+    }
+  }
+  // writeElementsで書くビット数
+  static size_t measureElements(const std::array<ElementType, Size> &values)
+  {
+    size_t bits = ArrayHeaderBits;
+    if constexpr (Format == ArrayFormat::Packed)
+    {
+      for (size_t top = 0; top < Size; top += PackBlock)
+      {
+        auto num = std::min(PackBlock, Size - top);
+        auto *block = values.data() + top;
+        auto base = *std::min_element(block, block + num);
+        UIntType range = 0;
+        for (size_t i = 0; i < num; i++)
         {
-          return false;
+          range |= UIntType(block[i]) - UIntType(base);
         }
+        bits += arrayValueBits(arrayValueType(base)) + PackWidthBits +
+                num * std::bit_width(range);
       }
     }
-    return true;
+    else
+    {
+      for (auto val : values)
+      {
+        bits += arrayValueBits(arrayValueType(val));
+      }
+    }
+    return bits;
   }
-  bool serializeDiff(Serializer &ser,
-                     const ValueInterface &other) const override
+  static bool readElements(Serializer &ser,
+                           std::array<ElementType, Size> &values)
   {
-    if (auto *oval = valueCast<ValueArray<NType, Size>>(other))
+    size_t nbData;
+    if constexpr (Format == ArrayFormat::Packed)
     {
-      if (!writeArrayHeader(ser, Size))
+      if (!readPackedHeader(ser, nbData) || nbData != Size)
       {
         return false;
       }
-      for (size_t i = 0; i < Size; i++)
+      return readPackedValues(ser, values);
+    }
+    else
+    {
+      if (!readArrayHeader(ser, nbData) || nbData != Size)
       {
-        if constexpr (std::is_signed_v<NType>)
+        return false;
+      }
+      for (auto &val : values)
+      {
+        if (!readArrayValue(ser, val))
         {
-          IntType diff = oval->at(i) - at(i);
-          if (!writeArrayValue(ser, diff))
-          {
-            return false;
-          }
+          return false;
         }
-        else
+      }
+      return true;
+    }
+  }
+
+public:
+  ValueArray(NType init, ValueLink &link) : array_{init} { link.add(this); }
+  ~ValueArray() override = default;
+
+  static const void *typeTagValue()
+  {
+    static const int tag = 0;
+    return &tag;
+  }
+  [[nodiscard]] const void *typeTag() const override { return typeTagValue(); }
+
+  //
+  [[nodiscard]] bool equal(const ValueArray<NType, Size, Format> &other) const
+  {
+    if constexpr (IsFloat)
+    {
+      // ValueRealと同じくビット列で比較
+      for (size_t i = 0; i < Size; i++)
+      {
+        if (floatBits(at(i)) != floatBits(other.at(i)))
         {
-          UIntType diff;
-          auto dstVal = oval->at(i);
-          auto val = at(i);
-          if (dstVal >= val)
-          {
-            diff = (dstVal - val) << 1ULL;
-          }
-          else
-          {
-            diff = (val - dstVal) << 1ULL | 1ULL;
-          }
-          if (!writeArrayValue(ser, diff))
-          {
-            return false;
-          }
+          return false;
         }
       }
       return true;
     }
+    for (size_t i = 0; i < Size; i++)
+    {
+      if (at(i) != other.at(i))
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+  [[nodiscard]] bool equal(const ValueInterface &other) const override
+  {
+    if (auto *oval = valueCast<ValueArray<NType, Size, Format>>(other))
+    {
+      return equal(*oval);
+    }
     return false;
   }
-  bool deserialize(Serializer &ser) override
+  void copy(const ValueArray<NType, Size, Format> &other)
   {
-    size_t nbData;
-    if (!readArrayHeader(ser, nbData))
+    array_ = other.array_;
+    markDirty();
+  }
+  void copy(const ValueInterface &other) override
+  {
+    if (auto *oval = valueCast<ValueArray<NType, Size, Format>>(other))
+    {
+      copy(*oval);
+    }
+  }
+  [[nodiscard]] bool isArray() const override { return true; }
+  [[nodiscard]] RawBytes rawBytes() const override
+  {
+    if constexpr (IsFloat)
+    {
+      // ==と一致しない(NaN, -0.0)のと、量子化設定を持つので対象外
+      return {};
+    }
+    else
+    {
+      if (!isExactly<ValueArray<NType, Size, Format>>())
+      {
+        return {};
+      }
+      return valueBytes(sizeof(*this), array_);
+    }
+  }
+  [[nodiscard]] size_t getByteSize() const override { return sizeof(NType); }
+  [[nodiscard]] size_t getArraySize() const override { return Size; }
+
+  //
+  bool serialize(Serializer &ser) const override
+  {
+    return writeElements(ser, encodeValues());
+  }
+  bool serializeDiff(Serializer &ser,
+                     const ValueArray<NType, Size, Format> &other) const
+  {
+    return writeElements(ser, diffValues(other));
+  }
+  bool serializeDiff(Serializer &ser,
+                     const ValueInterface &other) const override
+  {
+    if (auto *oval = valueCast<ValueArray<NType, Size, Format>>(other))
+    {
+      return serializeDiff(ser, *oval);
+    }
+    return false;
+  }
+  // 要素ごとに 0:スキップ(RunBits) / 1:差分 を前置する
+  // Packedは通常の差分と同じ(変化なしは幅0のブロックになる)
+  bool
+  serializeRunLengthDiff(Serializer &ser,
+                         const ValueArray<NType, Size, Format> &other) const
+  {
+    if constexpr (Format == ArrayFormat::Packed)
+    {
+      return serializeDiff(ser, other);
+    }
+    if (!writeArrayHeader(ser, Size))
     {
       return false;
     }
-    if (nbData != Size)
+    size_t run = 0;
+    for (size_t i = 0; i < Size; i++)
+    {
+      auto val = diffValue(at(i), other.at(i));
+      if (val == 0)
+      {
+        run++;
+        continue;
+      }
+      if (!writeElementRun(ser, run) || !writeElementMark(ser))
+      {
+        return false;
+      }
+      run = 0;
+      if (!writeArrayValue(ser, val))
+      {
+        return false;
+      }
+    }
+    return writeElementRun(ser, run);
+  }
+  bool serializeRunLengthDiff(Serializer &ser,
+                              const ValueInterface &other) const override
+  {
+    if (auto *oval = valueCast<ValueArray<NType, Size, Format>>(other))
+    {
+      return serializeRunLengthDiff(ser, *oval);
+    }
+    return false;
+  }
+  bool serializeUnchanged(Serializer &ser) const override
+  {
+    if constexpr (Format == ArrayFormat::Packed)
+    {
+      return writeElements(ser, {});
+    }
+    return writeUnchangedArray(ser, Size);
+  }
+  bool skip(Serializer &ser) const override
+  {
+    if constexpr (Format == ArrayFormat::Packed)
+    {
+      return skipPackedArray(ser);
+    }
+    return skipTaggedArray(ser);
+  }
+  bool skipRunLengthDiff(Serializer &ser) const override
+  {
+    if constexpr (Format == ArrayFormat::Packed)
+    {
+      return skipDiff(ser);
+    }
+    size_t nbData;
+    if (!readArrayHeader(ser, nbData) || nbData != Size)
     {
       return false;
     }
-    for (auto &item : array_)
+    size_t index = 0;
+    while (index < Size)
     {
-      if constexpr (std::is_signed_v<NType>)
+      size_t run;
+      if (!readElementRun(ser, run))
       {
-        IntType val;
-        if (!readArrayValue(ser, val))
-        {
-          return false;
-        }
-        item = val;
+        return false;
+      }
+      if (run > 0)
+      {
+        index += run;
+      }
+      else if (skipArrayValue(ser))
+      {
+        index++;
       }
       else
       {
-        UIntType val;
-        if (!readArrayValue(ser, val))
-        {
-          return false;
-        }
-        item = val;
+        return false;
       }
     }
+    return index == Size;
+  }
+  bool deserialize(Serializer &ser) override
+  {
+    std::array<ElementType, Size> values;
+    if (!readElements(ser, values))
+    {
+      return false;
+    }
+    markDirty();
+    for (size_t i = 0; i < Size; i++)
+    {
+      array_[i] = decodeValue(values[i]);
+    }
     return true;
   }
   bool deserializeDiff(Serializer &ser) override
   {
+    std::array<ElementType, Size> values;
+    if (!readElements(ser, values))
+    {
+      return false;
+    }
+    markDirty();
+    for (size_t i = 0; i < Size; i++)
+    {
+      applyDiff(array_[i], values[i]);
+    }
+    return true;
+  }
+  bool deserializeRunLengthDiff(Serializer &ser) override
+  {
+    if constexpr (Format == ArrayFormat::Packed)
+    {
+      return deserializeDiff(ser);
+    }
     size_t nbData;
     if (!readArrayHeader(ser, nbData))
     {
@@ -729,46 +2511,82 @@ public:
     {
       return false;
     }
-    for (auto &item : array_)
+    markDirty();
+    size_t index = 0;
+    while (index < Size)
     {
-      if constexpr (std::is_signed_v<NType>)
+      size_t run;
+      if (!readElementRun(ser, run))
       {
-        IntType val;
-        if (!readArrayValue(ser, val))
-        {
-          return false;
-        }
-        item += val;
+        return false;
       }
-      else
+      if (run > 0)
       {
-        UIntType val;
-        if (!readArrayValue(ser, val))
-        {
-          return false;
-        }
-        if (val & 1)
-        {
-          item -= val >> 1ULL;
-        }
-        else
-        {
-          item += val >> 1ULL;
-        }
+        index += run;
+        continue;
+      }
+      if (!readDiffValue(ser, array_[index]))
+      {
+        return false;
       }
+      index++;
     }
-    return true;
+    return index == Size;
+  }
+
+  [[nodiscard]] size_t measureBits() const override
+  {
+    return measureElements(encodeValues());
+  }
+  [[nodiscard]] size_t
+  measureDiffBits(const ValueArray<NType, Size, Format> &other) const
+  {
+    return measureElements(diffValues(other));
+  }
+  [[nodiscard]] size_t
+  measureDiffBits(const ValueInterface &other) const override
+  {
+    if (auto *oval = valueCast<ValueArray<NType, Size, Format>>(other))
+    {
+      return measureDiffBits(*oval);
+    }
+    return 0;
+  }
+
+  // 量子化の設定(浮動小数点の配列のみ、変更扱いで通知する)
+  void setQuantize(const FloatQuantize &quantize)
+    requires IsFloat
+  {
+    quantize_ = quantize;
+    markDirty();
   }
 
   //
   static constexpr size_t size() { return Size; }
   //
-  NType &at(size_t index) { return array_.at(index); }
+  // 非constアクセスは書き換えるものとして変更扱い
+  NType &at(size_t index)
+  {
+    markDirty();
+    return array_.at(index);
+  }
   const NType &at(size_t index) const { return array_.at(index); }
   [[nodiscard]] NType get(size_t index) const { return array_.at(index); }
-  void set(size_t index, NType num = 0) { array_.at(index) = num; }
-  void fill(NType num = 0) { array_.fill(num); }
-  NType *data() { return array_.data(); }
+  void set(size_t index, NType num = 0)
+  {
+    array_.at(index) = num;
+    markDirty();
+  }
+  void fill(NType num = 0)
+  {
+    array_.fill(num);
+    markDirty();
+  }
+  NType *data()
+  {
+    markDirty();
+    return array_.data();
+  }
   const NType *data() const { return array_.data(); }
 };
 
@@ -0,0 +1,304 @@
+//
+// copyright 2025 y.suzuki(wave.suzuki.z@gmail.com)
+//
+#pragma once
+
+#include "record.h"
+#include "serialize.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace record
+{
+
+//
+// レコードアーカイブ(ファイル形式)
+// ヘッダー + ビット列(フレームを連続して書いたもの) + フレーム索引
+// フレームはキーフレーム(serialize)か直前のフレームからの差分(serializeDiff)
+// 読み込みはファイルをmmapして、Serializer::viewでそのまま読む
+//
+// 全て8バイト境界・ネイティブエンディアン(Serializerのワード列と同じ)
+//
+
+// ファイル先頭
+struct ArchiveHeader
+{
+  static constexpr uint32_t Magic = 0x52414352; // "RCAR"
+  static constexpr uint32_t FormatVersion = 1;
+
+  uint32_t magic = Magic;
+  uint32_t formatVersion = FormatVersion;
+  uint64_t frameCount = 0;
+  // ビット列の長さ(ビット列はヘッダーの直後から)
+  uint64_t payloadBits = 0;
+  // フレーム索引のファイル先頭からの位置(バイト)
+  uint64_t indexOffset = 0;
+};
+
+// フレーム索引の1要素
+struct ArchiveFrame
+{
+  static constexpr uint32_t Keyframe = 1;
+  static constexpr uint32_t RunLength = 2; // 差分がDiffFormat::RunLength
+
+  uint64_t offset = 0; // ビット列上の先頭ビット位置
+  uint32_t dataVersion = 0;
+  uint32_t flags = 0;
+
+  [[nodiscard]] bool keyframe() const { return (flags & Keyframe) != 0; }
+  [[nodiscard]] DiffFormat format() const
+  {
+    return (flags & RunLength) != 0 ? DiffFormat::RunLength
+                                    : DiffFormat::Plain;
+  }
+};
+
+static_assert(sizeof(ArchiveHeader) % sizeof(uint64_t) == 0);
+static_assert(sizeof(ArchiveFrame) % sizeof(uint64_t) == 0);
+
+//
+// 書き込み(メモリ上に貯めてsaveでファイルにする)
+//
+class ArchiveWriter
+{
+  static constexpr size_t InitialBytes = 64 * 1024;
+
+  Serializer payload_{InitialBytes, Serializer::Policy::AutoGrow};
+  std::vector<ArchiveFrame> frames_;
+
+public:
+  //
+  // write(ser)でフレームを書く(失敗したらフレームは追加しない)
+  //
+  template <class Write>
+  bool addFrame(uint32_t flags, uint32_t dataVersion, Write write)
+  {
+    auto begPos = payload_.tell();
+    if (!write(payload_))
+    {
+      payload_.rollback(begPos);
+      return false;
+    }
+    frames_.push_back({begPos, dataVersion, flags});
+    return true;
+  }
+  bool addKeyframe(const ValueLink &link)
+  {
+    return addFrame(ArchiveFrame::Keyframe, link.getDataVersion(),
+                    [&](Serializer &ser) { return link.serialize(ser); });
+  }
+  // baseは直前のフレームの状態
+  bool addDelta(const ValueLink &base, const ValueLink &next,
+                DiffFormat format = DiffFormat::Plain)
+  {
+    if (frames_.empty())
+    {
+      return false;
+    }
+    auto flags = format == DiffFormat::RunLength ? ArchiveFrame::RunLength : 0;
+    return addFrame(flags, next.getDataVersion(), [&](Serializer &ser)
+                    { return base.serializeDiff(ser, next, format); });
+  }
+
+  [[nodiscard]] size_t frameCount() const { return frames_.size(); }
+
+  // ファイルへ書き出す
+  bool write(std::FILE *file) const
+  {
+    constexpr size_t WordBits = 64;
+    auto payloadBytes = (payload_.tell() + WordBits - 1) / WordBits * 8;
+    ArchiveHeader header;
+    header.frameCount = frames_.size();
+    header.payloadBits = payload_.tell();
+    header.indexOffset = sizeof(ArchiveHeader) + payloadBytes;
+    auto indexBytes = frames_.size() * sizeof(ArchiveFrame);
+    return std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+           std::fwrite(payload_.data(), 1, payloadBytes, file) ==
+               payloadBytes &&
+           std::fwrite(frames_.data(), 1, indexBytes, file) == indexBytes;
+  }
+  bool save(const char *path) const
+  {
+    auto *file = std::fopen(path, "wb");
+    if (file == nullptr)
+    {
+      return false;
+    }
+    auto result = write(file);
+    return std::fclose(file) == 0 && result;
+  }
+};
+
+//
+// 読み込み(ファイルをmmapするか、メモリ上のイメージを指す)
+// フレームの取り出しはビット列を読むだけで、全体の読み込みやコピーはしない
+//
+class ArchiveView
+{
+  const uint8_t *image_ = nullptr;
+  size_t bytes_ = 0;
+  void *map_ = nullptr; // openでmmapした領域
+  ArchiveHeader header_;
+
+  void release()
+  {
+    if (map_ != nullptr)
+    {
+      ::munmap(map_, bytes_);
+    }
+    map_ = nullptr;
+    image_ = nullptr;
+    bytes_ = 0;
+  }
+
+  // ヘッダーと索引の範囲を確認
+  bool bind(const void *image, size_t bytes)
+  {
+    image_ = static_cast<const uint8_t *>(image);
+    bytes_ = bytes;
+    if (bytes < sizeof(ArchiveHeader))
+    {
+      return false;
+    }
+    std::memcpy(&header_, image_, sizeof(header_));
+    auto payloadBytes = (header_.payloadBits + 63) / 64 * 8;
+    return header_.magic == ArchiveHeader::Magic &&
+           header_.formatVersion == ArchiveHeader::FormatVersion &&
+           header_.indexOffset == sizeof(ArchiveHeader) + payloadBytes &&
+           header_.indexOffset <= bytes &&
+           header_.frameCount <=
+               (bytes - header_.indexOffset) / sizeof(ArchiveFrame);
+  }
+
+public:
+  ArchiveView() = default;
+  // メモリ上のイメージ(8バイト境界、破棄まで有効なこと)
+  ArchiveView(const void *image, size_t bytes)
+  {
+    if (!bind(image, bytes))
+    {
+      image_ = nullptr;
+      header_ = {};
+    }
+  }
+  ArchiveView(const ArchiveView &) = delete;
+  ArchiveView &operator=(const ArchiveView &) = delete;
+  ArchiveView(ArchiveView &&other) noexcept { *this = std::move(other); }
+  ArchiveView &operator=(ArchiveView &&other) noexcept
+  {
+    if (this != &other)
+    {
+      release();
+      image_ = std::exchange(other.image_, nullptr);
+      bytes_ = std::exchange(other.bytes_, 0);
+      map_ = std::exchange(other.map_, nullptr);
+      header_ = std::exchange(other.header_, {});
+    }
+    return *this;
+  }
+  ~ArchiveView() { release(); }
+
+  // ファイルをmmapして開く(失敗したらvalid()がfalse)
+  static ArchiveView open(const char *path)
+  {
+    ArchiveView view;
+    auto fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+    {
+      return view;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+      auto bytes = static_cast<size_t>(st.st_size);
+      auto *map = ::mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (map != MAP_FAILED)
+      {
+        view.map_ = map;
+        if (!view.bind(map, bytes))
+        {
+          view.release();
+          view.header_ = {};
+        }
+      }
+    }
+    ::close(fd);
+    return view;
+  }
+
+  [[nodiscard]] bool valid() const { return image_ != nullptr; }
+  [[nodiscard]] size_t frameCount() const { return header_.frameCount; }
+  [[nodiscard]] ArchiveFrame frame(size_t index) const
+  {
+    ArchiveFrame entry;
+    std::memcpy(&entry,
+                image_ + header_.indexOffset + index * sizeof(ArchiveFrame),
+                sizeof(entry));
+    return entry;
+  }
+
+  // ビット列全体の読み込み専用Serializer
+  [[nodiscard]] Serializer payload() const
+  {
+    auto bytes = header_.indexOffset - sizeof(ArchiveHeader);
+    return Serializer::view(image_ + sizeof(ArchiveHeader), bytes);
+  }
+
+  // index以前で一番近いキーフレーム(無ければframeCount())
+  [[nodiscard]] size_t keyframeBefore(size_t index) const
+  {
+    if (index >= frameCount())
+    {
+      return frameCount();
+    }
+    for (auto i = index + 1; i-- > 0;)
+    {
+      if (frame(i).keyframe())
+      {
+        return i;
+      }
+    }
+    return frameCount();
+  }
+
+  //
+  // index番目のフレームの状態をlinkに作る
+  // (直前のキーフレームを読み、そこからの差分を順に適用する)
+  //
+  bool seek(size_t index, ValueLink &link) const
+  {
+    auto key = keyframeBefore(index);
+    if (key == frameCount())
+    {
+      return false;
+    }
+    auto ser = payload();
+    ser.seek(frame(key).offset);
+    if (!link.deserialize(ser))
+    {
+      return false;
+    }
+    for (auto i = key + 1; i <= index; i++)
+    {
+      auto entry = frame(i);
+      ser.seek(entry.offset);
+      if (!(entry.keyframe() ? link.deserialize(ser)
+                             : link.deserializeDiff(ser, entry.format())))
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+} // namespace record
@@ -0,0 +1,136 @@
+//
+// copyright 2025 y.suzuki(wave.suzuki.z@gmail.com)
+//
+#pragma once
+
+#include "record_parallel.h"
+#include "serialize.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace record
+{
+
+//
+// スナップショット履歴(ベースラインリング)
+// 送信したスナップショットをシーケンス番号ごとにフルエンコードして直近Depth個保持する
+// クライアントごとには受信確認(ack)済みのシーケンス番号だけ持てばよく、
+// レコードのコピーをクライアント数ぶん持たずに、ackされた任意の
+// ベースラインからの差分を作れる
+// (差分はベースラインを作業用レコードへ読み込んでからserializeDiffで作る)
+//
+template <class Record, size_t Depth = 32, class Writer = RecordWriter,
+          class Reader = RecordReader>
+class BaselineRing
+{
+  static constexpr size_t InitialBytes = 4096;
+
+  struct Slot
+  {
+    uint32_t seq = 0;
+    bool valid = false;
+    Serializer data{InitialBytes, Serializer::Policy::AutoGrow};
+    std::vector<size_t> offsets; // 各レコードの先頭ビット位置
+  };
+
+  std::array<Slot, Depth> slots_;
+  Writer writer_;
+  Reader reader_;
+
+  const Slot *find(uint32_t seq) const
+  {
+    const auto &slot = slots_[seq % Depth];
+    return slot.valid && slot.seq == seq ? &slot : nullptr;
+  }
+
+public:
+  BaselineRing(Writer writer = {}, Reader reader = {})
+      : writer_(writer), reader_(reader)
+  {
+  }
+
+  //
+  // records[0..num)をseqのベースラインとして保存
+  // (seq % Depthが同じ古いベースラインは消える)
+  //
+  bool push(uint32_t seq, const Record *records, size_t num)
+  {
+    auto &slot = slots_[seq % Depth];
+    slot.valid = false;
+    slot.seq = seq;
+    slot.data.reset();
+    slot.offsets.resize(num);
+    for (size_t i = 0; i < num; i++)
+    {
+      slot.offsets[i] = slot.data.tell();
+      if (!writer_(slot.data, records[i]))
+      {
+        return false;
+      }
+    }
+    // 書き込みを確定しておく(以降の読み込みはバッファを書き換えない)
+    slot.data.reset();
+    slot.valid = true;
+    return true;
+  }
+
+  // seqのベースラインを保持しているか
+  [[nodiscard]] bool contains(uint32_t seq) const
+  {
+    return find(seq) != nullptr;
+  }
+  // 保持しているレコード数(無ければ0)
+  [[nodiscard]] size_t size(uint32_t seq) const
+  {
+    const auto *slot = find(seq);
+    return slot ? slot->offsets.size() : 0;
+  }
+
+  // seqのindex番目のレコードをrecordへ読み込む
+  bool load(uint32_t seq, size_t index, Record &record) const
+  {
+    const auto *slot = find(seq);
+    if (slot == nullptr || index >= slot->offsets.size())
+    {
+      return false;
+    }
+    // 保存済みバッファを読むだけ(複数スレッドから同時に呼べる)
+    auto view = Serializer::view(slot->data.data(), slot->data.capacity());
+    view.seek(slot->offsets[index]);
+    return reader_(view, record);
+  }
+
+  //
+  // seqのindex番目からcurrentへの差分を書く
+  // scratch: ベースラインの読み込み先(呼び出しごとに上書き)
+  // seqが既に無ければfalse(呼び出し側はフルで送る)
+  //
+  bool serializeDiff(Serializer &ser, uint32_t seq, size_t index,
+                     const Record &current, Record &scratch) const
+  {
+    return load(seq, index, scratch) && scratch.serializeDiff(ser, current);
+  }
+
+  // 全ベースラインの保持バイト数
+  [[nodiscard]] size_t memoryBytes() const
+  {
+    size_t bytes = 0;
+    for (const auto &slot : slots_)
+    {
+      bytes += slot.data.capacity() + slot.offsets.capacity() * sizeof(size_t);
+    }
+    return bytes;
+  }
+
+  void clear()
+  {
+    for (auto &slot : slots_)
+    {
+      slot.valid = false;
+    }
+  }
+};
+
+} // namespace record
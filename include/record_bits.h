@@ -31,50 +31,8 @@ bool serializeBitField(Serializer &ser, BitClass *data, size_t num)
     return false;
   }
 
-  bool ret = true;
-  if constexpr (sizeof(BitClass) % 8 == 0)
-  {
-    // 8byte align
-    constexpr size_t Size = sizeof(BitClass) / 8;
-    union DataPtr
-    {
-      BitClass *data_;
-      uint64_t *ptr_;
-    };
-    DataPtr dptr;
-    dptr.data_ = data;
-    for (size_t i = 0; i < num * Size; i++)
-    {
-      if (!ser.writeBits64(*dptr.ptr_, 64))
-      {
-        ret = false;
-        break;
-      }
-      dptr.ptr_++;
-    }
-  }
-  else
-  {
-    // 4byte align
-    constexpr size_t Size = sizeof(BitClass) / 4;
-    union DataPtr
-    {
-      BitClass *data_;
-      uint32_t *ptr_;
-    };
-    DataPtr dptr;
-    dptr.data_ = data;
-    for (size_t i = 0; i < num * Size; i++)
-    {
-      if (!ser.writeBits(*dptr.ptr_, 32))
-      {
-        ret = false;
-        break;
-      }
-      dptr.ptr_++;
-    }
-  }
-  return ret;
+  // 4byte単位のデータはメモリ上のバイト列のままビット列に並ぶので一括で書く
+  return ser.writeBytes(data, num * sizeof(BitClass));
 }
 
 //
@@ -116,31 +74,23 @@ bool deserializeBitField(Serializer &ser, BitClass *data, size_t &num)
     readSize = sizeof(BitClass) / 4;
   }
 
-  bool ret = true;
-  union DataPtr
+  if (posOffset == 0 && readSize * 4 == sizeof(BitClass))
   {
-    BitClass *data_;
-    uint32_t *ptr_;
-  };
-  DataPtr dptr;
-  dptr.data_ = data;
+    // 構造体のサイズが一致していれば一括で読む
+    return ser.readBytes(data, num * sizeof(BitClass));
+  }
 
+  auto *dptr = reinterpret_cast<uint8_t *>(data);
   for (size_t i = 0; i < num; i++)
   {
-    for (size_t p = 0; p < readSize; p++)
+    if (!ser.readBytes(dptr, readSize * 4))
     {
-      if (!ser.readBits(dptr.ptr_[p], 32))
-      {
-        ret = false;
-        goto error_exit;
-      }
+      return false;
     }
     ser.seek(ser.tell() + posOffset);
-    dptr.data_++;
+    dptr += sizeof(BitClass);
   }
-
-error_exit:
-  return ret;
+  return true;
 }
 
 } // namespace record
@@ -0,0 +1,138 @@
+//
+// copyright 2025 y.suzuki(wave.suzuki.z@gmail.com)
+//
+#pragma once
+
+#include "serialize.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace record
+{
+
+//
+// ブロック圧縮
+// Serializerの出力(バイト列)をブロック単位で圧縮して流す
+// ブロック: 元のバイト数(32bit) + 圧縮後のバイト数(32bit) + データ
+//           (圧縮後 == 元のサイズなら無圧縮で格納)
+// 全体を溜めずにブロックごとに出力/復元する
+//
+
+// 圧縮の集計
+struct CompressStats
+{
+  uint64_t rawBytes = 0;    // 圧縮前
+  uint64_t packedBytes = 0; // 圧縮後(ブロックヘッダーを含む)
+  uint64_t blocks = 0;
+  uint64_t storedBlocks = 0; // 縮まなかったので無圧縮で格納したブロック
+  uint64_t nanoseconds = 0;  // 圧縮/復元にかかった時間
+
+  // 圧縮後/圧縮前(小さいほどよく縮んでいる)
+  [[nodiscard]] double ratio() const
+  {
+    return rawBytes == 0 ? 1.0 : double(packedBytes) / double(rawBytes);
+  }
+};
+
+//
+// ブロック単位のコーデック
+//
+class BlockCodec
+{
+public:
+  virtual ~BlockCodec() = default;
+
+  // srcBytesを圧縮した時の最大サイズ
+  [[nodiscard]] virtual size_t bound(size_t srcBytes) const = 0;
+  // 圧縮後のバイト数を返す(capacityに収まらなければ0)
+  virtual size_t compress(const uint8_t *src, size_t srcBytes, uint8_t *dst,
+                          size_t capacity) const = 0;
+  // 元のバイト数(rawBytes)ちょうどに戻せた場合のみtrue
+  virtual bool decompress(const uint8_t *src, size_t srcBytes, uint8_t *dst,
+                          size_t rawBytes) const = 0;
+};
+
+//
+// LZ4ブロック形式(外部ライブラリなし、LZ4_decompress_safeと互換)
+//
+class Lz4BlockCodec : public BlockCodec
+{
+public:
+  [[nodiscard]] size_t bound(size_t srcBytes) const override;
+  size_t compress(const uint8_t *src, size_t srcBytes, uint8_t *dst,
+                  size_t capacity) const override;
+  bool decompress(const uint8_t *src, size_t srcBytes, uint8_t *dst,
+                  size_t rawBytes) const override;
+
+  static const Lz4BlockCodec &instance();
+};
+
+// 出力先/復元先(falseで中断)
+using BlockSink = std::function<bool(const uint8_t *data, size_t bytes)>;
+
+//
+// 圧縮側
+// write()したバイト列をBlockBytesごとに圧縮してsinkへ渡す
+// enabledがfalseなら圧縮せずに格納する(チャンネルごとの切り替え用、
+// 読み込み側は同じCompressReaderで読める)
+//
+class CompressWriter
+{
+  BlockSink sink_;
+  const BlockCodec &codec_;
+  size_t blockBytes_;
+  bool enabled_;
+  std::vector<uint8_t> block_;
+  std::vector<uint8_t> packed_;
+  CompressStats stats_;
+
+  bool flushBlock();
+
+public:
+  static constexpr size_t DefaultBlockBytes = 64 * 1024;
+  static constexpr size_t HeaderBytes = 8;
+
+  CompressWriter(BlockSink sink, bool enabled = true,
+                 size_t blockBytes = DefaultBlockBytes,
+                 const BlockCodec &codec = Lz4BlockCodec::instance());
+
+  bool write(const void *data, size_t bytes);
+  // 書き込み済みのバイト列(端数ビットは0で埋めたバイトになる)
+  bool write(const Serializer &ser) { return write(ser.data(), ser.size()); }
+  // 残りのブロックを出力
+  bool finish();
+
+  void setEnabled(bool enabled) { enabled_ = enabled; }
+  [[nodiscard]] bool enabled() const { return enabled_; }
+  [[nodiscard]] const CompressStats &stats() const { return stats_; }
+};
+
+//
+// 復元側
+// 受け取った順にfeed()し、ブロックがそろうたびに復元してsinkへ渡す
+// (ブロックの途中で切れていても次のfeedで続きから読む)
+//
+class CompressReader
+{
+  BlockSink sink_;
+  const BlockCodec &codec_;
+  size_t maxBlockBytes_;
+  std::vector<uint8_t> pending_;
+  std::vector<uint8_t> raw_;
+  CompressStats stats_;
+
+public:
+  CompressReader(BlockSink sink,
+                 size_t maxBlockBytes = CompressWriter::DefaultBlockBytes,
+                 const BlockCodec &codec = Lz4BlockCodec::instance());
+
+  // 壊れたブロックかsinkの中断でfalse
+  bool feed(const void *data, size_t bytes);
+  // ブロックの途中で止まっていないか
+  [[nodiscard]] bool idle() const { return pending_.empty(); }
+  [[nodiscard]] const CompressStats &stats() const { return stats_; }
+};
+
+} // namespace record
@@ -0,0 +1,239 @@
+//
+// copyright 2025 y.suzuki(wave.suzuki.z@gmail.com)
+//
+#pragma once
+
+#include "serialize.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+namespace record
+{
+
+//
+// パケット単位の差分送信
+// (current, target)のレコード組を先頭から順に、決まったサイズのパケットへ
+// 入るだけ詰める。詰める数は書く前にmeasureDiffBitsで決めるので、
+// 書いて溢れてから巻き戻すことはない
+//
+// パケット: 先頭レコード番号(FirstBits) + レコード数(CountBits) +
+//           各レコードの差分(serializeDiffと同じ)
+//
+
+// 送信方法
+enum class PacketMode : uint8_t
+{
+  Atomic,   // 書いたレコードだけcurrentへコピー(serializeDiffAndCopy)
+  DiffOnly, // 書くだけ(コピーは呼び出し側、例えば受信確認後)
+};
+
+// 既定の差分サイズ: current.measureDiffBits(target)
+struct RecordDiffMeasure
+{
+  template <class Record>
+  size_t operator()(const Record &current, const Record &target) const
+  {
+    return current.measureDiffBits(target);
+  }
+};
+
+// 既定の差分書き込み
+struct RecordDiffWriter
+{
+  template <class Record>
+  bool operator()(Serializer &ser, Record &current, const Record &target,
+                  PacketMode mode) const
+  {
+    if (mode == PacketMode::Atomic)
+    {
+      return current.serializeDiffAndCopy(ser, target);
+    }
+    return current.serializeDiff(ser, target);
+  }
+};
+
+// 既定の差分読み込み: record.deserializeDiff(ser)
+struct RecordDiffReader
+{
+  template <class Record>
+  bool operator()(Serializer &ser, Record &record) const
+  {
+    return record.deserializeDiff(ser);
+  }
+};
+
+// パケットに入ったレコードの範囲
+struct PacketInfo
+{
+  size_t first = 0;
+  size_t count = 0;
+  size_t bits = 0; // ヘッダーを含む
+};
+
+// 次に送るレコード(num以上なら送り終わり)
+struct PacketCursor
+{
+  size_t next = 0;
+
+  [[nodiscard]] bool finished(size_t num) const { return next >= num; }
+};
+
+//
+class Packetizer
+{
+  static constexpr size_t ByteBits = 8;
+
+  size_t packetBytes_;
+  PacketMode mode_;
+  Serializer packet_;
+
+public:
+  static constexpr size_t FirstBits = 32;
+  static constexpr size_t CountBits = 16;
+  static constexpr size_t HeaderBits = FirstBits + CountBits;
+  static constexpr size_t MaxCount = (1ULL << CountBits) - 1;
+
+  Packetizer(size_t packetBytes, PacketMode mode = PacketMode::Atomic)
+      : packetBytes_(packetBytes), mode_(mode), packet_(packetBytes)
+  {
+  }
+
+  [[nodiscard]] size_t packetBytes() const { return packetBytes_; }
+  [[nodiscard]] PacketMode mode() const { return mode_; }
+
+  //
+  // cursorから入るだけpacketの現在位置に書き、cursorを進める
+  // packetに書き済みの分もpacketBytesに含め、固定容量ならその残りも超えない
+  // 1件も入らない(packetBytesより大きいレコード)か書き込みに失敗したら
+  // falseでpacketもcursorも戻す
+  // Atomicで途中のレコードが失敗した時は、コピー済みのレコードだけを
+  // パケットに残してtrue(cursorはその次から)
+  //
+  template <class Record, class Writer = RecordDiffWriter,
+            class Measure = RecordDiffMeasure>
+  bool fill(Serializer &packet, Record *current, const Record *target,
+            size_t num, PacketCursor &cursor, PacketInfo &info,
+            Writer writer = {}, Measure measure = {}) const
+  {
+    info = {cursor.next, 0, HeaderBits};
+    if (cursor.finished(num))
+    {
+      info.bits = 0;
+      return true;
+    }
+
+    // 入る数を先に決める
+    auto begPos = packet.tell();
+    auto limit = packetBytes_ * ByteBits;
+    if (!packet.isAutoGrow())
+    {
+      limit = std::min(limit, packet.capacity() * ByteBits);
+    }
+    auto budget = limit > begPos ? limit - begPos : 0;
+    auto end = std::min(num, cursor.next + MaxCount);
+    for (auto i = cursor.next; i < end; i++)
+    {
+      auto bits = measure(current[i], target[i]);
+      if (bits == 0 || info.bits + bits > budget)
+      {
+        break;
+      }
+      info.bits += bits;
+      info.count++;
+    }
+    if (info.count == 0)
+    {
+      return false;
+    }
+
+    if (!packet.writeBits(info.first, FirstBits) ||
+        !packet.writeBits(info.count, CountBits))
+    {
+      packet.rollback(begPos);
+      return false;
+    }
+    for (size_t n = 0; n < info.count; n++)
+    {
+      auto recPos = packet.tell();
+      auto i = info.first + n;
+      if (writer(packet, current[i], target[i], mode_))
+      {
+        continue;
+      }
+      if (mode_ != PacketMode::Atomic || n == 0)
+      {
+        packet.rollback(begPos);
+        return false;
+      }
+      // 書けたレコードはcurrentへコピー済みなので、その分だけ送る
+      packet.rollback(recPos);
+      packet.seek(begPos + FirstBits);
+      packet.writeBits(n, CountBits);
+      packet.seek(recPos);
+      info.count = n;
+      break;
+    }
+    info.bits = packet.tell() - begPos;
+    cursor.next += info.count;
+    return true;
+  }
+
+  //
+  // cursorから最大maxPackets個のパケットを作りsend(packet, info)に渡す
+  // sendがfalseを返したら打ち切る(そのパケットのレコードは送信済み扱い)
+  // 作ったパケット数を返し、cursorは次のtickで続きから呼べる位置になる
+  //
+  template <class Record, class Send, class Writer = RecordDiffWriter,
+            class Measure = RecordDiffMeasure>
+  size_t packetize(Record *current, const Record *target, size_t num,
+                   PacketCursor &cursor, size_t maxPackets, Send send,
+                   Writer writer = {}, Measure measure = {})
+  {
+    size_t packets = 0;
+    while (packets < maxPackets && !cursor.finished(num))
+    {
+      PacketInfo info;
+      packet_.reset();
+      if (!fill(packet_, current, target, num, cursor, info, writer, measure))
+      {
+        break;
+      }
+      packets++;
+      if (!send(static_cast<const Serializer &>(packet_), info))
+      {
+        break;
+      }
+    }
+    return packets;
+  }
+
+  //
+  // fillで書いたパケットを読み、records[first..first+count)へ差分を適用
+  // 範囲がnumを超える場合は何もせずfalse
+  //
+  template <class Record, class Reader = RecordDiffReader>
+  static bool unpack(Serializer &packet, Record *records, size_t num,
+                     PacketInfo &info, Reader reader = {})
+  {
+    auto begPos = packet.tell();
+    if (!packet.readBits(info.first, FirstBits) ||
+        !packet.readBits(info.count, CountBits) || info.first > num ||
+        info.count > num - info.first)
+    {
+      packet.seek(begPos);
+      return false;
+    }
+    for (auto i = info.first; i < info.first + info.count; i++)
+    {
+      if (!reader(packet, records[i]))
+      {
+        return false;
+      }
+    }
+    info.bits = packet.tell() - begPos;
+    return true;
+  }
+};
+
+} // namespace record
@@ -0,0 +1,412 @@
+//
+// copyright 2025 y.suzuki(wave.suzuki.z@gmail.com)
+//
+#pragma once
+
+#include "serialize.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace record
+{
+
+//
+// 複数レコードの並列シリアライズ
+// レコード列をワーカー数の連続区間に分け、区間ごとに別スレッド・別Serializerで
+// 書いてから出力へ順に連結する(逐次に書いた場合と同じビット列になる)
+// offsetsには各レコードの先頭ビット位置が入り、読み込み側も並列にできる
+//
+
+// 既定の書き込み: record.serialize(ser)
+struct RecordWriter
+{
+  template <class Record>
+  bool operator()(Serializer &ser, const Record &record) const
+  {
+    return record.serialize(ser);
+  }
+};
+
+// 既定の読み込み: record.deserialize(ser)
+struct RecordReader
+{
+  template <class Record>
+  bool operator()(Serializer &ser, Record &record) const
+  {
+    return record.deserialize(ser);
+  }
+};
+
+namespace parallel
+{
+
+// ワーカーひとつあたりの初期バッファ(足りなければ拡張)
+static constexpr size_t InitialBytes = 4096;
+
+// workers=0ならハードウェアスレッド数、レコード数より多くはしない
+inline size_t workerCount(size_t num, size_t workers)
+{
+  if (workers == 0)
+  {
+    workers = std::max(1U, std::thread::hardware_concurrency());
+  }
+  return std::clamp<size_t>(workers, 1, std::max<size_t>(num, 1));
+}
+
+// w番目のワーカーが受け持つ区間の先頭
+inline size_t chunkBegin(size_t num, size_t workers, size_t w)
+{
+  return num * w / workers;
+}
+
+// job(w)の結果をまとめる(例外はワーカーごとに受け取り、最初のものを投げ直す)
+class Results
+{
+  std::vector<uint8_t> results_;
+  std::vector<std::exception_ptr> errors_;
+
+public:
+  explicit Results(size_t workers) : results_(workers, 0), errors_(workers) {}
+
+  template <class Job> void invoke(const Job &job, size_t w)
+  {
+    try
+    {
+      results_[w] = job(w) ? 1 : 0;
+    }
+    catch (...)
+    {
+      errors_[w] = std::current_exception();
+    }
+  }
+  bool finish() const
+  {
+    for (const auto &error : errors_)
+    {
+      if (error)
+      {
+        std::rethrow_exception(error);
+      }
+    }
+    return std::all_of(results_.begin(), results_.end(),
+                       [](uint8_t res) { return res != 0; });
+  }
+};
+
+// job(w)をワーカー数ぶん実行(0番は呼び出しスレッドで実行)
+// 呼び出しごとにスレッドを作る。jobの例外は全スレッドの終了後に投げ直し、
+// スレッドを作れなかった場合も起動済みのスレッドを待ってから投げる
+template <class Job>
+bool run(size_t workers, const Job &job)
+{
+  Results results{workers};
+  auto task = [&](size_t w) { results.invoke(job, w); };
+  {
+    std::vector<std::thread> threads;
+    struct Joiner
+    {
+      std::vector<std::thread> &threads;
+      ~Joiner()
+      {
+        for (auto &thread : threads)
+        {
+          thread.join();
+        }
+      }
+    } joiner{threads};
+    threads.reserve(workers - 1);
+    for (size_t w = 1; w < workers; w++)
+    {
+      threads.emplace_back(task, w);
+    }
+    task(0);
+  }
+  return results.finish();
+}
+
+} // namespace parallel
+
+//
+// 使い回すワーカースレッド群
+// 毎回スレッドを作らずに済むよう、serializeParallel/deserializeParallelに
+// 渡して繰り返し使う。呼び出しスレッドも1ワーカーとして働く
+// 同時に複数のrunを呼んだ場合は順に実行する
+//
+class WorkerPool
+{
+  std::mutex runMutex_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  std::vector<std::thread> threads_;
+  // 実行中の仕事(run中のみ有効)
+  const void *task_ = nullptr;
+  void (*invoke_)(const void *, size_t) = nullptr;
+  size_t count_ = 0;
+  size_t next_ = 0;
+  size_t pending_ = 0;
+  bool stop_ = false;
+
+  // 残っているワーカー番号をひとつ実行(mutex_を持って呼ぶ)
+  void runOne(std::unique_lock<std::mutex> &lock)
+  {
+    auto w = next_++;
+    lock.unlock();
+    invoke_(task_, w);
+    lock.lock();
+    if (--pending_ == 0)
+    {
+      done_.notify_all();
+    }
+  }
+  void threadMain()
+  {
+    std::unique_lock lock{mutex_};
+    for (;;)
+    {
+      wake_.wait(lock, [this]() { return stop_ || next_ < count_; });
+      if (stop_)
+      {
+        return;
+      }
+      runOne(lock);
+    }
+  }
+  void shutdown()
+  {
+    {
+      std::lock_guard lock{mutex_};
+      stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto &thread : threads_)
+    {
+      thread.join();
+    }
+    threads_.clear();
+  }
+
+public:
+  // threads: 呼び出しスレッド以外のスレッド数(0ならハードウェアスレッド数-1)
+  explicit WorkerPool(size_t threads = 0)
+  {
+    if (threads == 0)
+    {
+      threads = std::max(1U, std::thread::hardware_concurrency()) - 1;
+    }
+    threads_.reserve(threads);
+    try
+    {
+      for (size_t i = 0; i < threads; i++)
+      {
+        threads_.emplace_back([this]() { threadMain(); });
+      }
+    }
+    catch (...)
+    {
+      shutdown();
+      throw;
+    }
+  }
+  ~WorkerPool() { shutdown(); }
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool &operator=(const WorkerPool &) = delete;
+
+  // 呼び出しスレッドを含めた並列数
+  [[nodiscard]] size_t concurrency() const { return threads_.size() + 1; }
+
+  // job(w)をw=0..workers-1で実行(parallel::runと同じ結果・例外)
+  // workersはconcurrency()より多くてもよい(空いたスレッドが順に受け持つ)
+  template <class Job>
+  bool run(size_t workers, const Job &job)
+  {
+    std::lock_guard runLock{runMutex_};
+    parallel::Results results{workers};
+    auto task = [&](size_t w) { results.invoke(job, w); };
+    using Task = decltype(task);
+    std::unique_lock lock{mutex_};
+    task_ = &task;
+    invoke_ = [](const void *ptr, size_t w)
+    { (*static_cast<const Task *>(ptr))(w); };
+    count_ = workers;
+    next_ = 0;
+    pending_ = workers;
+    wake_.notify_all();
+    while (next_ < count_)
+    {
+      runOne(lock);
+    }
+    done_.wait(lock, [this]() { return pending_ == 0; });
+    task_ = nullptr;
+    count_ = 0;
+    next_ = 0;
+    lock.unlock();
+    return results.finish();
+  }
+};
+
+namespace parallel
+{
+
+// 呼び出しごとにスレッドを作る実行(WorkerPoolを渡さない場合)
+struct Spawn
+{
+  template <class Job>
+  bool run(size_t workers, const Job &job) const
+  {
+    return parallel::run(workers, job);
+  }
+};
+
+// serializeParallelの本体(executor.run(workers, job)で並列に実行)
+template <class Executor, class Record, class Writer>
+bool serializeWith(Executor &executor, Serializer &ser, const Record *records,
+                   size_t num, std::vector<size_t> &offsets, size_t workers,
+                   Writer &writer)
+{
+  workers = workerCount(num, workers);
+  std::vector<Serializer> locals;
+  locals.reserve(workers);
+  for (size_t w = 0; w < workers; w++)
+  {
+    locals.emplace_back(InitialBytes, Serializer::Policy::AutoGrow);
+  }
+  offsets.resize(num);
+
+  auto job = [&](size_t w)
+  {
+    auto &local = locals[w];
+    auto end = chunkBegin(num, workers, w + 1);
+    for (auto i = chunkBegin(num, workers, w); i < end; i++)
+    {
+      offsets[i] = local.tell();
+      if (!writer(local, records[i]))
+      {
+        return false;
+      }
+    }
+    return true;
+  };
+  if (!executor.run(workers, job))
+  {
+    return false;
+  }
+
+  // 区間の順に連結してオフセットを絶対位置にする
+  auto begPos = ser.tell();
+  for (size_t w = 0; w < workers; w++)
+  {
+    auto base = ser.tell();
+    auto end = chunkBegin(num, workers, w + 1);
+    for (auto i = chunkBegin(num, workers, w); i < end; i++)
+    {
+      offsets[i] += base;
+    }
+    if (!ser.append(locals[w]))
+    {
+      ser.rollback(begPos);
+      return false;
+    }
+  }
+  return true;
+}
+
+// deserializeParallelの本体
+template <class Executor, class Record, class Reader>
+bool deserializeWith(Executor &executor, Serializer &ser, Record *records,
+                     const std::vector<size_t> &offsets, size_t workers,
+                     Reader &reader)
+{
+  auto num = offsets.size();
+  if (num == 0)
+  {
+    return true;
+  }
+  workers = workerCount(num, workers);
+  // 各ワーカーは同じバッファを指す読み込み専用ビューで読む
+  const void *buffer = ser.data();
+  size_t endPos = 0;
+
+  auto job = [&](size_t w)
+  {
+    auto view = Serializer::view(buffer, ser.capacity());
+    auto end = chunkBegin(num, workers, w + 1);
+    for (auto i = chunkBegin(num, workers, w); i < end; i++)
+    {
+      view.seek(offsets[i]);
+      if (!reader(view, records[i]))
+      {
+        return false;
+      }
+    }
+    if (w == workers - 1)
+    {
+      endPos = view.tell();
+    }
+    return true;
+  };
+  if (!executor.run(workers, job))
+  {
+    return false;
+  }
+  ser.seek(endPos);
+  return true;
+}
+
+} // namespace parallel
+
+//
+// records[0..num)をserに書き込む
+// offsets: 各レコードの先頭ビット位置(ser上の絶対位置)が返る
+// workers: スレッド数(0なら自動)
+// writer/jobの例外は全スレッドの終了後にそのまま投げ直す
+//
+template <class Record, class Writer = RecordWriter>
+bool serializeParallel(Serializer &ser, const Record *records, size_t num,
+                       std::vector<size_t> &offsets, size_t workers = 0,
+                       Writer writer = {})
+{
+  parallel::Spawn spawn;
+  return parallel::serializeWith(spawn, ser, records, num, offsets, workers,
+                                 writer);
+}
+// WorkerPoolのスレッドで書き込む(ワーカー数はpool.concurrency())
+template <class Record, class Writer = RecordWriter>
+bool serializeParallel(WorkerPool &pool, Serializer &ser, const Record *records,
+                       size_t num, std::vector<size_t> &offsets,
+                       Writer writer = {})
+{
+  return parallel::serializeWith(pool, ser, records, num, offsets,
+                                 pool.concurrency(), writer);
+}
+
+//
+// serializeParallelで書いたデータを並列に読み込む
+// offsets: serializeParallelが返したオフセット(要素数=レコード数)
+// 成功時はserの位置が最後のレコードの後ろになる
+//
+template <class Record, class Reader = RecordReader>
+bool deserializeParallel(Serializer &ser, Record *records,
+                         const std::vector<size_t> &offsets,
+                         size_t workers = 0, Reader reader = {})
+{
+  parallel::Spawn spawn;
+  return parallel::deserializeWith(spawn, ser, records, offsets, workers,
+                                   reader);
+}
+// WorkerPoolのスレッドで読み込む
+template <class Record, class Reader = RecordReader>
+bool deserializeParallel(WorkerPool &pool, Serializer &ser, Record *records,
+                         const std::vector<size_t> &offsets, Reader reader = {})
+{
+  return parallel::deserializeWith(pool, ser, records, offsets,
+                                   pool.concurrency(), reader);
+}
+
+} // namespace record
@@ -0,0 +1,92 @@
+//
+// copyright 2025 y.suzuki(wave.suzuki.z@gmail.com)
+//
+#pragma once
+
+#include "record.h"
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace record
+{
+
+//
+// レコードプール
+// SlabSize個ずつ連続したメモリにレコードを作る(アドレスは破棄まで不変)
+// フィールド配置は型ごとのRecordLayoutを共有するので、
+// レコードごとのフィールド一覧の確保が起きない
+//
+template <class Record, size_t SlabSize = 256>
+class RecordPool
+{
+  struct Slab
+  {
+    alignas(Record) std::byte storage_[sizeof(Record) * SlabSize];
+  };
+
+  std::vector<std::unique_ptr<Slab>> slabs_;
+  size_t size_ = 0;
+
+  Record *slot(size_t index) const
+  {
+    auto *slab = slabs_[index / SlabSize].get();
+    return std::launder(reinterpret_cast<Record *>(slab->storage_) +
+                        index % SlabSize);
+  }
+
+public:
+  RecordPool() = default;
+  RecordPool(const RecordPool &) = delete;
+  RecordPool &operator=(const RecordPool &) = delete;
+  ~RecordPool() { clear(); }
+
+  // 末尾に作成
+  template <class... Args>
+  Record &emplace(Args &&...args)
+  {
+    if (size_ == slabs_.size() * SlabSize)
+    {
+      slabs_.push_back(std::make_unique<Slab>());
+    }
+    auto *mem = slabs_[size_ / SlabSize]->storage_ +
+                sizeof(Record) * (size_ % SlabSize);
+    RecordLayout::Scope scope{layout()};
+    auto *record = new (mem) Record(std::forward<Args>(args)...);
+    size_++;
+    return *record;
+  }
+
+  // 全破棄(スラブは再利用する)
+  void clear()
+  {
+    while (size_ > 0)
+    {
+      slot(--size_)->~Record();
+    }
+  }
+
+  [[nodiscard]] size_t size() const { return size_; }
+  [[nodiscard]] bool empty() const { return size_ == 0; }
+  Record &operator[](size_t index) { return *slot(index); }
+  const Record &operator[](size_t index) const { return *slot(index); }
+
+  // index番目のスラブの先頭と、そのスラブ内の個数
+  // (スラブ単位でまとめてserializeBatchなどに渡せる)
+  [[nodiscard]] size_t slabCount() const
+  {
+    return (size_ + SlabSize - 1) / SlabSize;
+  }
+  [[nodiscard]] std::pair<Record *, size_t> slab(size_t index) const
+  {
+    auto top = index * SlabSize;
+    return {slot(top), std::min(SlabSize, size_ - top)};
+  }
+
+  static RecordLayout &layout() { return RecordLayout::of<Record>(); }
+};
+
+} // namespace record
@@ -0,0 +1,505 @@
+//
+// copyright 2025 y.suzuki(wave.suzuki.z@gmail.com)
+//
+#pragma once
+
+#include "record.h"
+#include "serialize.h"
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace record
+{
+
+//
+// 静的スキーマ
+// メンバーポインタの並びからシリアライズ処理をコンパイル時に展開する
+// 仮想呼び出しを経由しないだけで出力はValueLinkと同一
+//
+// using TestSchema = record::Schema<&Test::enabled_, &Test::count_, ...>;
+// TestSchema::serialize(ser, test);
+//
+template <auto... Members>
+class Schema
+{
+  template <class MemberPtr>
+  struct MemberTraits;
+  template <class Field, class Class>
+  struct MemberTraits<Field Class::*>
+  {
+    using FieldType = Field;
+  };
+
+  template <auto Member>
+  using FieldType = typename MemberTraits<decltype(Member)>::FieldType;
+
+  template <auto Member>
+  static constexpr bool IsSeparator =
+      std::is_base_of_v<ValueVersion, FieldType<Member>>;
+
+  static_assert(sizeof...(Members) > 0, "empty schema");
+  static_assert((std::is_base_of_v<ValueInterface, FieldType<Members>> && ...),
+                "member must be record value type");
+
+  // 読み込み結果
+  enum class ReadResult
+  {
+    Continue,
+    Separator,
+    Failed,
+  };
+
+  //
+  template <auto Member, class Record>
+  static bool equalField(const Record &rec, const Record &other)
+  {
+    using Field = FieldType<Member>;
+    return (rec.*Member).Field::equal(other.*Member);
+  }
+  template <auto Member, class Record>
+  static void copyField(Record &rec, const Record &other)
+  {
+    using Field = FieldType<Member>;
+    (rec.*Member).Field::copy(other.*Member);
+  }
+  template <auto Member, class Record>
+  static bool serializeField(Serializer &ser, const Record &rec)
+  {
+    using Field = FieldType<Member>;
+    return (rec.*Member).Field::serialize(ser);
+  }
+  template <auto Member, class Record>
+  static bool serializeDiffField(Serializer &ser, const Record &rec,
+                                 const Record &other)
+  {
+    using Field = FieldType<Member>;
+    return (rec.*Member).Field::serializeDiff(ser, other.*Member);
+  }
+  template <auto Member, class Record>
+  static bool serializeDiffAndCopyField(Serializer &ser, Record &rec,
+                                        const Record &other)
+  {
+    if (!serializeDiffField<Member>(ser, rec, other))
+    {
+      return false;
+    }
+    copyField<Member>(rec, other);
+    return true;
+  }
+  template <bool Diff, auto Member, class Record>
+  static ReadResult deserializeField(Serializer &ser, Record &rec)
+  {
+    using Field = FieldType<Member>;
+    auto prevPos = ser.tell();
+    auto &field = rec.*Member;
+    bool ret;
+    if constexpr (Diff)
+    {
+      ret = field.Field::deserializeDiff(ser);
+    }
+    else
+    {
+      ret = field.Field::deserialize(ser);
+    }
+    if (ret)
+    {
+      return ReadResult::Continue;
+    }
+    if constexpr (IsSeparator<Member>)
+    {
+      // 過去バージョン(=正常終了)
+      ser.seek(prevPos);
+      return ReadResult::Separator;
+    }
+    return ReadResult::Failed;
+  }
+  template <bool Diff, class Record>
+  static bool deserializeImpl(Serializer &ser, Record &rec)
+  {
+    auto begPos = ser.tell();
+    auto result = ReadResult::Continue;
+    (((result = deserializeField<Diff, Members>(ser, rec)) ==
+      ReadResult::Continue) &&
+     ...);
+    if (result == ReadResult::Failed)
+    {
+      // 失敗したのでポインタもどす
+      ser.rollback(begPos);
+      return false;
+    }
+    return ValueLink::checkTerminate(ser);
+  }
+
+  //
+  // カラム単位の一括処理
+  // 先頭レコードは丸ごと、以降は直前のレコードとの差分か丸ごとを
+  // カラムごとに選ぶ(1bit)
+  //
+  template <auto Member, class Record>
+  static bool writeColumn(Serializer &ser, const Record *records, size_t num,
+                          bool delta)
+  {
+    for (size_t i = 0; i < num; i++)
+    {
+      bool ret = (delta && i > 0)
+                     ? serializeDiffField<Member>(ser, records[i - 1],
+                                                  records[i])
+                     : serializeField<Member>(ser, records[i]);
+      if (!ret)
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+  // 先頭の数レコードを両方の方式で試し書きして小さい方を選ぶ
+  template <auto Member, class Record>
+  static bool chooseDelta(Serializer &ser, const Record *records, size_t num)
+  {
+    if (num < 2)
+    {
+      return false;
+    }
+    auto sample = num < BatchSample ? num : BatchSample;
+    auto pos = ser.tell();
+    bool rawOk = writeColumn<Member>(ser, records, sample, false);
+    auto rawBits = ser.tell() - pos;
+    ser.seek(pos);
+    bool deltaOk = writeColumn<Member>(ser, records, sample, true);
+    auto deltaBits = ser.tell() - pos;
+    ser.seek(pos);
+    return deltaOk && (!rawOk || deltaBits < rawBits);
+  }
+  template <auto Member, class Record>
+  static bool serializeColumn(Serializer &ser, const Record *records,
+                              size_t num)
+  {
+    if constexpr (IsSeparator<Member>)
+    {
+      // セパレータは中身がないので出力しない
+      return true;
+    }
+    else
+    {
+      bool delta = chooseDelta<Member>(ser, records, num);
+      if (!ser.writeBool(delta))
+      {
+        return false;
+      }
+      return writeColumn<Member>(ser, records, num, delta);
+    }
+  }
+  template <auto Member, class Record>
+  static bool deserializeColumn(Serializer &ser, Record *records, size_t num)
+  {
+    if constexpr (IsSeparator<Member>)
+    {
+      return true;
+    }
+    else
+    {
+      bool delta;
+      if (!ser.readBool(delta))
+      {
+        return false;
+      }
+      using Field = FieldType<Member>;
+      for (size_t i = 0; i < num; i++)
+      {
+        auto &field = records[i].*Member;
+        bool ret;
+        if (delta && i > 0)
+        {
+          field.Field::copy(records[i - 1].*Member);
+          ret = field.Field::deserializeDiff(ser);
+        }
+        else
+        {
+          ret = field.Field::deserialize(ser);
+        }
+        if (!ret)
+        {
+          return false;
+        }
+      }
+      return true;
+    }
+  }
+  template <auto Member, class Record>
+  static bool serializeDiffColumn(Serializer &ser, const Record *base,
+                                  const Record *next, size_t num)
+  {
+    if constexpr (IsSeparator<Member>)
+    {
+      return true;
+    }
+    else
+    {
+      for (size_t i = 0; i < num; i++)
+      {
+        if (!serializeDiffField<Member>(ser, base[i], next[i]))
+        {
+          return false;
+        }
+      }
+      return true;
+    }
+  }
+  template <auto Member, class Record>
+  static bool deserializeDiffColumn(Serializer &ser, Record *records,
+                                    size_t num)
+  {
+    if constexpr (IsSeparator<Member>)
+    {
+      return true;
+    }
+    else
+    {
+      using Field = FieldType<Member>;
+      for (size_t i = 0; i < num; i++)
+      {
+        if (!(records[i].*Member).Field::deserializeDiff(ser))
+        {
+          return false;
+        }
+      }
+      return true;
+    }
+  }
+
+  static constexpr std::array<bool, sizeof...(Members)> Separators = {
+      IsSeparator<Members>...};
+
+  // 一括ヘッダー書き込み
+  static bool writeBatchHeader(Serializer &ser, size_t num)
+  {
+    assert(num < (1ULL << BatchCountBits));
+    return ser.writeBits(num, BatchCountBits) &&
+           ser.writeBits(sizeof...(Members), BatchFieldBits);
+  }
+  // 一括ヘッダー読み込み
+  // 書き手のフィールドが少ない場合はバージョン区切りまでなら読める
+  static bool readBatchHeader(Serializer &ser, size_t &num, size_t &fields)
+  {
+    if (!ser.readBits(num, BatchCountBits) ||
+        !ser.readBits(fields, BatchFieldBits))
+    {
+      return false;
+    }
+    if (fields > sizeof...(Members))
+    {
+      return false;
+    }
+    return fields == sizeof...(Members) || Separators[fields];
+  }
+
+public:
+  // 一括処理のヘッダー
+  static constexpr size_t BatchCountBits = 32;
+  static constexpr size_t BatchFieldBits = 8;
+  // 差分/丸ごとの判定に使うレコード数
+  static constexpr size_t BatchSample = 16;
+
+  // フィールド数
+  static constexpr size_t size() { return sizeof...(Members); }
+
+  // データーバージョン
+  static constexpr uint32_t getDataVersion()
+  {
+    return (uint32_t(IsSeparator<Members>) + ...);
+  }
+
+  // 比較
+  template <class Record>
+  [[nodiscard]] static bool equal(const Record &rec, const Record &other)
+  {
+    return (equalField<Members>(rec, other) && ...);
+  }
+
+  // コピー
+  template <class Record>
+  static void copy(Record &rec, const Record &other)
+  {
+    (copyField<Members>(rec, other), ...);
+  }
+
+  // 丸ごと保存
+  template <class Record>
+  static bool serialize(Serializer &ser, const Record &rec)
+  {
+    auto begPos = ser.tell();
+    if (!(serializeField<Members>(ser, rec) && ...))
+    {
+      // 失敗したのでポインタもどす
+      ser.rollback(begPos);
+      return false;
+    }
+    return ValueLink::writeTerminate(ser);
+  }
+
+  // 差分を保存
+  template <class Record>
+  static bool serializeDiff(Serializer &ser, const Record &rec,
+                            const Record &other)
+  {
+    auto begPos = ser.tell();
+    if (!(serializeDiffField<Members>(ser, rec, other) && ...))
+    {
+      // 失敗したのでポインタもどす
+      ser.rollback(begPos);
+      return false;
+    }
+    return ValueLink::writeTerminate(ser);
+  }
+
+  // 差分保存して成功時にコピー
+  template <class Record>
+  static bool serializeDiffAndCopy(Serializer &ser, Record &rec,
+                                   const Record &other)
+  {
+    auto begPos = ser.tell();
+#if defined(RECORD_FAST_DIFF_COPY)
+    if (!(serializeDiffAndCopyField<Members>(ser, rec, other) && ...))
+    {
+      // 失敗したのでポインタもどす
+      ser.rollback(begPos);
+      return false;
+    }
+    if (!ValueLink::writeTerminate(ser))
+    {
+      ser.rollback(begPos);
+      return false;
+    }
+#else
+    if (!(serializeDiffField<Members>(ser, rec, other) && ...))
+    {
+      // 失敗したのでポインタもどす
+      ser.rollback(begPos);
+      return false;
+    }
+    if (!ValueLink::writeTerminate(ser))
+    {
+      ser.rollback(begPos);
+      return false;
+    }
+
+    // 出力成功後にのみ現在値を更新(atomic behavior)
+    copy(rec, other);
+#endif
+    return true;
+  }
+
+  // 丸ごと更新
+  template <class Record>
+  static bool deserialize(Serializer &ser, Record &rec)
+  {
+    return deserializeImpl<false>(ser, rec);
+  }
+
+  // 差分を読んで更新
+  template <class Record>
+  static bool deserializeDiff(Serializer &ser, Record &rec)
+  {
+    return deserializeImpl<true>(ser, rec);
+  }
+
+  //
+  // 一括(カラム単位)保存
+  // records: 書き込むレコードの先頭
+  // num: レコード数
+  //
+  template <class Record>
+  static bool serializeBatch(Serializer &ser, const Record *records, size_t num)
+  {
+    auto begPos = ser.tell();
+    if (!writeBatchHeader(ser, num) ||
+        !(serializeColumn<Members>(ser, records, num) && ...))
+    {
+      // 失敗したのでポインタもどす
+      ser.rollback(begPos);
+      return false;
+    }
+    return true;
+  }
+
+  //
+  // 一括(カラム単位)差分保存
+  // base -> next の差分をレコード数num個分
+  //
+  template <class Record>
+  static bool serializeBatchDiff(Serializer &ser, const Record *base,
+                                 const Record *next, size_t num)
+  {
+    auto begPos = ser.tell();
+    if (!writeBatchHeader(ser, num) ||
+        !(serializeDiffColumn<Members>(ser, base, next, num) && ...))
+    {
+      // 失敗したのでポインタもどす
+      ser.rollback(begPos);
+      return false;
+    }
+    return true;
+  }
+
+  //
+  // 一括(カラム単位)更新
+  // records: 読み込み先
+  // num: recordsのキャパシティーを格納する/実際に読み込んだ要素数が返る
+  //
+  template <class Record>
+  static bool deserializeBatch(Serializer &ser, Record *records, size_t &num)
+  {
+    auto begPos = ser.tell();
+    size_t readNum;
+    size_t fields;
+    if (!readBatchHeader(ser, readNum, fields) || readNum > num)
+    {
+      ser.rollback(begPos);
+      return false;
+    }
+    size_t column = 0;
+    if (!((column++ >= fields ||
+           deserializeColumn<Members>(ser, records, readNum)) &&
+          ...))
+    {
+      // 失敗したのでポインタもどす
+      ser.rollback(begPos);
+      return false;
+    }
+    num = readNum;
+    return true;
+  }
+
+  //
+  // 一括(カラム単位)差分更新
+  // num: レコード数(書き込み時と同じであること)
+  //
+  template <class Record>
+  static bool deserializeBatchDiff(Serializer &ser, Record *records,
+                                   size_t num)
+  {
+    auto begPos = ser.tell();
+    size_t readNum;
+    size_t fields;
+    if (!readBatchHeader(ser, readNum, fields) || readNum != num)
+    {
+      ser.rollback(begPos);
+      return false;
+    }
+    size_t column = 0;
+    if (!((column++ >= fields ||
+           deserializeDiffColumn<Members>(ser, records, readNum)) &&
+          ...))
+    {
+      // 失敗したのでポインタもどす
+      ser.rollback(begPos);
+      return false;
+    }
+    return true;
+  }
+};
+
+} // namespace record
@@ -0,0 +1,153 @@
+//
+// copyright 2025 y.suzuki(wave.suzuki.z@gmail.com)
+//
+#pragma once
+
+#include "record.h"
+#include "serialize.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace record
+{
+
+//
+// 公開スナップショット(書き込み1スレッド・読み込み複数スレッド)
+// 書き込みスレッドは区切りの良いところでpublish(link)してエンコード結果を公開し、
+// 読み込みスレッドはread(ser)でロックなしに最新の公開分を書き出す
+// (ValueLink自体は書き込みスレッドしか触らないので、グローバルロックはいらない)
+//
+// 2面のバッファを交互に使い、それぞれをシーケンス番号(seqlock)で守る
+// 書き込み側は待たず、読み込み側は読んでいる面を追い越された時だけ読み直す
+//
+class SnapshotSlot
+{
+  static constexpr size_t WordBits = 64;
+
+  struct Buffer
+  {
+    std::atomic<uint64_t> seq{0}; // 奇数なら書き込み中
+    std::atomic<size_t> bits{0};
+    std::unique_ptr<std::atomic<uint64_t>[]> words;
+  };
+
+  std::array<Buffer, 2> buffers_;
+  std::atomic<uint32_t> front_{0};
+  std::atomic<uint64_t> generation_{0};
+  size_t wordCount_;
+  // 書き込みスレッド専用
+  Serializer scratch_;
+
+public:
+  static constexpr size_t DefaultBytes = 4096;
+
+  // maxBytes: 1レコードのエンコード結果の上限
+  explicit SnapshotSlot(size_t maxBytes = DefaultBytes)
+      : wordCount_((maxBytes + sizeof(uint64_t) - 1) / sizeof(uint64_t)),
+        scratch_(maxBytes)
+  {
+    for (auto &buffer : buffers_)
+    {
+      buffer.words = std::make_unique<std::atomic<uint64_t>[]>(wordCount_);
+    }
+  }
+  SnapshotSlot(const SnapshotSlot &) = delete;
+  SnapshotSlot &operator=(const SnapshotSlot &) = delete;
+
+  //
+  // linkの現在の状態を公開する(書き込みスレッドのみ)
+  // maxBytesに収まらなければfalse(公開済みのものはそのまま)
+  //
+  bool publish(const ValueLink &link)
+  {
+    scratch_.reset();
+    if (!link.serialize(scratch_))
+    {
+      return false;
+    }
+    auto bits = scratch_.tell();
+    const auto *src = static_cast<const uint64_t *>(scratch_.data());
+
+    auto back = 1 - front_.load(std::memory_order_relaxed);
+    auto &buffer = buffers_[back];
+    auto seq = buffer.seq.load(std::memory_order_relaxed);
+    buffer.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < (bits + WordBits - 1) / WordBits; i++)
+    {
+      buffer.words[i].store(src[i], std::memory_order_relaxed);
+    }
+    buffer.bits.store(bits, std::memory_order_relaxed);
+    buffer.seq.store(seq + 2, std::memory_order_release);
+
+    front_.store(back, std::memory_order_release);
+    generation_.fetch_add(1, std::memory_order_release);
+    return true;
+  }
+
+  //
+  // 最新の公開分をserに書き足す(どのスレッドからでも、ロックなし)
+  // まだ公開されていないかserに書けなければfalse
+  //
+  bool read(Serializer &ser) const
+  {
+    auto begPos = ser.tell();
+    while (true)
+    {
+      const auto &buffer = buffers_[front_.load(std::memory_order_acquire)];
+      auto seq = buffer.seq.load(std::memory_order_acquire);
+      if (seq == 0)
+      {
+        return false;
+      }
+      if (seq % 2 != 0)
+      {
+        // 追い越されて書き込み中
+        continue;
+      }
+      auto bits = buffer.bits.load(std::memory_order_relaxed);
+      bool written = true;
+      for (size_t pos = 0; written && pos < bits; pos += WordBits)
+      {
+        const auto &src = buffer.words[pos / WordBits];
+        auto word = src.load(std::memory_order_relaxed);
+        written = ser.writeBits64(word, std::min(WordBits, bits - pos));
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (buffer.seq.load(std::memory_order_relaxed) == seq)
+      {
+        if (!written)
+        {
+          ser.rollback(begPos);
+        }
+        return written;
+      }
+      // 読んでいる間に書き換わったので読み直す
+      ser.rollback(begPos);
+    }
+  }
+
+  // 最新の公開分をlinkへ読み込む(読み込みスレッド側の作業用レコードへ)
+  bool load(ValueLink &link) const
+  {
+    Serializer ser{wordCount_ * sizeof(uint64_t)};
+    if (!read(ser))
+    {
+      return false;
+    }
+    ser.seek(0);
+    return link.deserialize(ser);
+  }
+
+  // publishした回数(変わっていなければ送り直さなくてよい)
+  [[nodiscard]] uint64_t generation() const
+  {
+    return generation_.load(std::memory_order_acquire);
+  }
+};
+
+} // namespace record
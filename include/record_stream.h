@@ -0,0 +1,137 @@
+//
+// copyright 2025 y.suzuki(wave.suzuki.z@gmail.com)
+//
+#pragma once
+
+#include "record.h"
+#include "serialize.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace record
+{
+
+//
+// ストリーム読み込み
+// ソケットなどから届いた順にバイト列をfeedし、1レコード分そろうたびに取り出す
+// (スナップショット全体が届く前に、届いたレコードから適用できる)
+//
+// レコードがそろったかはskipRecord/skipDiffRecordで確認してから読むので、
+// 途中までしか届いていないレコードでlinkを書き換えることはない
+// (差分は2回適用すると壊れるので、読み直しはしない)
+//
+
+// next/nextDiffの結果
+enum class StreamStatus
+{
+  Record,   // 1レコード読み込んだ
+  NeedMore, // まだそろっていない(入力はそのまま)
+  Broken,   // そろっているのに読めない(レコードの型が違う等)
+};
+
+class StreamReader
+{
+  std::vector<uint64_t> words_;
+  size_t bytes_ = 0;  // 受信済みバイト数
+  size_t bitPos_ = 0; // 読み込み済みビット位置
+  size_t maxPendingBytes_;
+
+  //
+  // skipでレコード全体が受信済みの範囲にあるか確認してからreadする
+  // (読める範囲は受信済みのバイトまで。skipが範囲の終わりで失敗したら
+  // 続きを待ち、範囲内で失敗したら壊れている)
+  //
+  template <class Skip, class Read>
+  StreamStatus decode(Skip skip, Read read)
+  {
+    auto ser =
+        Serializer::view(words_.data(), words_.size() * sizeof(uint64_t));
+    ser.limitRead(bytes_ * 8);
+    ser.seek(bitPos_);
+    if (!skip(ser))
+    {
+      return ser.overrun() ? StreamStatus::NeedMore : StreamStatus::Broken;
+    }
+    auto end = ser.tell();
+    ser.seek(bitPos_);
+    if (!read(ser) || ser.tell() != end)
+    {
+      return StreamStatus::Broken;
+    }
+    bitPos_ = end;
+    return StreamStatus::Record;
+  }
+
+  // 読み終わったワードを捨てる
+  void compact()
+  {
+    auto done = bitPos_ / 64;
+    if (done == 0 || done * 2 < words_.size())
+    {
+      return;
+    }
+    words_.erase(words_.begin(), words_.begin() + done);
+    bitPos_ -= done * 64;
+    bytes_ -= done * sizeof(uint64_t);
+  }
+
+public:
+  static constexpr size_t DefaultMaxPendingBytes = 16 * 1024 * 1024;
+
+  explicit StreamReader(size_t maxPendingBytes = DefaultMaxPendingBytes)
+      : maxPendingBytes_(maxPendingBytes)
+  {
+  }
+
+  //
+  // 受信したバイト列を追加(Serializer::data()のバイト列を届いた順に)
+  // 未読みがmaxPendingBytesを超えたらfalse(届かないレコードを待ち続けない)
+  //
+  bool feed(const void *data, size_t bytes)
+  {
+    compact();
+    if (pendingBytes() + bytes > maxPendingBytes_)
+    {
+      return false;
+    }
+    words_.resize((bytes_ + bytes + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+    if (bytes != 0)
+    {
+      std::memcpy(reinterpret_cast<uint8_t *>(words_.data()) + bytes_, data,
+                  bytes);
+    }
+    bytes_ += bytes;
+    return true;
+  }
+
+  // serializeで書いたレコードを1つ読む
+  StreamStatus next(ValueLink &link)
+  {
+    return decode([&](Serializer &ser) { return link.skipRecord(ser); },
+                  [&](Serializer &ser) { return link.deserialize(ser); });
+  }
+  // serializeDiffで書いた差分を1つ読む
+  StreamStatus nextDiff(ValueLink &link,
+                        DiffFormat format = DiffFormat::Plain)
+  {
+    return decode(
+        [&](Serializer &ser) { return link.skipDiffRecord(ser, format); },
+        [&](Serializer &ser) { return link.deserializeDiff(ser, format); });
+  }
+
+  // 未読みのバイト数(読みかけのバイトを含む)
+  [[nodiscard]] size_t pendingBytes() const { return bytes_ - bitPos_ / 8; }
+  // 読みかけのレコードが無いか(最後のバイトの端数ビットは除く)
+  [[nodiscard]] bool idle() const { return bytes_ * 8 - bitPos_ < 8; }
+
+  void reset()
+  {
+    words_.clear();
+    bytes_ = 0;
+    bitPos_ = 0;
+  }
+};
+
+} // namespace record
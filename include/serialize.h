@@ -3,12 +3,44 @@
 //
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <bit>
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <utility>
 #include <vector>
 
 namespace record
 {
 
+// RECORD_STATSを定義すると書き込みの統計を集計する(未定義なら何もしない)
+#if defined(RECORD_STATS)
+static constexpr bool StatsEnabled = true;
+#else
+static constexpr bool StatsEnabled = false;
+#endif
+
+//
+// 書き込み統計(StatsEnabledでなければ常に0)
+//
+struct SerializerStats
+{
+  // 数値の書き込みビット数ごとの回数(添字はビット数/2、0は値0)
+  std::array<uint64_t, 33> numberBits{};
+  // 配列要素のサイズ種別(ArrayBitListの添字)ごとの回数
+  std::array<uint64_t, 8> arrayTypes{};
+  // 失敗による巻き戻し回数
+  uint64_t rollbacks = 0;
+  // 容量不足で書けなかった回数
+  uint64_t overflows = 0;
+  // 書き込み位置の最大(bit)
+  size_t highWater = 0;
+};
+
 //
 //
 //
@@ -18,57 +50,247 @@ class Serializer
   static constexpr size_t WordBytes = sizeof(uint64_t);
   static constexpr size_t WordBits = WordBytes * ByteBits;
 
-  std::vector<uint64_t> buffer_;
+  // アキュムレータの状態
+  enum class Mode : uint8_t
+  {
+    Idle,
+    Write,
+    Read,
+  };
+
+  std::vector<uint64_t> owned_;
+  // 書き込み先(owned_ もしくは外部メモリ)
+  uint64_t *buffer_;
+  size_t wordCount_;
   size_t bufferSize_;
+  // 書き込める範囲(読み込み専用ビューは0)
+  size_t writeSize_ = 0;
   size_t bitPos_;
+  // Write: 現在ワードの書き込み済み下位ビット
+  // Read: 現在ワードの未読ビット(下位詰め)
+  uint64_t accum_ = 0;
+  Mode mode_ = Mode::Idle;
+  bool autoGrow_ = false;
+  // 読み込みが範囲の終わりを越えようとして失敗したか
+  bool overrun_ = false;
+#if defined(RECORD_STATS)
+  SerializerStats stats_;
+#endif
 
-public:
-  Serializer(size_t n)
-      : buffer_((n + WordBytes - 1) / WordBytes),
-        bufferSize_(buffer_.size() * WordBits), bitPos_(0)
+  static constexpr uint64_t lowMask(size_t bits)
   {
+    return bits < WordBits ? (1ULL << bits) - 1ULL : ~0ULL;
   }
 
-  // 書き込み終了(任意)
-  void terminate(uint32_t mark) { writeBits(mark, sizeof(mark) * ByteBits); }
+  void bindOwned()
+  {
+    buffer_ = owned_.data();
+    wordCount_ = owned_.size();
+    bufferSize_ = wordCount_ * WordBits;
+    writeSize_ = bufferSize_;
+  }
 
-  // ビット書き込み 64bit専用
-  bool writeBits64(uint64_t value, size_t bits)
+  // 容量確保(自動拡張時のみ伸ばす)
+  bool reserveBits(size_t bits)
   {
-    assert(bits <= WordBits);
-    if (bitPos_ + bits > bufferSize_)
+    if (bits <= writeSize_)
     {
+      return true;
+    }
+    if (!autoGrow_)
+    {
+#if defined(RECORD_STATS)
+      stats_.overflows++;
+#endif
       return false;
     }
+    auto words = std::max(wordCount_ * 2, (bits + WordBits - 1) / WordBits);
+    owned_.resize(words);
+    bindOwned();
+    return true;
+  }
 
+  // 書き込み開始: 現在ワードの書き込み済み部分を読み込む
+  void beginWrite()
+  {
     auto bitIndex = bitPos_ % WordBits;
-    auto *ptr = &buffer_[bitPos_ / WordBits];
+    accum_ = bitIndex ? buffer_[bitPos_ / WordBits] & lowMask(bitIndex) : 0;
+    mode_ = Mode::Write;
+  }
 
-    if (bits == WordBits && bitIndex == 0)
+  // リトルエンディアンでnバイト(<=8)読み書き
+  static uint64_t loadWord(const uint8_t *ptr, size_t n)
+  {
+    uint64_t word = 0;
+    if constexpr (std::endian::native == std::endian::little)
+    {
+      std::memcpy(&word, ptr, n);
+    }
+    else
     {
-      *ptr = value;
+      for (size_t i = 0; i < n; i++)
+      {
+        word |= uint64_t(ptr[i]) << (i * ByteBits);
+      }
     }
-    else if (bitIndex + bits <= WordBits)
+    return word;
+  }
+  static void storeWord(uint8_t *ptr, uint64_t word, size_t n)
+  {
+    if constexpr (std::endian::native == std::endian::little)
     {
-      // single
-      auto mask = ((1ULL << bits) - 1ULL);
-      *ptr &= ~(mask << bitIndex);
-      *ptr |= (value & mask) << bitIndex;
+      std::memcpy(ptr, &word, n);
     }
     else
     {
-      // double
-      auto bits1 = WordBits - bitIndex;
-      auto bits2 = bits - bits1;
+      for (size_t i = 0; i < n; i++)
+      {
+        ptr[i] = uint8_t(word >> (i * ByteBits));
+      }
+    }
+  }
+
+  // 読み込み開始: 現在ワードの残りを窓に入れる
+  void beginRead()
+  {
+    flush();
+    accum_ = bitPos_ < bufferSize_
+                 ? buffer_[bitPos_ / WordBits] >> (bitPos_ % WordBits)
+                 : 0;
+    mode_ = Mode::Read;
+  }
+
+public:
+  // バッファの扱い
+  enum class Policy : uint8_t
+  {
+    Fixed,    // 容量固定(溢れたら失敗)
+    AutoGrow, // 溢れたら倍々に拡張
+  };
+
+  // 内部バッファ(nバイト)
+  Serializer(size_t n, Policy policy = Policy::Fixed)
+      : owned_((n + WordBytes - 1) / WordBytes), bitPos_(0),
+        autoGrow_(policy == Policy::AutoGrow)
+  {
+    bindOwned();
+  }
+  // 外部バッファ(8バイト境界必須、端数は使わない)
+  // mmap領域やリングバッファのスロットに直接書き込む
+  Serializer(void *data, size_t bytes)
+      : buffer_(static_cast<uint64_t *>(data)), wordCount_(bytes / WordBytes),
+        bufferSize_(wordCount_ * WordBits), writeSize_(bufferSize_), bitPos_(0)
+  {
+    assert(reinterpret_cast<uintptr_t>(data) % alignof(uint64_t) == 0);
+  }
+  // 読み込み専用ビュー(mmap領域や他のSerializerのdata()をそのまま読む)
+  // 書き込みは常に失敗する
+  static Serializer view(const void *data, size_t bytes)
+  {
+    Serializer ser{const_cast<void *>(data), bytes};
+    ser.writeSize_ = 0;
+    return ser;
+  }
+  Serializer(std::span<uint64_t> words)
+      : Serializer(words.data(), words.size_bytes())
+  {
+  }
+  // 外部バッファのコピーは同じメモリを指す
+  Serializer(const Serializer &other) { *this = other; }
+  Serializer(Serializer &&other) noexcept { *this = std::move(other); }
+  ~Serializer() = default;
+
+  Serializer &operator=(const Serializer &other)
+  {
+    if (this == &other)
+    {
+      return *this;
+    }
+    other.flush();
+    owned_ = other.owned_;
+    buffer_ = other.buffer_;
+    wordCount_ = other.wordCount_;
+    bufferSize_ = other.bufferSize_;
+    writeSize_ = other.writeSize_;
+    bitPos_ = other.bitPos_;
+    accum_ = 0;
+    mode_ = Mode::Idle;
+    autoGrow_ = other.autoGrow_;
+    overrun_ = other.overrun_;
+    if (other.isOwned())
+    {
+      bindOwned();
+    }
+    return *this;
+  }
+  Serializer &operator=(Serializer &&other) noexcept
+  {
+    if (this == &other)
+    {
+      return *this;
+    }
+    bool owned = other.isOwned();
+    owned_ = std::move(other.owned_);
+    buffer_ = owned ? owned_.data() : other.buffer_;
+    wordCount_ = other.wordCount_;
+    bufferSize_ = other.bufferSize_;
+    writeSize_ = other.writeSize_;
+    bitPos_ = other.bitPos_;
+    accum_ = other.accum_;
+    mode_ = other.mode_;
+    autoGrow_ = other.autoGrow_;
+    overrun_ = other.overrun_;
+    other.owned_.clear();
+    other.bindOwned();
+    other.bitPos_ = 0;
+    other.mode_ = Mode::Idle;
+    return *this;
+  }
+
+  // 内部バッファを使っているか
+  [[nodiscard]] bool isOwned() const { return buffer_ == owned_.data(); }
+  // 容量を自動で伸ばすか
+  [[nodiscard]] bool isAutoGrow() const { return autoGrow_; }
+  // 容量(バイト数)
+  [[nodiscard]] size_t capacity() const { return wordCount_ * WordBytes; }
+
+  // 書き込み終了(任意)
+  void terminate(uint32_t mark) { writeBits(mark, sizeof(mark) * ByteBits); }
+
+  // 書き込み途中の端数ワードをバッファへ反映
+  // (現在位置より後ろのビットは保持)
+  void flush() const
+  {
+    auto bitIndex = bitPos_ % WordBits;
+    if (mode_ == Mode::Write && bitIndex != 0)
+    {
+      auto &word = buffer_[bitPos_ / WordBits];
+      word = (word & ~lowMask(bitIndex)) | accum_;
+    }
+  }
 
-      auto mask1 = ((1ULL << bits1) - 1ULL);
-      auto mask2 = ((1ULL << bits2) - 1ULL);
+  // ビット書き込み 64bit専用
+  // 1ワード分たまった時だけバッファへ書き出す
+  bool writeBits64(uint64_t value, size_t bits)
+  {
+    assert(bits <= WordBits);
+    if (bitPos_ + bits > writeSize_ && !reserveBits(bitPos_ + bits))
+    {
+      return false;
+    }
+    if (mode_ != Mode::Write)
+    {
+      beginWrite();
+    }
 
-      *ptr &= ~(mask1 << bitIndex);
-      *ptr |= (value & mask1) << bitIndex;
-      ptr++;
-      *ptr &= ~mask2;
-      *ptr |= (value >> bits1) & mask2;
+    auto bitIndex = bitPos_ % WordBits;
+    value &= lowMask(bits);
+    accum_ |= value << bitIndex;
+    if (bitIndex + bits >= WordBits)
+    {
+      // ワードが埋まったので書き出し
+      buffer_[bitPos_ / WordBits] = accum_;
+      accum_ = bitIndex + bits > WordBits ? value >> (WordBits - bitIndex) : 0;
     }
 
     bitPos_ += bits;
@@ -80,60 +302,53 @@ public:
   bool writeBits(NumType value, size_t bits)
   {
     assert(bits <= sizeof(NumType) * ByteBits);
-    if (bitPos_ + bits > bufferSize_)
-    {
-      return false;
-    }
-
     if constexpr (std::is_signed_v<NumType>)
     {
+      // 符号+絶対値(符号ビットは64bit幅で作る)
+      auto sign = 1ULL << (bits - 1);
       if (value < 0)
       {
-        value = -value;
-        value |= (1 << (bits - 1));
-      }
-      else
-      {
-        value &= ~(1 << (bits - 1));
+        return writeBits64((0ULL - uint64_t(value)) | sign, bits);
       }
+      return writeBits64(uint64_t(value) & ~sign, bits);
     }
     return writeBits64(uint64_t(value), bits);
   }
 
   // ビット読み込み 64bit専用
+  // 窓を使い切った時だけ次のワードを補充する
   bool readBits64(uint64_t &value, size_t bits)
   {
     assert(bits <= WordBits);
     if (bitPos_ + bits > bufferSize_)
     {
+      overrun_ = true;
       return false;
     }
-
-    auto bitIndex = bitPos_ % WordBits;
-    auto *ptr = &buffer_[bitPos_ / WordBits];
-
-    if (bitIndex == 0 && bits == WordBits)
+    if (mode_ != Mode::Read)
     {
-      value = *ptr;
+      beginRead();
     }
-    else if (bitIndex + bits <= WordBits)
+
+    auto avail = WordBits - bitPos_ % WordBits;
+    if (bits < avail)
     {
-      // single
-      auto mask = ((1ULL << bits) - 1ULL);
-      value = (*ptr >> bitIndex) & mask;
+      value = accum_ & lowMask(bits);
+      accum_ >>= bits;
     }
     else
     {
-      // double
-      auto bits1 = WordBits - bitIndex;
-      auto bits2 = bits - bits1;
-
-      auto mask1 = ((1ULL << bits1) - 1ULL);
-      auto mask2 = ((1ULL << bits2) - 1ULL);
-
-      value = (*ptr >> bitIndex) & mask1;
-      ptr++;
-      value |= (*ptr & mask2) << bits1;
+      // 次ワード補充
+      auto next = bitPos_ / WordBits + 1;
+      uint64_t word = next < wordCount_ ? buffer_[next] : 0;
+      auto rest = bits - avail;
+      value = accum_;
+      if (rest != 0)
+      {
+        value |= (word & lowMask(rest)) << avail;
+        word >>= rest;
+      }
+      accum_ = word;
     }
 
     bitPos_ += bits;
@@ -147,16 +362,16 @@ public:
     uint64_t tempValue = 0;
     if (readBits64(tempValue, bits))
     {
-      value = tempValue;
       if constexpr (std::is_signed_v<NumType>)
       {
-        auto mask = (1 << (bits - 1));
-        if (value & mask)
+        auto sign = 1ULL << (bits - 1);
+        if (tempValue & sign)
         {
-          value &= ~mask;
-          value = -value;
+          value = NumType(0ULL - (tempValue & ~sign));
+          return true;
         }
       }
+      value = tempValue;
       return true;
     }
     return false;
@@ -192,12 +407,129 @@ public:
     return false;
   }
 
-  // バイトにそろえる
-  void alignByte()
+  // バイト列書き込み(リトルエンディアンのバイト順でビット列に並べる)
+  // バイト境界にいればバッファへ一括コピーする
+  bool writeBytes(const void *src, size_t bytes)
+  {
+    auto bits = bytes * ByteBits;
+    if (bitPos_ + bits > writeSize_ && !reserveBits(bitPos_ + bits))
+    {
+      return false;
+    }
+    auto *ptr = static_cast<const uint8_t *>(src);
+    if (bitPos_ % ByteBits == 0 && std::endian::native == std::endian::little)
+    {
+      flush();
+      if (bytes != 0)
+      {
+        std::memcpy(reinterpret_cast<uint8_t *>(buffer_) + bitPos_ / ByteBits,
+                    ptr, bytes);
+      }
+      mode_ = Mode::Idle;
+      bitPos_ += bits;
+      return true;
+    }
+    auto rest = bytes % WordBytes;
+    auto *last = ptr + (bytes - rest);
+    for (; ptr != last; ptr += WordBytes)
+    {
+      writeBits64(loadWord(ptr, WordBytes), WordBits);
+    }
+    return rest == 0 || writeBits64(loadWord(last, rest), rest * ByteBits);
+  }
+
+  // バイト列読み込み(writeBytesの逆)
+  bool readBytes(void *dst, size_t bytes)
+  {
+    if (!requireBytes(bytes))
+    {
+      return false;
+    }
+    auto bits = bytes * ByteBits;
+    auto *ptr = static_cast<uint8_t *>(dst);
+    if (bitPos_ % ByteBits == 0 && std::endian::native == std::endian::little)
+    {
+      flush();
+      if (bytes != 0)
+      {
+        std::memcpy(ptr,
+                    reinterpret_cast<const uint8_t *>(buffer_) +
+                        bitPos_ / ByteBits,
+                    bytes);
+      }
+      mode_ = Mode::Idle;
+      bitPos_ += bits;
+      return true;
+    }
+    uint64_t word = 0;
+    for (; bytes >= WordBytes; bytes -= WordBytes, ptr += WordBytes)
+    {
+      readBits64(word, WordBits);
+      storeWord(ptr, word, WordBytes);
+    }
+    if (bytes != 0)
+    {
+      readBits64(word, bytes * ByteBits);
+      storeWord(ptr, word, bytes);
+    }
+    return true;
+  }
+
+  // 他のビット列の先頭bitsビットを現在位置に連結
+  // src: Serializer::data()と同じワード列(末尾ワードまで読めること)
+  bool appendBits(const void *src, size_t bits)
+  {
+    if (bitPos_ + bits > writeSize_ && !reserveBits(bitPos_ + bits))
+    {
+      return false;
+    }
+    const auto *words = static_cast<const uint8_t *>(src);
+    auto count = bits / WordBits;
+    auto bitIndex = bitPos_ % WordBits;
+    auto *dst = buffer_ + bitPos_ / WordBits;
+    if (bitIndex == 0)
+    {
+      // ワード境界: そのままコピー
+      flush();
+      mode_ = Mode::Idle;
+      std::memcpy(dst, words, count * WordBytes);
+    }
+    else
+    {
+      // 境界がずれているのでワード単位でシフトしながらコピー
+      if (mode_ != Mode::Write)
+      {
+        beginWrite();
+      }
+      for (size_t i = 0; i < count; i++)
+      {
+        uint64_t word;
+        std::memcpy(&word, words + i * WordBytes, WordBytes);
+        dst[i] = accum_ | word << bitIndex;
+        accum_ = word >> (WordBits - bitIndex);
+      }
+    }
+    bitPos_ += count * WordBits;
+
+    auto rest = bits % WordBits;
+    if (rest == 0)
+    {
+      return true;
+    }
+    uint64_t word;
+    std::memcpy(&word, words + count * WordBytes, WordBytes);
+    return writeBits64(word, rest);
+  }
+  // 他のSerializerの書き込み済みビット列を連結
+  bool append(const Serializer &other)
   {
-    bitPos_ = ((bitPos_ + ByteBits - 1) / ByteBits) * ByteBits;
+    assert(&other != this);
+    return appendBits(other.data(), other.tell());
   }
 
+  // バイトにそろえる
+  void alignByte() { seek(((bitPos_ + ByteBits - 1) / ByteBits) * ByteBits); }
+
   // バイトにそろえて0で埋める
   void padToNext()
   {
@@ -210,14 +542,102 @@ public:
   }
 
   // 先頭戻し
-  void reset() { bitPos_ = 0; }
+  void reset() { seek(0); }
   // ポインタ移動
-  void seek(size_t pos) { bitPos_ = pos; }
+  void seek(size_t pos)
+  {
+    if (pos == bitPos_)
+    {
+      return;
+    }
+#if defined(RECORD_STATS)
+    stats_.highWater = std::max(stats_.highWater, bitPos_);
+#endif
+    flush();
+    mode_ = Mode::Idle;
+    bitPos_ = pos;
+  }
+  // 読み飛ばし(範囲外なら失敗して動かない)
+  bool skipBits(size_t bits)
+  {
+    if (bitPos_ + bits > bufferSize_)
+    {
+      overrun_ = true;
+      return false;
+    }
+    seek(bitPos_ + bits);
+    return true;
+  }
+  // 残りからbytesバイト読めるか(読む前に確かめる、足りなければ失敗)
+  bool requireBytes(size_t bytes)
+  {
+    auto rest = bitPos_ < bufferSize_ ? bufferSize_ - bitPos_ : 0;
+    if (bytes > rest / ByteBits)
+    {
+      overrun_ = true;
+      return false;
+    }
+    return true;
+  }
+  // 読み込める範囲をbitsまでに狭める(受信途中のバッファを読むビュー向け)
+  void limitRead(size_t bits) { bufferSize_ = std::min(bufferSize_, bits); }
+  // 範囲の終わりを越えて読もうとしたか(データ不足と壊れたデータの区別)
+  [[nodiscard]] bool overrun() const { return overrun_; }
+
+  // 失敗時の巻き戻し(統計では回数を数える)
+  void rollback(size_t pos)
+  {
+#if defined(RECORD_STATS)
+    stats_.rollbacks++;
+#endif
+    seek(pos);
+  }
   // 現在値取得
   size_t tell() const { return bitPos_; }
 
+  // 統計
+  [[nodiscard]] SerializerStats stats() const
+  {
+#if defined(RECORD_STATS)
+    auto stats = stats_;
+    stats.highWater = std::max(stats.highWater, bitPos_);
+    return stats;
+#else
+    return {};
+#endif
+  }
+  void resetStats()
+  {
+#if defined(RECORD_STATS)
+    stats_ = {};
+#endif
+  }
+  // 数値/配列要素の書き込み幅を数える
+  void countNumber([[maybe_unused]] size_t bits)
+  {
+#if defined(RECORD_STATS)
+    stats_.numberBits[std::min<size_t>(bits >> 1U, 32)]++;
+#endif
+  }
+  void countArrayType([[maybe_unused]] size_t type,
+                      [[maybe_unused]] size_t num = 1)
+  {
+#if defined(RECORD_STATS)
+    stats_.arrayTypes[type] += num;
+#endif
+  }
+
   // 先頭ポインタ取得
-  [[nodiscard]] const void *data() const { return buffer_.data(); }
+  [[nodiscard]] const void *data() const
+  {
+    flush();
+    return buffer_;
+  }
+  // 書き込み済みバイト列(外部バッファならそのままsend/writevに渡せる)
+  [[nodiscard]] std::span<const std::byte> bytes() const
+  {
+    return {static_cast<const std::byte *>(data()), size()};
+  }
 
   // 保持データーサイズ(バイト数)
   [[nodiscard]] size_t size() const
@@ -3,8 +3,11 @@
 //
 #include "record.h"
 #include "serialize.h"
+#include <algorithm>
+#include <bit>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 
 namespace record
 {
@@ -21,8 +24,79 @@ namespace
 [[maybe_unused]] constexpr uint32_t BBVersion = 0x2; // version separator
 [[maybe_unused]] constexpr uint32_t BBOther = 0x3;   // data
 
+// BBZeroをnum個まとめて書き込み
+bool writeZeroTags(Serializer &ser, size_t num)
+{
+  constexpr size_t Chunk = 64 / ValueInterface::BaseBits;
+  while (num > 0)
+  {
+    auto n = num < Chunk ? num : Chunk;
+    if (!ser.writeBits64(BBZero, n * ValueInterface::BaseBits))
+    {
+      return false;
+    }
+    num -= n;
+  }
+  return true;
+}
+
+//
+// RunLength差分
+// 先頭 10 ff : 形式番号(ff = 01)
+// 10 0 nnnn: 変化なしフィールドがn+1個続く
+// 10 1     : バージョンセパレータ
+// それ以外はフィールドの差分(先頭は00/01/11)
+//
+constexpr size_t RunTagBits = ValueInterface::BaseBits + 1;
+// 形式番号(Plainの差分を読んだ場合や、将来の形式と区別する)
+constexpr size_t FormatBits = 2;
+constexpr uint32_t RunLengthFormat = 1;
+constexpr uint32_t RunLengthHeader =
+    BBVersion | (RunLengthFormat << ValueInterface::BaseBits);
+
+bool writeRunHeader(Serializer &ser)
+{
+  return ser.writeBits(RunLengthHeader, ValueInterface::BaseBits + FormatBits);
+}
+
+bool readRunHeader(Serializer &ser)
+{
+  uint32_t header = 0;
+  return ser.readBits(header, ValueInterface::BaseBits + FormatBits) &&
+         header == RunLengthHeader;
+}
+
+bool writeSkipRun(Serializer &ser, size_t num)
+{
+  while (num > 0)
+  {
+    auto n = num < ValueInterface::MaxRun ? num : ValueInterface::MaxRun;
+    uint64_t token = BBVersion | ((n - 1) << RunTagBits);
+    if (!ser.writeBits64(token, RunTagBits + ValueInterface::RunBits))
+    {
+      return false;
+    }
+    num -= n;
+  }
+  return true;
+}
+
+bool writeRunSeparator(Serializer &ser)
+{
+  return ser.writeBits64(BBVersion | (1ULL << ValueInterface::BaseBits),
+                         RunTagBits);
+}
+
 } // namespace
 
+//
+// 終端書き込み
+//
+bool ValueLink::writeTerminate(Serializer &ser)
+{
+  return ser.writeBits(BBZero, ValueInterface::BaseBits);
+}
+
 //
 // 終端チェック
 //
@@ -34,22 +108,257 @@ bool ValueLink::checkTerminate(Serializer &ser)
   return ret ? term == BBZero : false;
 }
 
+//
+// dirty tracking
+//
+void ValueLink::enableDirtyTracking()
+{
+  tracking_ = true;
+  linkFields(true);
+  auto words = (size() + MapBits - 1) / MapBits;
+  dirty_.assign(words, 0);
+  plain_.assign(words, 0);
+  sticky_.assign(words, 0);
+  for (size_t i = 0; i < size(); i++)
+  {
+    const auto *val = field(i);
+    auto bit = 1ULL << (i % MapBits);
+    if (val->isSeparator() || !val->linked())
+    {
+      sticky_[i / MapBits] |= bit;
+    }
+    else if (!val->isBool() && !val->isArray())
+    {
+      plain_[i / MapBits] |= bit;
+    }
+  }
+  markAllDirty();
+}
+
+//
+// 変更通知の開始/停止
+// 破棄済みと相対位置がint32に収まらないフィールドには触らない
+//
+void ValueLink::linkFields(bool enable)
+{
+  released_.resize((size() + MapBits - 1) / MapBits, 0);
+  for (size_t i = 0; i < size(); i++)
+  {
+    auto back = -fieldOffset(i);
+    if (testBit(released_, i) || !reachable(back))
+    {
+      continue;
+    }
+    field(i)->linkOffset_ = enable ? static_cast<int32_t>(back) : 0;
+  }
+}
+
+//
+void ValueLink::markAllDirty()
+{
+  if (!tracking_)
+  {
+    return;
+  }
+  std::fill(dirty_.begin(), dirty_.end(), ~0ULL);
+  if (auto rem = size() % MapBits)
+  {
+    dirty_.back() = (1ULL << rem) - 1ULL;
+  }
+}
+
+//
+// 一括コピー/比較
+// 共有レイアウトごとに最初の1回だけ、全フィールドがバイト列として扱えて
+// 隙間なく並んでいるかを調べる
+//
+const RecordLayout::Bulk *ValueLink::bulkLayout() const
+{
+  if (layout_ == nullptr || !layout_->sealed())
+  {
+    return nullptr;
+  }
+  std::call_once(layout_->bulkOnce_,
+                 [this]() { layout_->bulk_ = analyzeBulk(); });
+  return layout_->bulk_.valid ? &layout_->bulk_ : nullptr;
+}
+
+//
+RecordLayout::Bulk ValueLink::analyzeBulk() const
+{
+  RecordLayout::Bulk bulk;
+  if (size() == 0)
+  {
+    return bulk;
+  }
+  bulk.begin = static_cast<int32_t>(fieldOffset(0));
+  int64_t end = bulk.begin;
+  for (size_t i = 0; i < size(); i++)
+  {
+    auto raw = field(i)->rawBytes();
+    if (raw.size == 0 || fieldOffset(i) != end)
+    {
+      // 対象外の型か、フィールドの間に他のメンバーがある
+      return {};
+    }
+    auto offset = static_cast<uint32_t>(end - bulk.begin + raw.begin);
+    auto bytes = static_cast<uint32_t>(raw.end - raw.begin);
+    auto &runs = bulk.runs;
+    if (bytes == 0)
+    {
+      // 値を持たない(ValueVersion)
+    }
+    else if (!runs.empty() &&
+             runs.back().first + runs.back().second == offset)
+    {
+      runs.back().second += bytes;
+    }
+    else
+    {
+      runs.emplace_back(offset, bytes);
+    }
+    end += static_cast<int64_t>(raw.size);
+  }
+  bulk.valid = true;
+  return bulk;
+}
+
+//
+bool ValueLink::copyBulk(const ValueLink &other)
+{
+  const auto *bulk = bulkLayout();
+  if (bulk == nullptr || &other == this)
+  {
+    return false;
+  }
+  // 値メンバーだけを写す(vtableとlink情報はコピー先のものを残す)
+  auto *dst = reinterpret_cast<char *>(this) + bulk->begin;
+  const auto *src = reinterpret_cast<const char *>(&other) + bulk->begin;
+  for (const auto &[offset, bytes] : bulk->runs)
+  {
+    std::memcpy(dst + offset, src + offset, bytes);
+  }
+  // フィールドごとのcopyと同じく全フィールド変更扱い
+  generation_++;
+  markAllDirty();
+  return true;
+}
+
+//
+// 変更フィールドのみコピー
+//
+void ValueLink::copyDirty(const ValueLink &other)
+{
+  if (size() != other.size())
+  {
+    return;
+  }
+  for (size_t i = 0; i < size(); i++)
+  {
+    if (other.isDirty(i))
+    {
+      field(i)->copy(*other.field(i));
+    }
+  }
+}
+
 //
 // 丸ごと保存
 //
 bool ValueLink::serialize(Serializer &ser) const
+{
+  return caching_ && !unlinked_ ? serializeCached(ser) : serializeFields(ser);
+}
+
+//
+// キャッシュ経由で保存(世代が進んでいる時だけエンコードし直す)
+// 値の変更とserializeは同時に起きないので、世代が公開された後の中身は
+// 次の変更まで書き換わらない
+//
+bool ValueLink::serializeCached(Serializer &ser) const
+{
+  auto stamp = generation_ + 1;
+  if (cache_.stamp.load(std::memory_order_acquire) != stamp)
+  {
+    if (cache_.filling.exchange(true, std::memory_order_acquire))
+    {
+      // 他のスレッドが作り直している
+      return serializeFields(ser);
+    }
+    if (cache_.stamp.load(std::memory_order_acquire) != stamp)
+    {
+      cache_.words.assign((measureFields() + 63) / 64, 0);
+      Serializer local{std::span<uint64_t>(cache_.words)};
+      if (!serializeFields(local))
+      {
+        // 見積もりを超えた場合はキャッシュせずに直接書く
+        cache_.filling.store(false, std::memory_order_release);
+        return serializeFields(ser);
+      }
+      local.flush();
+      cache_.bits = local.tell();
+      cache_.stamp.store(stamp, std::memory_order_release);
+    }
+    cache_.filling.store(false, std::memory_order_release);
+  }
+  return ser.appendBits(cache_.words.data(), cache_.bits);
+}
+
+//
+bool ValueLink::serializeFields(Serializer &ser) const
 {
   auto begPos = ser.tell();
-  for (const auto val : list_)
+  for (size_t i = 0; i < size(); i++)
   {
-    if (!val->serialize(ser))
+    auto fieldPos = ser.tell();
+    if (!field(i)->serialize(ser))
     {
       // 失敗したのでポインタもどす
-      ser.seek(begPos);
+      ser.rollback(begPos);
       return false;
     }
+    countField(i, ser.tell() - fieldPos);
+  }
+  return writeTerminate(ser);
+}
+
+//
+// 書き込みサイズ(最新のキャッシュがあればそのサイズ)
+//
+size_t ValueLink::measureBits() const
+{
+  if (caching_ &&
+      cache_.stamp.load(std::memory_order_acquire) == generation_ + 1)
+  {
+    return cache_.bits;
+  }
+  return measureFields();
+}
+
+//
+size_t ValueLink::measureFields() const
+{
+  size_t bits = ValueInterface::BaseBits;
+  for (const auto val : fields())
+  {
+    bits += val->measureBits();
   }
-  return ser.writeBits(BBZero, ValueInterface::BaseBits); // terminate
+  return bits;
+}
+
+//
+size_t ValueLink::measureDiffBits(const ValueLink &other) const
+{
+  if (size() != other.size())
+  {
+    return 0;
+  }
+  size_t bits = ValueInterface::BaseBits;
+  for (size_t i = 0; i < size(); i++)
+  {
+    bits += field(i)->measureDiffBits(*other.field(i));
+  }
+  return bits;
 }
 
 //
@@ -57,24 +366,80 @@ bool ValueLink::serialize(Serializer &ser) const
 //
 bool ValueLink::serializeDiff(Serializer &ser, const ValueLink &other) const
 {
-  if (list_.size() != other.list_.size())
+  if (size() != other.size())
   {
     return false;
   }
 
   auto begPos = ser.tell();
-  auto beg0 = list_.begin();
-  auto beg1 = other.list_.begin();
-  for (; beg0 != list_.end(); beg0++, beg1++)
+  for (size_t i = 0; i < size(); i++)
   {
-    if (!(*beg0)->serializeDiff(ser, **beg1))
+    auto fieldPos = ser.tell();
+    if (!field(i)->serializeDiff(ser, *other.field(i)))
     {
       // 失敗したのでポインタもどす
-      ser.seek(begPos);
+      ser.rollback(begPos);
       return false;
     }
+    countDiff(i, ser.tell() - fieldPos, *field(i), *other.field(i));
   }
-  return ser.writeBits(BBZero, ValueInterface::BaseBits); // terminate
+  return writeTerminate(ser);
+}
+
+//
+// 差分を保存(フォーマット指定)
+//
+bool ValueLink::serializeDiff(Serializer &ser, const ValueLink &other,
+                              DiffFormat format) const
+{
+  if (format == DiffFormat::Plain)
+  {
+    return serializeDiff(ser, other);
+  }
+  if (size() != other.size())
+  {
+    return false;
+  }
+
+  auto begPos = ser.tell();
+  if (!writeRunHeader(ser))
+  {
+    ser.rollback(begPos);
+    return false;
+  }
+  size_t run = 0;
+  for (size_t i = 0; i < size(); i++)
+  {
+    const auto *val = field(i);
+    const auto *oval = other.field(i);
+    if (!val->isSeparator() && val->equal(*oval))
+    {
+      countDiff(i, 0, *val, *oval);
+      run++;
+      continue;
+    }
+    bool ret = writeSkipRun(ser, run);
+    run = 0;
+    auto fieldPos = ser.tell();
+    if (ret)
+    {
+      ret = val->isSeparator() ? writeRunSeparator(ser)
+                               : val->serializeRunLengthDiff(ser, *oval);
+    }
+    if (!ret)
+    {
+      // 失敗したのでポインタもどす
+      ser.rollback(begPos);
+      return false;
+    }
+    countDiff(i, ser.tell() - fieldPos, *val, *oval);
+  }
+  if (!writeSkipRun(ser, run))
+  {
+    ser.rollback(begPos);
+    return false;
+  }
+  return writeTerminate(ser);
 }
 
 //
@@ -82,61 +447,393 @@ bool ValueLink::serializeDiff(Serializer &ser, const ValueLink &other) const
 //
 bool ValueLink::serializeDiffAndCopy(Serializer &ser, const ValueLink &other)
 {
-  if (list_.size() != other.list_.size())
+  if (size() != other.size())
   {
     return false;
   }
 
   auto begPos = ser.tell();
-  auto beg0 = list_.begin();
-  auto beg1 = other.list_.begin();
 #if defined(RECORD_FAST_DIFF_COPY)
-  for (; beg0 != list_.end(); beg0++, beg1++)
+  for (size_t i = 0; i < size(); i++)
   {
-    if (!(*beg0)->serializeDiffAndCopy(ser, **beg1))
+    auto fieldPos = ser.tell();
+    if (!field(i)->serializeDiffAndCopy(ser, *other.field(i)))
     {
       // 失敗したのでポインタもどす
+      ser.rollback(begPos);
+      return false;
+    }
+    // コピー後なので変化なしかどうかは数えない
+    countField(i, ser.tell() - fieldPos);
+  }
+  if (!writeTerminate(ser))
+  {
+    ser.rollback(begPos);
+    return false;
+  }
+#else
+  for (size_t i = 0; i < size(); i++)
+  {
+    auto fieldPos = ser.tell();
+    if (!field(i)->serializeDiff(ser, *other.field(i)))
+    {
+      // 失敗したのでポインタもどす
+      ser.rollback(begPos);
+      return false;
+    }
+    countDiff(i, ser.tell() - fieldPos, *field(i), *other.field(i));
+  }
+  if (!writeTerminate(ser))
+  {
+    ser.rollback(begPos);
+    return false;
+  }
+
+  // 出力成功後にのみ現在値を更新(atomic behavior)
+  copy(other);
+#endif
+  return true;
+}
+
+//
+// 差分保存して成功時にコピー(フォーマット指定)
+//
+bool ValueLink::serializeDiffAndCopy(Serializer &ser, const ValueLink &other,
+                                     DiffFormat format)
+{
+  if (format == DiffFormat::Plain)
+  {
+    return serializeDiffAndCopy(ser, other);
+  }
+  if (!serializeDiff(ser, other, format))
+  {
+    return false;
+  }
+  copy(other);
+  return true;
+}
+
+//
+// 変更のあったフィールドだけ比較して差分を保存
+// 出力はbase.serializeDiff(ser, *this)と同じ
+//
+bool ValueLink::serializeDirty(Serializer &ser, const ValueLink &base) const
+{
+  if (!tracking_)
+  {
+    return base.serializeDiff(ser, *this);
+  }
+  if (size() != base.size())
+  {
+    return false;
+  }
+
+  auto begPos = ser.tell();
+  // 未変更が続く区間はBBZeroをまとめて書く
+  size_t zeros = 0;
+  for (size_t i = 0; i < size(); i++)
+  {
+    bool dirty = testBit(dirty_, i);
+    if (!dirty && testBit(plain_, i))
+    {
+      countDiff(i, ValueInterface::BaseBits, *base.field(i), *field(i));
+      zeros++;
+      continue;
+    }
+    bool ret = writeZeroTags(ser, zeros);
+    zeros = 0;
+    auto fieldPos = ser.tell();
+    if (ret)
+    {
+      ret = dirty ? base.field(i)->serializeDiff(ser, *field(i))
+                  : field(i)->serializeUnchanged(ser);
+    }
+    if (!ret)
+    {
+      // 失敗したのでポインタもどす
+      ser.rollback(begPos);
+      return false;
+    }
+    countDiff(i, ser.tell() - fieldPos, *base.field(i), *field(i));
+  }
+  if (!writeZeroTags(ser, zeros))
+  {
+    ser.rollback(begPos);
+    return false;
+  }
+  return writeTerminate(ser);
+}
+
+//
+// 変更のあったフィールドだけ比較して差分を保存(フォーマット指定)
+// RunLengthならdirtyビットだけをたどる
+//
+bool ValueLink::serializeDirty(Serializer &ser, const ValueLink &base,
+                               DiffFormat format) const
+{
+  if (format == DiffFormat::Plain)
+  {
+    return serializeDirty(ser, base);
+  }
+  if (!tracking_)
+  {
+    return base.serializeDiff(ser, *this, format);
+  }
+  if (size() != base.size())
+  {
+    return false;
+  }
+
+  auto begPos = ser.tell();
+  if (!writeRunHeader(ser))
+  {
+    ser.rollback(begPos);
+    return false;
+  }
+  // 次に出力するフィールド(それより前はスキップ済み)
+  size_t next = 0;
+  for (size_t word = 0; word < dirty_.size(); word++)
+  {
+    for (auto bits = dirty_[word]; bits != 0; bits &= bits - 1)
+    {
+      auto i = word * MapBits + std::countr_zero(bits);
+      const auto *val = field(i);
+      const auto *bval = base.field(i);
+      bool separator = val->isSeparator();
+      if (!separator && bval->equal(*val))
+      {
+        countDiff(i, 0, *bval, *val);
+        continue;
+      }
+      bool ret = writeSkipRun(ser, i - next);
+      auto fieldPos = ser.tell();
+      if (ret)
+      {
+        ret = separator ? writeRunSeparator(ser)
+                        : bval->serializeRunLengthDiff(ser, *val);
+      }
+      if (!ret)
+      {
+        // 失敗したのでポインタもどす
+        ser.rollback(begPos);
+        return false;
+      }
+      countDiff(i, ser.tell() - fieldPos, *bval, *val);
+      next = i + 1;
+    }
+  }
+  if (!writeSkipRun(ser, size() - next))
+  {
+    ser.rollback(begPos);
+    return false;
+  }
+  return writeTerminate(ser);
+}
+
+//
+// 丸ごと更新
+//
+bool ValueLink::deserialize(Serializer &ser)
+{
+  auto begPos = ser.tell();
+  for (const auto val : fields())
+  {
+    auto prevPos = ser.tell();
+    if (!val->deserialize(ser))
+    {
+      if (val->isSeparator())
+      {
+        // セパレータ(バージョン区切り)なら
+        // 過去バージョン(=正常終了)
+        ser.seek(prevPos);
+        break;
+      }
+      // 失敗したのでポインタもどす
+      ser.rollback(begPos);
+      return false;
+    }
+  }
+  return checkTerminate(ser);
+}
+
+//
+// 値を作らないレコード走査
+//
+bool ValueLink::scanRecord(Serializer &ser, bool diff, FieldIndex *index) const
+{
+  auto begPos = ser.tell();
+  if (index != nullptr)
+  {
+    index->begin = begPos;
+    index->offsets.clear();
+    index->offsets.reserve(size());
+  }
+  for (const auto val : fields())
+  {
+    auto prevPos = ser.tell();
+    if (!(diff ? val->skipDiff(ser) : val->skip(ser)))
+    {
+      if (val->isSeparator())
+      {
+        // 過去バージョン(=正常終了)
+        ser.seek(prevPos);
+        break;
+      }
+      ser.seek(begPos);
+      return false;
+    }
+    if (index != nullptr)
+    {
+      index->offsets.push_back(static_cast<uint32_t>(prevPos - begPos));
+    }
+  }
+  if (!checkTerminate(ser))
+  {
+    ser.seek(begPos);
+    return false;
+  }
+  if (index != nullptr)
+  {
+    index->end = ser.tell();
+  }
+  return true;
+}
+
+//
+bool ValueLink::buildFieldIndex(Serializer &ser, FieldIndex &index) const
+{
+  return scanRecord(ser, false, &index);
+}
+
+//
+bool ValueLink::skipRecord(Serializer &ser) const
+{
+  return scanRecord(ser, false, nullptr);
+}
+
+//
+bool ValueLink::skipDiffRecord(Serializer &ser) const
+{
+  return scanRecord(ser, true, nullptr);
+}
+
+//
+// RunLength差分の読み飛ばし(deserializeDiffと同じ手順)
+//
+bool ValueLink::skipDiffRecord(Serializer &ser, DiffFormat format) const
+{
+  if (format == DiffFormat::Plain)
+  {
+    return skipDiffRecord(ser);
+  }
+
+  auto begPos = ser.tell();
+  if (!readRunHeader(ser))
+  {
+    ser.seek(begPos);
+    return false;
+  }
+  size_t skip = 0;
+  for (const auto val : fields())
+  {
+    if (skip > 0)
+    {
+      if (val->isSeparator())
+      {
+        ser.seek(begPos);
+        return false;
+      }
+      skip--;
+      continue;
+    }
+
+    auto prevPos = ser.tell();
+    uint32_t tag = BBZero;
+    uint32_t flag = 0;
+    if (!ser.readBits(tag, ValueInterface::BaseBits) ||
+        (tag == BBVersion && !ser.readBits(flag, 1)))
+    {
+      ser.seek(begPos);
+      return false;
+    }
+    if (val->isSeparator())
+    {
+      if (tag == BBVersion && flag == 1)
+      {
+        continue;
+      }
+      // 過去バージョン(=正常終了)
+      ser.seek(prevPos);
+      break;
+    }
+    if (tag == BBVersion)
+    {
+      if (flag != 0 || !ser.readBits(skip, ValueInterface::RunBits))
+      {
+        ser.seek(begPos);
+        return false;
+      }
+      continue;
+    }
+    ser.seek(prevPos);
+    if (!val->skipRunLengthDiff(ser))
+    {
       ser.seek(begPos);
       return false;
     }
   }
-  if (!ser.writeBits(BBZero, ValueInterface::BaseBits))
+  if (skip > 0 || !checkTerminate(ser))
+  {
+    ser.seek(begPos);
+    return false;
+  }
+  return true;
+}
+
+//
+bool ValueLink::skipField(Serializer &ser, size_t number) const
+{
+  if (number >= size())
+  {
+    return false;
+  }
+  auto begPos = ser.tell();
+  if (!field(number)->skip(ser))
   {
     ser.seek(begPos);
     return false;
   }
-#else
-  for (; beg0 != list_.end(); beg0++, beg1++)
+  return true;
+}
+
+//
+bool ValueLink::deserializeField(Serializer &ser, const FieldIndex &index,
+                                 size_t number)
+{
+  if (number >= index.size() || number >= size())
   {
-    if (!(*beg0)->serializeDiff(ser, **beg1))
-    {
-      // 失敗したのでポインタもどす
-      ser.seek(begPos);
-      return false;
-    }
+    return false;
   }
-  if (!ser.writeBits(BBZero, ValueInterface::BaseBits))
+  auto begPos = ser.tell();
+  ser.seek(index.position(number));
+  if (!field(number)->deserialize(ser))
   {
     ser.seek(begPos);
     return false;
   }
-
-  // 出力成功後にのみ現在値を更新(atomic behavior)
-  copy(other);
-#endif
   return true;
 }
 
 //
-// 丸ごと更新
+// 差分を読んで更新
 //
-bool ValueLink::deserialize(Serializer &ser)
+bool ValueLink::deserializeDiff(Serializer &ser)
 {
   auto begPos = ser.tell();
-  for (const auto val : list_)
+  for (const auto val : fields())
   {
     auto prevPos = ser.tell();
-    if (!val->deserialize(ser))
+    if (!val->deserializeDiff(ser))
     {
       if (val->isSeparator())
       {
@@ -146,7 +843,7 @@ bool ValueLink::deserialize(Serializer &ser)
         break;
       }
       // 失敗したのでポインタもどす
-      ser.seek(begPos);
+      ser.rollback(begPos);
       return false;
     }
   }
@@ -154,28 +851,85 @@ bool ValueLink::deserialize(Serializer &ser)
 }
 
 //
-// 差分を読んで更新
+// 差分を読んで更新(フォーマット指定)
 //
-bool ValueLink::deserializeDiff(Serializer &ser)
+bool ValueLink::deserializeDiff(Serializer &ser, DiffFormat format)
 {
+  if (format == DiffFormat::Plain)
+  {
+    return deserializeDiff(ser);
+  }
+
   auto begPos = ser.tell();
-  for (const auto val : list_)
+  if (!readRunHeader(ser))
   {
-    auto prevPos = ser.tell();
-    if (!val->deserializeDiff(ser))
+    ser.rollback(begPos);
+    return false;
+  }
+  // スキップ中の残りフィールド数
+  size_t skip = 0;
+  for (const auto val : fields())
+  {
+    if (skip > 0)
     {
       if (val->isSeparator())
       {
-        // セパレータ(バージョン区切り)なら
-        // 過去バージョン(=正常終了)
-        ser.seek(prevPos);
-        break;
+        // セパレータはスキップに含めない
+        ser.rollback(begPos);
+        return false;
+      }
+      skip--;
+      continue;
+    }
+
+    auto prevPos = ser.tell();
+    uint32_t tag = BBZero;
+    if (!ser.readBits(tag, ValueInterface::BaseBits))
+    {
+      ser.rollback(begPos);
+      return false;
+    }
+    uint32_t flag = 0;
+    if (tag == BBVersion && !ser.readBits(flag, 1))
+    {
+      ser.rollback(begPos);
+      return false;
+    }
+    if (val->isSeparator())
+    {
+      if (tag == BBVersion && flag == 1)
+      {
+        continue;
+      }
+      // 過去バージョン(=正常終了)
+      ser.seek(prevPos);
+      break;
+    }
+    if (tag == BBVersion)
+    {
+      size_t run = 0;
+      if (flag != 0 || !ser.readBits(run, ValueInterface::RunBits))
+      {
+        ser.rollback(begPos);
+        return false;
       }
+      // このフィールドを含めてrun+1個変化なし
+      skip = run;
+      continue;
+    }
+    ser.seek(prevPos);
+    if (!val->deserializeRunLengthDiff(ser))
+    {
       // 失敗したのでポインタもどす
-      ser.seek(begPos);
+      ser.rollback(begPos);
       return false;
     }
   }
+  if (skip > 0)
+  {
+    ser.rollback(begPos);
+    return false;
+  }
   return checkTerminate(ser);
 }
 
@@ -183,6 +937,26 @@ bool ValueLink::deserializeDiff(Serializer &ser)
 // クラス別シリアライザ
 //
 
+//
+bool ValueInterface::serializeUnchanged(Serializer &ser) const
+{
+  return ser.writeBits(BBZero, BaseBits);
+}
+
+//
+size_t ValueInterface::measureBits() const
+{
+  Serializer local{getByteSize() + ByteBits, Serializer::Policy::AutoGrow};
+  return serialize(local) ? local.tell() : 0;
+}
+
+//
+size_t ValueInterface::measureDiffBits(const ValueInterface &other) const
+{
+  Serializer local{getByteSize() + ByteBits, Serializer::Policy::AutoGrow};
+  return serializeDiff(local, other) ? local.tell() : 0;
+}
+
 //
 // バージョンセパレータ
 //
@@ -199,6 +973,16 @@ bool ValueVersion::serializeDiff(Serializer &ser, const ValueInterface &) const
   return serialize(ser);
 }
 //
+bool ValueVersion::serializeDiff(Serializer &ser, const ValueVersion &) const
+{
+  return serialize(ser);
+}
+//
+bool ValueVersion::serializeUnchanged(Serializer &ser) const
+{
+  return serialize(ser);
+}
+//
 bool ValueVersion::deserialize(Serializer &ser)
 {
   uint32_t version;
@@ -210,6 +994,12 @@ bool ValueVersion::deserialize(Serializer &ser)
 }
 //
 bool ValueVersion::deserializeDiff(Serializer &ser) { return deserialize(ser); }
+//
+bool ValueVersion::skip(Serializer &ser) const
+{
+  uint32_t version;
+  return ser.readBits(version, BaseBits) && version == BBVersion;
+}
 
 //
 // boolean
@@ -228,6 +1018,16 @@ bool ValueBool::serializeDiff(Serializer &ser,
   return other.serialize(ser);
 }
 //
+bool ValueBool::serializeDiff(Serializer &ser, const ValueBool &other) const
+{
+  return other.ValueBool::serialize(ser);
+}
+//
+bool ValueBool::serializeUnchanged(Serializer &ser) const
+{
+  // booleanは値そのもの
+  return serialize(ser);
+}
 //
 bool ValueBool::deserialize(Serializer &ser)
 {
@@ -237,11 +1037,13 @@ bool ValueBool::deserialize(Serializer &ser)
     if (value == 0)
     {
       val_ = false;
+      markDirty();
       return true;
     }
     else if (value == 1)
     {
       val_ = true;
+      markDirty();
       return true;
     }
   }
@@ -249,135 +1051,453 @@ bool ValueBool::deserialize(Serializer &ser)
 }
 //
 bool ValueBool::deserializeDiff(Serializer &ser) { return deserialize(ser); }
+//
+bool ValueBool::skip(Serializer &ser) const
+{
+  uint32_t value;
+  return ser.readBits(value, BaseBits) && value <= 1;
+}
 
 //
 // string
 //
 
+namespace
+{
+
+// StringCodecの読み込み先(std::string)
+struct DynamicStorage
+{
+  std::string &str_;
+
+  [[nodiscard]] size_t size() const { return str_.size(); }
+  char *data() { return str_.data(); }
+  bool resize(size_t len)
+  {
+    str_.resize(len);
+    return true;
+  }
+};
+
+// StringCodecの読み込み先(固定長バッファ、容量を超えたら失敗)
+struct FixedStorage
+{
+  char *data_;
+  size_t &len_;
+  size_t capacity_;
+
+  [[nodiscard]] size_t size() const { return len_; }
+  char *data() { return data_; }
+  bool resize(size_t len)
+  {
+    if (len > capacity_)
+    {
+      return false;
+    }
+    len_ = len;
+    return true;
+  }
+};
+
+} // namespace
+
 //
-bool ValueString::serialize(Serializer &ser) const
+// 長さ: LongLengthTag未満はSizeBitsのみ
+// それ以上はLongLengthTagの後に(len - LongLengthTag)を7bitずつ(継続ビット付き)
+//
+bool StringCodec::writeLength(Serializer &ser, size_t len)
 {
-  if (!ser.writeBits(BBOther, BaseBits))
+  if (len < LongLengthTag)
+  {
+    return ser.writeBits(len, SizeBits);
+  }
+  if (!ser.writeBits(LongLengthTag, SizeBits))
   {
-    // 型書き込み失敗
     return false;
   }
-  auto len = val_.size();
-  if (!ser.writeBits(len, SizeBits))
+  uint64_t rest = len - LongLengthTag;
+  do
+  {
+    uint64_t group = rest & ((1ULL << LengthGroupBits) - 1);
+    rest >>= LengthGroupBits;
+    if (rest != 0)
+    {
+      group |= 1ULL << LengthGroupBits;
+    }
+    if (!ser.writeBits64(group, LengthGroupBits + 1))
+    {
+      return false;
+    }
+  } while (rest != 0);
+  return true;
+}
+//
+bool StringCodec::readLength(Serializer &ser, size_t &len)
+{
+  if (!ser.readBits(len, SizeBits))
   {
-    // バイト数書き込み失敗
     return false;
   }
-  if (len == 0)
+  if (len < LongLengthTag)
   {
-    // 空なのでここで終わり
     return true;
   }
-
-  // 文字列はバイト単位にそろえ直す
-  for (auto byte : val_)
+  uint64_t rest = 0;
+  for (size_t shift = 0; shift < 64; shift += LengthGroupBits)
   {
-    if (!ser.writeByte(byte))
+    uint64_t group;
+    if (!ser.readBits64(group, LengthGroupBits + 1))
     {
       return false;
     }
+    rest |= (group & ((1ULL << LengthGroupBits) - 1)) << shift;
+    if ((group >> LengthGroupBits) == 0)
+    {
+      len += rest;
+      return true;
+    }
   }
-
-  return true;
+  // 長すぎる
+  return false;
 }
 //
-bool ValueString::serializeDiff(Serializer &ser,
-                                const ValueInterface &other) const
+size_t StringCodec::lengthBits(size_t len)
 {
-  if (const auto *oval = valueCast<ValueString>(other))
+  if (len < LongLengthTag)
+  {
+    return SizeBits;
+  }
+  size_t groups = 1;
+  for (auto rest = (len - LongLengthTag) >> LengthGroupBits; rest != 0;
+       rest >>= LengthGroupBits)
+  {
+    groups++;
+  }
+  return SizeBits + groups * (LengthGroupBits + 1);
+}
+
+//
+// valueを書き込む(辞書にあれば番号)
+//
+bool StringCodec::write(Serializer &ser, std::string_view value,
+                        const StringDictionary *dict)
+{
+  uint32_t index;
+  if (dict != nullptr && dict->find(value, index))
   {
-    if (val_ == oval->val_)
+    if (!ser.writeBits(BBOne, BaseBits) || !ser.writeBits(PatchDictionary, 1))
     {
-      // 同じなので差分無し(BaseBit<Zero>のみ出力)
-      return ser.writeBits(BBZero, BaseBits);
+      return false;
     }
+    return writeLength(ser, index);
+  }
+  if (!ser.writeBits(BBOther, BaseBits))
+  {
+    // 型書き込み失敗
+    return false;
+  }
+  auto len = value.size();
+  if (!writeLength(ser, len))
+  {
+    // バイト数書き込み失敗
+    return false;
+  }
+  // 文字列はまとめてコピー(バイト境界ならmemcpy)
+  return ser.writeBytes(value.data(), len);
+}
+
+//
+// from -> to の差分
+//
+bool StringCodec::writeDiff(Serializer &ser, std::string_view from,
+                            std::string_view to, const StringDictionary *dict,
+                            bool allowSplice)
+{
+  if (from == to)
+  {
+    // 同じなので差分無し(BaseBit<Zero>のみ出力)
+    return ser.writeBits(BBZero, BaseBits);
+  }
+  uint32_t index;
+  if (!allowSplice || (dict != nullptr && dict->find(to, index)))
+  {
+    return write(ser, to, dict);
+  }
+
+  // 前後の一致部分を除いた差し替えの方が小さければそちらを使う
+  auto patch = splice(from, to);
+  if (!useSplice(patch, to.size()))
+  {
     // 違うのでそのまま出力
-    return other.serialize(ser);
+    return write(ser, to, dict);
   }
-  return false;
+  if (!ser.writeBits(BBOne, BaseBits) || !ser.writeBits(PatchSplice, 1))
+  {
+    return false;
+  }
+  if (!writeLength(ser, patch.prefix) || !writeLength(ser, patch.suffix) ||
+      !writeLength(ser, patch.mid))
+  {
+    return false;
+  }
+  return ser.writeBytes(to.data() + patch.prefix, patch.mid);
 }
+
 //
-bool ValueString::deserialize(Serializer &ser)
+// from -> to の前後の一致部分
+//
+StringCodec::Splice StringCodec::splice(std::string_view from,
+                                        std::string_view to)
+{
+  auto limit = std::min(from.size(), to.size());
+  size_t prefix = 0;
+  while (prefix < limit && from[prefix] == to[prefix])
+  {
+    prefix++;
+  }
+  size_t suffix = 0;
+  while (suffix < limit - prefix &&
+         from[from.size() - 1 - suffix] == to[to.size() - 1 - suffix])
+  {
+    suffix++;
+  }
+  return {prefix, suffix, to.size() - prefix - suffix};
+}
+
+//
+bool StringCodec::useSplice(const Splice &patch, size_t len)
 {
+  auto fullBits = lengthBits(len) + len * ByteBits;
+  auto spliceBits = 1 + lengthBits(patch.prefix) + lengthBits(patch.suffix) +
+                    lengthBits(patch.mid) + patch.mid * ByteBits;
+  return spliceBits < fullBits;
+}
+
+//
+size_t StringCodec::measure(std::string_view value,
+                            const StringDictionary *dict)
+{
+  uint32_t index;
+  if (dict != nullptr && dict->find(value, index))
+  {
+    return BaseBits + 1 + lengthBits(index);
+  }
+  return BaseBits + lengthBits(value.size()) + value.size() * ByteBits;
+}
+
+//
+size_t StringCodec::measureDiff(std::string_view from, std::string_view to,
+                                const StringDictionary *dict, bool allowSplice)
+{
+  if (from == to)
+  {
+    return BaseBits;
+  }
+  uint32_t index;
+  if (!allowSplice || (dict != nullptr && dict->find(to, index)))
+  {
+    return measure(to, dict);
+  }
+  auto patch = splice(from, to);
+  if (!useSplice(patch, to.size()))
+  {
+    return measure(to, dict);
+  }
+  return BaseBits + 1 + lengthBits(patch.prefix) + lengthBits(patch.suffix) +
+         lengthBits(patch.mid) + patch.mid * ByteBits;
+}
+
+//
+// 読み込み(diffなら変更なし/差し替えも受け付ける)
+// 格納先の容量が足りれば再確保しない
+//
+template <class Storage>
+bool StringCodec::readImpl(Serializer &ser, Storage &storage,
+                           const StringDictionary *dict, bool diff,
+                           bool &changed)
+{
+  changed = false;
   uint32_t base;
   if (!ser.readBits(base, BaseBits))
   {
     return false;
   }
-  if (base != BBOther)
+  if (base == BBZero && diff)
   {
-    // 型が違う
-    return false;
+    // 変更なし
+    return true;
+  }
+  if (base == BBOther)
+  {
+    size_t bytes;
+    if (!readLength(ser, bytes))
+    {
+      return false;
+    }
+    if (!ser.requireBytes(bytes) || !storage.resize(bytes))
+    {
+      // 途中で切れた/壊れたデータ(値はそのまま)
+      return false;
+    }
+    changed = true;
+    return ser.readBytes(storage.data(), bytes);
   }
-  size_t bytes;
-  if (!ser.readBits(bytes, SizeBits))
+  if (base != BBOne)
   {
+    // 型が違う
     return false;
   }
-  val_.clear();
-  if (bytes == 0)
+
+  uint32_t kind;
+  if (!ser.readBits(kind, 1))
   {
-    // 空なので終了
-    return true;
+    return false;
   }
-  for (size_t i = 0; i < bytes; i++)
+  if (kind == PatchDictionary)
   {
-    uint8_t value;
-    if (!ser.readByte(value))
+    size_t index;
+    if (!readLength(ser, index) || dict == nullptr)
+    {
+      return false;
+    }
+    const auto *word = dict->at(index);
+    if (word == nullptr || !storage.resize(word->size()))
     {
       return false;
     }
-    val_.push_back(value);
+    std::memcpy(storage.data(), word->data(), word->size());
+    changed = true;
+    return true;
+  }
+  if (!diff)
+  {
+    // 差し替えは差分の時だけ
+    return false;
   }
 
-  return true;
+  size_t prefix, suffix, mid;
+  if (!readLength(ser, prefix) || !readLength(ser, suffix) ||
+      !readLength(ser, mid))
+  {
+    return false;
+  }
+  auto oldLen = storage.size();
+  if (prefix + suffix > oldLen || !ser.requireBytes(mid))
+  {
+    // 元の文字列と合わない、または途中で切れている
+    return false;
+  }
+  // 後ろの一致部分を新しい位置へ寄せてから中央を読み込む
+  auto newLen = prefix + mid + suffix;
+  if (newLen > oldLen && !storage.resize(newLen))
+  {
+    return false;
+  }
+  std::memmove(storage.data() + prefix + mid,
+               storage.data() + oldLen - suffix, suffix);
+  if (newLen < oldLen)
+  {
+    storage.resize(newLen);
+  }
+  changed = true;
+  return ser.readBytes(storage.data() + prefix, mid);
 }
+
 //
-bool ValueString::deserializeDiff(Serializer &ser)
+// 読み飛ばし(readImplと同じ判定で、本体はskipBitsで飛ばす)
+//
+bool StringCodec::skip(Serializer &ser, bool diff)
 {
   uint32_t base;
   if (!ser.readBits(base, BaseBits))
   {
     return false;
   }
-  if (base == BBZero)
+  if (base == BBZero && diff)
+  {
+    return true;
+  }
+  size_t len;
+  if (base == BBOther)
+  {
+    return readLength(ser, len) && ser.requireBytes(len) &&
+           ser.skipBits(len * ByteBits);
+  }
+  uint32_t kind;
+  if (base != BBOne || !ser.readBits(kind, 1))
+  {
+    return false;
+  }
+  if (kind == PatchDictionary)
   {
-    // 変更なし
-    return true;
+    return readLength(ser, len);
   }
-  if (base != BBOther)
+  size_t prefix, suffix;
+  if (!diff || !readLength(ser, prefix) || !readLength(ser, suffix) ||
+      !readLength(ser, len))
   {
-    // 型が違う
     return false;
   }
+  return ser.requireBytes(len) && ser.skipBits(len * ByteBits);
+}
+
+//
+bool StringCodec::read(Serializer &ser, std::string &value,
+                       const StringDictionary *dict, bool diff, bool &changed)
+{
+  DynamicStorage storage{value};
+  return readImpl(ser, storage, dict, diff, changed);
+}
+//
+bool StringCodec::read(Serializer &ser, char *data, size_t &len,
+                       size_t capacity, const StringDictionary *dict,
+                       bool diff, bool &changed)
+{
+  FixedStorage storage{data, len, capacity};
+  return readImpl(ser, storage, dict, diff, changed);
+}
 
-  size_t bytes;
-  if (!ser.readBits(bytes, SizeBits))
+//
+bool ValueString::serialize(Serializer &ser) const
+{
+  return StringCodec::write(ser, val_, dict_);
+}
+//
+bool ValueString::serializeDiff(Serializer &ser,
+                                const ValueInterface &other) const
+{
+  if (const auto *oval = valueCast<ValueString>(other))
   {
-    return false;
+    return serializeDiff(ser, *oval);
   }
-  val_.clear();
-  if (bytes == 0)
+  return false;
+}
+//
+bool ValueString::serializeDiff(Serializer &ser, const ValueString &other) const
+{
+  return StringCodec::writeDiff(ser, val_, other.val_, dict_, splice_);
+}
+//
+bool ValueString::deserialize(Serializer &ser)
+{
+  bool changed;
+  auto result = StringCodec::read(ser, val_, dict_, false, changed);
+  if (changed)
   {
-    // 空なので終了
-    return true;
+    markDirty();
   }
-  for (size_t i = 0; i < bytes; i++)
+  return result;
+}
+//
+bool ValueString::deserializeDiff(Serializer &ser)
+{
+  bool changed;
+  auto result = StringCodec::read(ser, val_, dict_, true, changed);
+  if (changed)
   {
-    uint8_t value;
-    if (!ser.readByte(value))
-    {
-      return false;
-    }
-    val_.push_back(value);
+    markDirty();
   }
-
-  return true;
+  return result;
 }
 
 //
@@ -393,8 +1513,10 @@ bool writeNumberImpl(Serializer &ser, NumType num, size_t bits)
   if (num == 0)
   {
     // 0は特殊
+    ser.countNumber(0);
     return ser.writeBits(BBZero, ValueInterface::BaseBits);
   }
+  ser.countNumber(bits);
   if (!ser.writeBits(BBOther, ValueInterface::BaseBits))
   {
     return false;
@@ -406,6 +1528,9 @@ bool writeNumberImpl(Serializer &ser, NumType num, size_t bits)
   return ser.writeBits(num, bits);
 }
 // read
+// BaseBits/SizeBitsは窓(Serializerの現在ワード)から読むだけで、
+// ワード境界をまたぐことも少ないので分岐はほぼ当たる
+// (先読み + 表引きで1回にまとめる方式は、表の読み込み待ちが増えて遅かった)
 template <class NumType>
 bool readNumberImpl(Serializer &ser, NumType &num)
 {
@@ -439,14 +1564,6 @@ bool readNumberImpl(Serializer &ser, NumType &num)
   return ser.readBits(num, bits << 1ULL);
 }
 
-namespace
-{
-
-// array bits
-std::array<uint64_t, 8> arrayBitList = {2, 4, 8, 16, 24, 32, 48, 64};
-
-} // namespace
-
 // read array
 template <class NumType>
 bool readArrayNumber(Serializer &ser, NumType &num)
@@ -457,7 +1574,7 @@ bool readArrayNumber(Serializer &ser, NumType &num)
     return false;
   }
 
-  return ser.readBits(num, arrayBitList[type]);
+  return ser.readBits(num, ValueNumber::ArrayBitList[type]);
 }
 
 } // namespace
@@ -465,20 +1582,16 @@ bool readArrayNumber(Serializer &ser, NumType &num)
 //
 bool ValueNumber::writeNumber(Serializer &ser, UIntType num, size_t bits)
 {
-  auto halfBit = bits >> 1ULL;
-  if (num < (1ULL << halfBit))
-  {
-    // 値が小さいならより少ないビット数にする
-    auto quarterBit = halfBit >> 1ULL;
-    bits = num < (1ULL << quarterBit) ? quarterBit : halfBit;
-  }
-  return writeNumberImpl(ser, num, bits);
+  // 値が小さいならより少ないビット数にする
+  return writeNumberImpl(ser, num, numberWidth(num, bits));
 }
 
 //
-bool ValueNumber::writeNumber(Serializer &ser, IntType num, size_t bits)
+bool ValueNumber::writeNumber(Serializer &ser, IntType num, size_t)
 {
-  return writeNumberImpl(ser, num, bits);
+  // ジグザグ符号化した値を必要なビット数(2bit単位)で書く
+  // (型の幅は使わない: 差分は型の幅+1bitになることがある)
+  return writeNumberImpl(ser, zigZag(num), numberWidth(num));
 }
 
 //
@@ -490,7 +1603,13 @@ bool ValueNumber::readNumber(Serializer &ser, UIntType &num)
 //
 bool ValueNumber::readNumber(Serializer &ser, IntType &num)
 {
-  return readNumberImpl(ser, num);
+  UIntType code;
+  if (!readNumberImpl(ser, code))
+  {
+    return false;
+  }
+  num = unZigZag(code);
+  return true;
 }
 
 // 配列の先頭情報書き込み
@@ -530,56 +1649,268 @@ bool ValueNumber::readArrayHeader(Serializer &ser, size_t &num)
   return ser.readBits(num, ByteBits);
 }
 
-//
-bool ValueNumber::writeArrayValue(Serializer &ser, UIntType num)
+// Packed配列の先頭情報書き込み
+bool ValueNumber::writePackedHeader(Serializer &ser, size_t num)
+{
+  if (!ser.writeBits(BBOther, ValueInterface::BaseBits))
+  {
+    return false;
+  }
+  if (!ser.writeBits(PackedArrayTag, ValueInterface::SizeBits))
+  {
+    return false;
+  }
+  return ser.writeBits(num, ByteBits);
+}
+
+// Packed配列の先頭情報読み込み
+bool ValueNumber::readPackedHeader(Serializer &ser, size_t &num)
+{
+  uint64_t base;
+  if (!ser.readBits(base, ValueInterface::BaseBits) || base != BBOther)
+  {
+    return false;
+  }
+  if (!ser.readBits(base, ValueInterface::SizeBits) || base != PackedArrayTag)
+  {
+    return false;
+  }
+  return ser.readBits(num, ByteBits);
+}
+
+// Packed配列のブロック書き込み(最大オフセットのビット幅で全要素を詰める)
+bool ValueNumber::writePackedBlock(Serializer &ser, const UIntType *offsets,
+                                   size_t num)
 {
-  for (uint64_t idx = 0; idx < arrayBitList.size() - 1; idx++)
+  UIntType range = 0;
+  for (size_t i = 0; i < num; i++)
+  {
+    range |= offsets[i];
+  }
+  size_t width = std::bit_width(range);
+  if (!ser.writeBits64(width, PackWidthBits))
   {
-    auto bits = arrayBitList[idx];
-    if (num < (1ULL << bits))
+    return false;
+  }
+  for (size_t i = 0; i < num; i++)
+  {
+    if (!ser.writeBits64(offsets[i], width))
     {
-      if (!ser.writeBits(idx, ValueInterface::ArraySizeBits))
-      {
-        // failed
-        return false;
-      }
-      // success
-      return ser.writeBits(num, bits);
+      return false;
+    }
+  }
+  return true;
+}
+
+// Packed配列のブロック読み込み(要素ごとの分岐なし)
+bool ValueNumber::readPackedBlock(Serializer &ser, UIntType *offsets,
+                                  size_t num)
+{
+  uint64_t width;
+  if (!ser.readBits64(width, PackWidthBits) || width > 64)
+  {
+    return false;
+  }
+  for (size_t i = 0; i < num; i++)
+  {
+    if (!ser.readBits64(offsets[i], width))
+    {
+      return false;
     }
   }
-  // 64bits
-  if (ser.writeBits(7, ValueInterface::ArraySizeBits))
+  return true;
+}
+
+// 変化なしの配列(全要素差分0)書き込み
+bool ValueNumber::writeUnchangedArray(Serializer &ser, size_t num)
+{
+  if (!writeArrayHeader(ser, num))
   {
-    return ser.writeBits(num, 64);
+    return false;
   }
-  return false;
+  // 差分0の要素はサイズ種別0 + 0(ArrayBitList[0]bit)
+  ser.countArrayType(0, num);
+  const size_t elemBits = ValueInterface::ArraySizeBits + ArrayBitList[0];
+  const size_t chunk = 64 / elemBits;
+  for (; num > 0; num -= std::min(num, chunk))
+  {
+    if (!ser.writeBits64(0, std::min(num, chunk) * elemBits))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+// RunLength差分: 要素スキップ(0 + RunBits)
+bool ValueNumber::writeElementRun(Serializer &ser, size_t run)
+{
+  while (run > 0)
+  {
+    auto n = run < MaxRun ? run : MaxRun;
+    if (!ser.writeBits64((n - 1) << 1ULL, 1 + RunBits))
+    {
+      return false;
+    }
+    run -= n;
+  }
+  return true;
+}
+
+// RunLength差分: 変化あり要素(1)
+bool ValueNumber::writeElementMark(Serializer &ser)
+{
+  return ser.writeBits64(1, 1);
+}
+
+// RunLength差分: 0なら変化あり要素が続く
+bool ValueNumber::readElementRun(Serializer &ser, size_t &run)
+{
+  uint64_t mark;
+  if (!ser.readBits64(mark, 1))
+  {
+    return false;
+  }
+  if (mark == 1)
+  {
+    run = 0;
+    return true;
+  }
+  uint64_t num;
+  if (!ser.readBits64(num, RunBits))
+  {
+    return false;
+  }
+  run = num + 1;
+  return true;
+}
+
+//
+bool ValueNumber::writeArrayValue(Serializer &ser, UIntType num)
+{
+  return writeArrayValue(ser, num, arrayValueType(num));
 }
 
 //
 bool ValueNumber::writeArrayValue(Serializer &ser, IntType num)
 {
-  auto anum = std::abs(num);
+  return writeArrayValue(ser, num, arrayValueType(num));
+}
+
+//
+bool ValueNumber::writeArrayValue(Serializer &ser, UIntType num, uint8_t type)
+{
+  ser.countArrayType(type);
+  size_t bits = ArrayBitList[type];
+  if (ArraySizeBits + bits <= 64)
+  {
+    // サイズ種別と値をまとめて書く
+    return ser.writeBits64(type | (num << ArraySizeBits),
+                           ArraySizeBits + bits);
+  }
+  if (!ser.writeBits64(type, ArraySizeBits))
+  {
+    return false;
+  }
+  return ser.writeBits64(num, bits);
+}
+
+//
+bool ValueNumber::writeArrayValue(Serializer &ser, IntType num, uint8_t type)
+{
+  return writeArrayValue(ser, zigZag(num), type);
+}
+
+//
+bool ValueNumber::skipNumber(Serializer &ser)
+{
+  uint64_t base;
+  if (!ser.readBits(base, BaseBits))
+  {
+    return false;
+  }
+  if (base == BBZero)
+  {
+    return true;
+  }
+  uint64_t bits;
+  if (base != BBOther || !ser.readBits(bits, SizeBits) || bits == 0 ||
+      bits == PackedArrayTag)
+  {
+    // 数値ではない
+    return false;
+  }
+  return ser.skipBits(bits << 1ULL);
+}
+
+//
+bool ValueNumber::skipXorDiff(Serializer &ser)
+{
+  uint64_t base;
+  if (!ser.readBits64(base, BaseBits))
+  {
+    return false;
+  }
+  if (base == BBZero)
+  {
+    return true;
+  }
+  uint64_t head;
+  if (base != BBOther || !ser.readBits64(head, XorShiftBits * 2))
+  {
+    return false;
+  }
+  auto trailing = head & ((1ULL << XorShiftBits) - 1);
+  auto width = (head >> XorShiftBits) + 1;
+  return trailing + width <= 64 && ser.skipBits(width - 1);
+}
+
+//
+bool ValueNumber::skipArrayValue(Serializer &ser)
+{
+  uint64_t type;
+  return ser.readBits(type, ArraySizeBits) &&
+         ser.skipBits(ArrayBitList[type]);
+}
 
-  for (uint64_t idx = 0; idx < arrayBitList.size() - 1; idx++)
+//
+bool ValueNumber::skipTaggedArray(Serializer &ser)
+{
+  size_t num;
+  if (!readArrayHeader(ser, num))
+  {
+    return false;
+  }
+  for (size_t i = 0; i < num; i++)
   {
-    auto bits = arrayBitList[idx];
-    if (anum < (1ULL << (bits - 1)))
+    if (!skipArrayValue(ser))
     {
-      if (!ser.writeBits(idx, ValueInterface::ArraySizeBits))
-      {
-        // failed
-        return false;
-      }
-      // success
-      return ser.writeBits(num, bits);
+      return false;
     }
   }
-  // 64bits
-  if (ser.writeBits(7, ValueInterface::ArraySizeBits))
+  return true;
+}
+
+//
+bool ValueNumber::skipPackedArray(Serializer &ser)
+{
+  size_t num;
+  if (!readPackedHeader(ser, num))
+  {
+    return false;
+  }
+  for (size_t top = 0; top < num; top += PackBlock)
   {
-    return ser.writeBits(num, 64);
+    // 基準値 + 共通ビット幅 x 要素数
+    auto count = std::min(PackBlock, num - top);
+    uint64_t width;
+    if (!skipArrayValue(ser) || !ser.readBits64(width, PackWidthBits) ||
+        width > 64 || !ser.skipBits(width * count))
+    {
+      return false;
+    }
   }
-  return false;
+  return true;
 }
 
 //
@@ -591,7 +1922,68 @@ bool ValueNumber::readArrayValue(Serializer &ser, UIntType &num)
 //
 bool ValueNumber::readArrayValue(Serializer &ser, IntType &num)
 {
-  return readArrayNumber(ser, num);
+  UIntType code;
+  if (!readArrayNumber(ser, code))
+  {
+    return false;
+  }
+  num = unZigZag(code);
+  return true;
+}
+
+//
+bool ValueNumber::writeXorDiff(Serializer &ser, UIntType diff)
+{
+  if (diff == 0)
+  {
+    return ser.writeBits(BBZero, ValueInterface::BaseBits);
+  }
+  size_t trailing = std::countr_zero(diff);
+  auto body = diff >> trailing;
+  size_t width = std::bit_width(body);
+  // 識別 + 末尾の0の数 + 有効ビット数 をまとめて書く
+  UIntType head = BBOther | trailing << ValueInterface::BaseBits |
+                  (width - 1) << (ValueInterface::BaseBits + XorShiftBits);
+  if (!ser.writeBits64(head, ValueInterface::BaseBits + XorShiftBits * 2))
+  {
+    return false;
+  }
+  // 有効ビットの先頭は必ず1なので書かない
+  return width == 1 || ser.writeBits64(body, width - 1);
+}
+
+//
+bool ValueNumber::readXorDiff(Serializer &ser, UIntType &diff)
+{
+  uint64_t base;
+  if (!ser.readBits64(base, ValueInterface::BaseBits))
+  {
+    return false;
+  }
+  if (base == BBZero)
+  {
+    diff = 0;
+    return true;
+  }
+  uint64_t head;
+  if (base != BBOther || !ser.readBits64(head, XorShiftBits * 2))
+  {
+    return false;
+  }
+  auto mask = (1ULL << XorShiftBits) - 1;
+  auto trailing = head & mask;
+  auto width = (head >> XorShiftBits) + 1;
+  if (trailing + width > 64)
+  {
+    return false;
+  }
+  uint64_t body = 0;
+  if (width > 1 && !ser.readBits64(body, width - 1))
+  {
+    return false;
+  }
+  diff = (body | 1ULL << (width - 1)) << trailing;
+  return true;
 }
 
 } // namespace record
@@ -0,0 +1,437 @@
+//
+// copyright 2025 y.suzuki(wave.suzuki.z@gmail.com)
+//
+#include "record_compress.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+
+namespace record
+{
+
+namespace
+{
+
+//
+// LZ4ブロック形式
+// シーケンス: トークン(リテラル長4bit + 一致長-4の4bit) + [リテラル長の続き] +
+//             リテラル + オフセット(16bit) + [一致長の続き]
+// 最後のシーケンスはリテラルのみ、末尾5バイトは必ずリテラル
+//
+constexpr size_t MinMatch = 4;
+constexpr size_t LastLiterals = 5;
+constexpr size_t MatchFindLimit = 12;
+constexpr size_t MaxOffset = 65535;
+constexpr size_t HashLog = 12;
+constexpr size_t RunMask = 15;
+
+uint32_t load32(const uint8_t *ptr)
+{
+  uint32_t value;
+  std::memcpy(&value, ptr, sizeof(value));
+  return value;
+}
+
+uint32_t hashOf(uint32_t sequence)
+{
+  return (sequence * 2654435761U) >> (32 - HashLog);
+}
+
+// 長さの続き(255の並び + 残り)
+uint8_t *writeLength(uint8_t *op, size_t len)
+{
+  for (; len >= 255; len -= 255)
+  {
+    *op++ = 255;
+  }
+  *op++ = static_cast<uint8_t>(len);
+  return op;
+}
+
+bool readLength(const uint8_t *src, size_t srcBytes, size_t &ip, size_t &len)
+{
+  uint8_t byte;
+  do
+  {
+    if (ip >= srcBytes)
+    {
+      return false;
+    }
+    byte = src[ip++];
+    len += byte;
+  } while (byte == 255);
+  return true;
+}
+
+// シーケンスの最大バイト数
+size_t sequenceBound(size_t literals, size_t match)
+{
+  return 1 + literals / 255 + 1 + literals + 2 + match / 255 + 1;
+}
+
+// ヘッダーの読み書き(リトルエンディアン)
+void put32(uint8_t *ptr, uint32_t value)
+{
+  for (size_t i = 0; i < 4; i++)
+  {
+    ptr[i] = static_cast<uint8_t>(value >> (i * 8));
+  }
+}
+
+uint32_t get32(const uint8_t *ptr)
+{
+  uint32_t value = 0;
+  for (size_t i = 0; i < 4; i++)
+  {
+    value |= uint32_t(ptr[i]) << (i * 8);
+  }
+  return value;
+}
+
+uint64_t elapsedNs(std::chrono::steady_clock::time_point start)
+{
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+}
+
+} // namespace
+
+//
+size_t Lz4BlockCodec::bound(size_t srcBytes) const
+{
+  return srcBytes + srcBytes / 255 + 16;
+}
+
+//
+// 貪欲な一致探索(直近の4バイト一致をハッシュ表で探す)
+//
+size_t Lz4BlockCodec::compress(const uint8_t *src, size_t srcBytes,
+                               uint8_t *dst, size_t capacity) const
+{
+  auto *op = dst;
+  auto *end = dst + capacity;
+  size_t anchor = 0;
+  auto emit = [&](size_t literals, size_t offset, size_t match)
+  {
+    if (sequenceBound(literals, match) > size_t(end - op))
+    {
+      return false;
+    }
+    auto *token = op++;
+    *token = static_cast<uint8_t>(std::min(literals, RunMask) << 4);
+    if (literals >= RunMask)
+    {
+      op = writeLength(op, literals - RunMask);
+    }
+    std::memcpy(op, src + anchor, literals);
+    op += literals;
+    if (match == 0)
+    {
+      // 最後のシーケンス
+      return true;
+    }
+    *op++ = static_cast<uint8_t>(offset);
+    *op++ = static_cast<uint8_t>(offset >> 8);
+    match -= MinMatch;
+    *token |= static_cast<uint8_t>(std::min(match, RunMask));
+    if (match >= RunMask)
+    {
+      op = writeLength(op, match - RunMask);
+    }
+    return true;
+  };
+
+  if (srcBytes > MatchFindLimit)
+  {
+    std::array<uint32_t, 1U << HashLog> table{}; // 位置+1(0は未登録)
+    auto limit = srcBytes - MatchFindLimit;
+    auto matchEnd = srcBytes - LastLiterals;
+    size_t ip = 0;
+    while (ip < limit)
+    {
+      auto sequence = load32(src + ip);
+      auto &slot = table[hashOf(sequence)];
+      size_t ref = slot;
+      slot = static_cast<uint32_t>(ip + 1);
+      if (ref == 0 || ip + 1 - ref > MaxOffset ||
+          load32(src + ref - 1) != sequence)
+      {
+        // 一致しない区間が続くほど大きく進める
+        ip += 1 + ((ip - anchor) >> 6);
+        continue;
+      }
+      ref--;
+      auto len = MinMatch;
+      while (ip + len < matchEnd && src[ref + len] == src[ip + len])
+      {
+        len++;
+      }
+      while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1])
+      {
+        ip--;
+        ref--;
+        len++;
+      }
+      if (!emit(ip - anchor, ip - ref, len))
+      {
+        return 0;
+      }
+      ip += len;
+      anchor = ip;
+    }
+  }
+  if (!emit(srcBytes - anchor, 0, 0))
+  {
+    return 0;
+  }
+  return op - dst;
+}
+
+//
+bool Lz4BlockCodec::decompress(const uint8_t *src, size_t srcBytes,
+                               uint8_t *dst, size_t rawBytes) const
+{
+  size_t ip = 0;
+  size_t op = 0;
+  while (ip < srcBytes)
+  {
+    auto token = src[ip++];
+    size_t literals = token >> 4;
+    if (literals == RunMask && !readLength(src, srcBytes, ip, literals))
+    {
+      return false;
+    }
+    if (literals > srcBytes - ip || literals > rawBytes - op)
+    {
+      return false;
+    }
+    std::memcpy(dst + op, src + ip, literals);
+    ip += literals;
+    op += literals;
+    if (ip == srcBytes)
+    {
+      // 最後のシーケンス
+      return op == rawBytes;
+    }
+
+    if (srcBytes - ip < 2)
+    {
+      return false;
+    }
+    size_t offset = src[ip] | size_t(src[ip + 1]) << 8;
+    ip += 2;
+    size_t match = token & RunMask;
+    if (match == RunMask && !readLength(src, srcBytes, ip, match))
+    {
+      return false;
+    }
+    match += MinMatch;
+    if (offset == 0 || offset > op || match > rawBytes - op)
+    {
+      return false;
+    }
+    const auto *ref = dst + op - offset;
+    if (offset >= match)
+    {
+      std::memcpy(dst + op, ref, match);
+    }
+    else
+    {
+      // 重なっているので1バイトずつ(繰り返しになる)
+      for (size_t i = 0; i < match; i++)
+      {
+        dst[op + i] = ref[i];
+      }
+    }
+    op += match;
+  }
+  return false;
+}
+
+//
+const Lz4BlockCodec &Lz4BlockCodec::instance()
+{
+  static const Lz4BlockCodec codec;
+  return codec;
+}
+
+//
+// 圧縮側
+//
+CompressWriter::CompressWriter(BlockSink sink, bool enabled,
+                               size_t blockBytes, const BlockCodec &codec)
+    : sink_(std::move(sink)), codec_(codec),
+      blockBytes_(std::max<size_t>(blockBytes, 1)), enabled_(enabled)
+{
+  block_.reserve(blockBytes_);
+  auto capacity = std::max(codec_.bound(blockBytes_), blockBytes_);
+  packed_.resize(HeaderBytes + capacity);
+}
+
+//
+bool CompressWriter::write(const void *data, size_t bytes)
+{
+  const auto *ptr = static_cast<const uint8_t *>(data);
+  while (bytes > 0)
+  {
+    auto take = std::min(bytes, blockBytes_ - block_.size());
+    block_.insert(block_.end(), ptr, ptr + take);
+    ptr += take;
+    bytes -= take;
+    if (block_.size() == blockBytes_ && !flushBlock())
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+//
+bool CompressWriter::finish() { return flushBlock(); }
+
+//
+bool CompressWriter::flushBlock()
+{
+  if (block_.empty())
+  {
+    return true;
+  }
+  auto start = std::chrono::steady_clock::now();
+  auto rawBytes = block_.size();
+  auto *body = packed_.data() + HeaderBytes;
+  size_t packedBytes = 0;
+  if (enabled_)
+  {
+    packedBytes = codec_.compress(block_.data(), rawBytes, body,
+                                  packed_.size() - HeaderBytes);
+  }
+  if (packedBytes == 0 || packedBytes >= rawBytes)
+  {
+    // 縮まないので無圧縮で格納
+    std::memcpy(body, block_.data(), rawBytes);
+    packedBytes = rawBytes;
+    stats_.storedBlocks++;
+  }
+  put32(packed_.data(), static_cast<uint32_t>(rawBytes));
+  put32(packed_.data() + 4, static_cast<uint32_t>(packedBytes));
+  stats_.nanoseconds += elapsedNs(start);
+  stats_.rawBytes += rawBytes;
+  stats_.packedBytes += HeaderBytes + packedBytes;
+  stats_.blocks++;
+  block_.clear();
+  return sink_(packed_.data(), HeaderBytes + packedBytes);
+}
+
+//
+// 復元側
+//
+CompressReader::CompressReader(BlockSink sink, size_t maxBlockBytes,
+                               const BlockCodec &codec)
+    : sink_(std::move(sink)), codec_(codec), maxBlockBytes_(maxBlockBytes)
+{
+}
+
+//
+bool CompressReader::feed(const void *data, size_t bytes)
+{
+  constexpr auto HeaderBytes = CompressWriter::HeaderBytes;
+  const auto *ptr = static_cast<const uint8_t *>(data);
+
+  // ヘッダーを確認してブロック全体のバイト数を返す(壊れていれば0)
+  auto blockSize = [&](const uint8_t *header)
+  {
+    auto rawBytes = get32(header);
+    auto packedBytes = get32(header + 4);
+    if (rawBytes == 0 || rawBytes > maxBlockBytes_ || packedBytes == 0 ||
+        packedBytes > rawBytes)
+    {
+      return size_t(0);
+    }
+    return HeaderBytes + packedBytes;
+  };
+  // そろったブロックを復元してsinkへ
+  auto process = [&](const uint8_t *block)
+  {
+    auto rawBytes = get32(block);
+    auto packedBytes = get32(block + 4);
+    if (packedBytes == rawBytes)
+    {
+      stats_.rawBytes += rawBytes;
+      stats_.packedBytes += HeaderBytes + packedBytes;
+      stats_.blocks++;
+      stats_.storedBlocks++;
+      return sink_(block + HeaderBytes, rawBytes);
+    }
+    auto start = std::chrono::steady_clock::now();
+    raw_.resize(maxBlockBytes_);
+    if (!codec_.decompress(block + HeaderBytes, packedBytes, raw_.data(),
+                           rawBytes))
+    {
+      return false;
+    }
+    stats_.nanoseconds += elapsedNs(start);
+    stats_.rawBytes += rawBytes;
+    stats_.packedBytes += HeaderBytes + packedBytes;
+    stats_.blocks++;
+    return sink_(raw_.data(), rawBytes);
+  };
+
+  // 前回の途中のブロックを完成させる
+  if (!pending_.empty())
+  {
+    auto need = HeaderBytes;
+    while (true)
+    {
+      if (pending_.size() >= HeaderBytes)
+      {
+        need = blockSize(pending_.data());
+        if (need == 0)
+        {
+          return false;
+        }
+      }
+      auto take = std::min(bytes, need - pending_.size());
+      pending_.insert(pending_.end(), ptr, ptr + take);
+      ptr += take;
+      bytes -= take;
+      if (pending_.size() < need && bytes == 0)
+      {
+        return true;
+      }
+      if (pending_.size() == need && need > HeaderBytes)
+      {
+        break;
+      }
+    }
+    if (!process(pending_.data()))
+    {
+      return false;
+    }
+    pending_.clear();
+  }
+
+  // 入力の中でそろっているブロックはコピーせずに復元する
+  while (bytes >= HeaderBytes)
+  {
+    auto need = blockSize(ptr);
+    if (need == 0)
+    {
+      return false;
+    }
+    if (bytes < need)
+    {
+      break;
+    }
+    if (!process(ptr))
+    {
+      return false;
+    }
+    ptr += need;
+    bytes -= need;
+  }
+  pending_.assign(ptr, ptr + bytes);
+  return true;
+}
+
+} // namespace record
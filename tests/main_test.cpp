@@ -1,11 +1,30 @@
 #include "record.h"
+#include "record_archive.h"
+#include "record_baseline.h"
+#include "record_compress.h"
 #include "record_bits.h"
+#include "record_packet.h"
+#include "record_parallel.h"
+#include "record_pool.h"
+#include "record_schema.h"
+#include "record_snapshot.h"
+#include "record_stream.h"
 #include "serialize.h"
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
+#include <cmath>
 #include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <memory>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <vector>
 
 namespace
 {
@@ -40,6 +59,10 @@ struct Test
   {
     return valLink.serializeDiffAndCopy(ser, other.valLink);
   }
+  size_t measureDiffBits(const Test &other) const
+  {
+    return valLink.measureDiffBits(other.valLink);
+  }
   bool equal(const Test &other) const { return valLink.equal(other.valLink); }
   bool deserialize(record::Serializer &ser) { return valLink.deserialize(ser); }
   bool deserializeDiff(record::Serializer &ser)
@@ -54,6 +77,36 @@ struct TestVer2 : public Test
   vuint32_t number_{100, valLink};
 };
 
+// ValueLinkと別に確保したフィールドを持つレコード
+struct HeapField
+{
+  record::ValueLink valLink;
+  record::Value<uint32_t> near_{7, valLink};
+  std::unique_ptr<record::Value<int32_t>> far_ =
+      std::make_unique<record::Value<int32_t>>(-5, valLink);
+
+  // far_の相対位置がint32に収まらない(変更通知が届かない)か
+  [[nodiscard]] bool distant() const
+  {
+    auto offset = reinterpret_cast<intptr_t>(far_.get()) -
+                  reinterpret_cast<intptr_t>(&valLink);
+    return offset < INT32_MIN || offset > INT32_MAX;
+  }
+};
+
+using TestSchema =
+    record::Schema<&Test::enabled_, &Test::count_, &Test::name_, &Test::age_,
+                   &Test::points_, &Test::bits_, &Test::code_>;
+using TestVer2Schema =
+    record::Schema<&Test::enabled_, &Test::count_, &Test::name_, &Test::age_,
+                   &Test::points_, &Test::bits_, &Test::code_,
+                   &TestVer2::ver_1, &TestVer2::number_>;
+
+bool sameStream(const record::Serializer &a, const record::Serializer &b)
+{
+  return a.tell() == b.tell() && std::memcmp(a.data(), b.data(), a.size()) == 0;
+}
+
 struct Bit1
 {
   uint64_t enable_ : 1;
@@ -90,6 +143,156 @@ void test_bool_io()
   assert(b3);
 }
 
+void test_bit_stream_words()
+{
+  // ワード境界をまたぐ書き込みと読み込み
+  record::Serializer ser{64};
+  for (uint64_t i = 0; i < 20; ++i)
+  {
+    assert(ser.writeBits64(i * 0x9e3779b97f4a7c15ULL, 13 + i));
+  }
+  const auto endPos = ser.tell();
+  ser.reset();
+  for (uint64_t i = 0; i < 20; ++i)
+  {
+    uint64_t value = 0;
+    assert(ser.readBits64(value, 13 + i));
+    assert(value == ((i * 0x9e3779b97f4a7c15ULL) & ((1ULL << (13 + i)) - 1)));
+  }
+  assert(ser.tell() == endPos);
+
+  // 途中への上書きは前後のビットを壊さない
+  uint64_t before = 0;
+  ser.seek(60);
+  uint64_t value = 0;
+  assert(ser.readBits64(before, 40));
+  ser.seek(70);
+  assert(ser.writeBits64(0, 4));
+  ser.seek(60);
+  assert(ser.readBits64(value, 40));
+  assert(value == (before & ~(0xfULL << 10)));
+
+  // 読み込み直後の書き込み/巻き戻し
+  ser.reset();
+  assert(ser.writeBits64(0x5, 3));
+  assert(ser.readBits64(value, 5));
+  auto pos = ser.tell();
+  assert(ser.writeBits64(0x1f, 5));
+  ser.seek(pos);
+  assert(ser.readBits64(value, 5));
+  assert(value == 0x1f);
+  ser.reset();
+  assert(ser.readBits64(value, 3));
+  assert(value == 0x5);
+
+  // 容量ちょうどまで
+  record::Serializer full{8};
+  assert(full.writeBits64(~0ULL, 64));
+  assert(!full.writeBits64(1, 1));
+  full.reset();
+  assert(full.readBits64(value, 64));
+  assert(value == ~0ULL);
+  assert(!full.readBits64(value, 1));
+}
+
+void test_append_streams()
+{
+  // 連結元: ワードをまたぐ長さのビット列
+  record::Serializer src{64};
+  for (uint64_t i = 0; i < 9; ++i)
+  {
+    assert(src.writeBits64(i * 0x9e3779b97f4a7c15ULL, 7 + i * 5));
+  }
+  const auto srcBits = src.tell();
+
+  for (size_t head : {0, 5, 63, 64, 100})
+  {
+    record::Serializer ser{64};
+    record::Serializer ref{64};
+    assert(ser.writeBits64(0x2b, std::min<size_t>(head, 6)));
+    assert(ref.writeBits64(0x2b, std::min<size_t>(head, 6)));
+    ser.seek(head);
+    ref.seek(head);
+    assert(ser.append(src));
+    for (uint64_t i = 0; i < 9; ++i)
+    {
+      assert(ref.writeBits64(i * 0x9e3779b97f4a7c15ULL, 7 + i * 5));
+    }
+    assert(ser.tell() == head + srcBits);
+    // 連結後も続けて書ける
+    assert(ser.writeBits64(0x3, 2));
+    assert(ref.writeBits64(0x3, 2));
+    assert(sameStream(ser, ref));
+  }
+
+  // 途中までのビット数指定
+  record::Serializer part{64};
+  assert(part.writeBits64(1, 3));
+  assert(part.appendBits(src.data(), 70));
+  part.seek(3);
+  uint64_t value = 0;
+  assert(part.readBits64(value, 64));
+  record::Serializer srcRead = src;
+  srcRead.reset();
+  uint64_t expect = 0;
+  assert(srcRead.readBits64(expect, 64));
+  assert(value == expect);
+
+  // 固定容量を超える連結は失敗し、位置は変わらない
+  record::Serializer small{8};
+  assert(small.writeBits64(1, 1));
+  assert(!small.append(src));
+  assert(small.tell() == 1);
+  record::Serializer grow{8, record::Serializer::Policy::AutoGrow};
+  assert(grow.writeBits64(1, 1));
+  assert(grow.append(src));
+  assert(grow.tell() == 1 + srcBits);
+}
+
+void test_external_and_growable_buffer()
+{
+  TestVer2 src;
+  src.name_ = "External";
+  src.points_.set(0, 0xffffff);
+
+  // 呼び出し側のメモリへ直接書き込む
+  std::array<uint64_t, 64> storage{};
+  record::Serializer ext{storage.data(), sizeof(storage)};
+  assert(!ext.isOwned());
+  assert(ext.capacity() == sizeof(storage));
+  assert(src.serialize(ext));
+  const auto out = ext.bytes();
+  assert(out.data() == reinterpret_cast<const std::byte *>(storage.data()));
+  assert(out.size() == ext.size());
+
+  TestVer2 dst;
+  record::Serializer view{std::span<uint64_t>{storage}};
+  assert(dst.deserialize(view));
+  assert(dst.name_() == "External");
+  assert(dst.points_.get(0) == 0xffffff);
+
+  // 容量不足の固定バッファは失敗する
+  record::Serializer tiny{4};
+  assert(!src.serialize(tiny));
+  assert(tiny.tell() == 0);
+
+  // 自動拡張なら成功して中身も同じ
+  record::Serializer grow{4, record::Serializer::Policy::AutoGrow};
+  assert(src.serialize(grow));
+  assert(grow.capacity() >= grow.size());
+  assert(sameStream(ext, grow));
+
+  // コピー/ムーブ後も独立したバッファとして使える
+  record::Serializer copied{grow};
+  record::Serializer moved{std::move(grow)};
+  assert(sameStream(copied, moved));
+  copied.reset();
+  moved.reset();
+  TestVer2 fromCopy;
+  assert(fromCopy.deserialize(copied));
+  assert(fromCopy.name_() == "External");
+}
+
 void test_cross_version_serialize_deserialize()
 {
   Test test;
@@ -223,14 +426,2474 @@ void test_bitfield_size_migration()
   assert(bittest1[9].count_ == 109);
 }
 
+void test_bulk_array_and_bitfield()
+{
+  // 配列: まとめて分類した書き込みが要素ごとの(種別,値)と同じビット列になる
+  struct Wide
+  {
+    record::ValueLink valLink;
+    record::ValueArray<uint64_t, 6> unum_{0, valLink};
+    record::ValueArray<int64_t, 6> snum_{0, valLink};
+  };
+  const std::array<uint64_t, 6> uvals = {0,       3,       255,
+                                         1 << 20, 1ULL << 40, ~0ULL};
+  const std::array<int64_t, 6> svals = {
+      -1, 1, -(1LL << 20), 1LL << 30, -(1LL << 40), (1LL << 62) + 5};
+  Wide wide;
+  for (size_t i = 0; i < uvals.size(); i++)
+  {
+    wide.unum_.set(i, uvals[i]);
+    wide.snum_.set(i, svals[i]);
+  }
+  record::Serializer ser{4096};
+  record::Serializer ref{4096};
+  assert(wide.unum_.serialize(ser));
+  const std::array<size_t, 6> ubits = {2, 2, 8, 24, 48, 64};
+  const std::array<uint64_t, 6> utype = {0, 0, 2, 4, 6, 7};
+  ref.writeBits64(3, 2);
+  ref.writeBits64(0, 6);
+  ref.writeBits64(uvals.size(), 8);
+  for (size_t i = 0; i < uvals.size(); i++)
+  {
+    ref.writeBits64(utype[i], 3);
+    ref.writeBits64(uvals[i], ubits[i]);
+  }
+  assert(sameStream(ser, ref));
+
+  // 48/64bit幅の負数も往復できる
+  ser.reset();
+  assert(wide.valLink.serialize(ser));
+  Wide wcopy;
+  ser.reset();
+  assert(wcopy.valLink.deserialize(ser));
+  for (size_t i = 0; i < svals.size(); i++)
+  {
+    assert(wcopy.unum_.at(i) == uvals[i]);
+    assert(wcopy.snum_.at(i) == svals[i]);
+  }
+
+  // ビットフィールド: バイト境界でない位置でも一括コピーと同じ結果
+  std::array<Bit1, 5> bits{};
+  for (size_t i = 0; i < bits.size(); i++)
+  {
+    bits[i].count_ = 1000 + i;
+    bits[i].day_ = i + 3;
+  }
+  for (size_t head : {0, 3, 8})
+  {
+    ser.reset();
+    ref.reset();
+    ser.writeBits64(5, head);
+    ref.writeBits64(5, head);
+    assert(record::serializeBitField(ser, bits.data(), bits.size()));
+    ref.writeBits64(sizeof(Bit1) / 4 - 1, 3);
+    ref.writeBits64(bits.size(), 13);
+    for (auto &bit : bits)
+    {
+      uint64_t word;
+      std::memcpy(&word, &bit, sizeof(word));
+      ref.writeBits64(word, 64);
+    }
+    assert(sameStream(ser, ref));
+
+    std::array<Bit1, 5> rbits{};
+    size_t rnum = rbits.size();
+    ser.seek(head);
+    assert(record::deserializeBitField(ser, rbits.data(), rnum));
+    assert(rnum == bits.size());
+    assert(ser.tell() == ref.tell());
+    assert(std::memcmp(rbits.data(), bits.data(), sizeof(bits)) == 0);
+  }
+}
+
+void test_packed_array()
+{
+  constexpr auto Packed = record::ArrayFormat::Packed;
+  struct Dense
+  {
+    record::ValueLink valLink;
+    record::ValueArray<uint32_t, 40> tagged_{0, valLink};
+    record::ValueArray<uint32_t, 40, Packed> packed_{0, valLink};
+    record::ValueArray<int16_t, 20, Packed> signed_{0, valLink};
+  };
+  Dense base;
+  for (size_t i = 0; i < 40; i++)
+  {
+    // 基準値付近にそろった値
+    base.tagged_.set(i, 100000 + i * 3);
+    base.packed_.set(i, 100000 + i * 3);
+  }
+  for (size_t i = 0; i < 20; i++)
+  {
+    base.signed_.set(i, int16_t(i * 7) - 60);
+  }
+
+  // 同じ値でも共通幅で詰める方が小さい
+  record::Serializer tser{4096};
+  record::Serializer pser{4096};
+  assert(base.tagged_.serialize(tser));
+  assert(base.packed_.serialize(pser));
+  assert(pser.tell() * 2 < tser.tell());
+
+  record::Serializer ser{4096};
+  assert(base.valLink.serialize(ser));
+  Dense copied;
+  ser.reset();
+  assert(copied.valLink.deserialize(ser));
+  assert(copied.valLink.equal(base.valLink));
+  assert(copied.signed_.get(0) == -60);
+  assert(copied.signed_.get(19) == 73);
+
+  // 差分(Plain / RunLength)と変化なし
+  Dense next;
+  next.valLink.copy(base.valLink);
+  next.packed_.set(3, 0);
+  next.packed_.set(39, 0xffffffff);
+  next.signed_.set(5, -32000);
+  for (auto format : {record::DiffFormat::Plain, record::DiffFormat::RunLength})
+  {
+    ser.reset();
+    assert(base.valLink.serializeDiff(ser, next.valLink, format));
+    Dense applied;
+    applied.valLink.copy(base.valLink);
+    ser.reset();
+    assert(applied.valLink.deserializeDiff(ser, format));
+    assert(applied.valLink.equal(next.valLink));
+  }
+  next.valLink.enableDirtyTracking();
+  next.valLink.clearDirty();
+  ser.reset();
+  assert(next.valLink.serializeDirty(ser, next.valLink));
+  Dense same;
+  same.valLink.copy(next.valLink);
+  ser.reset();
+  assert(same.valLink.deserializeDiff(ser));
+  assert(same.valLink.equal(next.valLink));
+
+  // フォーマットが異なる配列としては読めない
+  pser.reset();
+  assert(!copied.tagged_.deserialize(pser));
+  tser.reset();
+  assert(!copied.packed_.deserialize(tser));
+}
+
+void test_signed_zigzag()
+{
+  struct Motion
+  {
+    record::ValueLink valLink;
+    record::Value<int32_t> pos_{0, valLink};
+    record::Value<int64_t> wide_{0, valLink};
+    record::Value<int16_t> small_{0, valLink};
+    record::ValueArray<int32_t, 8> vel_{0, valLink};
+    record::ValueArray<int64_t, 4> big_{0, valLink};
+  };
+
+  // 小さな符号付き差分は型の幅によらず 2 + 6 + 2bit
+  Motion from;
+  Motion to;
+  to.pos_ = -1;
+  record::Serializer ser{4096};
+  assert(from.pos_.serializeDiff(ser, to.pos_));
+  assert(ser.tell() == 10);
+  ser.reset();
+  to.wide_ = 1;
+  assert(from.wide_.serializeDiff(ser, to.wide_));
+  assert(ser.tell() == 10);
+
+  // 端の値と型の幅を超える差分
+  const int64_t wides[] = {-1, 1, -64, 63, INT64_MIN, INT64_MAX};
+  for (auto wide : wides)
+  {
+    Motion src;
+    src.pos_ = int32_t(wide);
+    src.wide_ = wide;
+    src.small_ = int16_t(wide);
+    for (size_t i = 0; i < 8; i++)
+    {
+      src.vel_.set(i, int32_t(wide) + int32_t(i));
+    }
+    for (size_t i = 0; i < 4; i++)
+    {
+      src.big_.set(i, wide ^ int64_t(i));
+    }
+    ser.reset();
+    assert(src.valLink.serialize(ser));
+    Motion dst;
+    ser.reset();
+    assert(dst.valLink.deserialize(ser));
+    assert(dst.valLink.equal(src.valLink));
+
+    // 差分が型の範囲を超える組み合わせ(UBSanでも未定義動作にならない)
+    Motion base;
+    base.small_ = INT16_MAX;
+    base.vel_.set(0, INT32_MIN);
+    base.vel_.set(1, INT32_MAX);
+    base.pos_ = wide < 0 ? INT32_MAX : INT32_MIN;
+    base.wide_ = wide < 0 ? INT64_MAX : INT64_MIN;
+    base.big_.set(0, INT64_MAX);
+    base.big_.set(1, INT64_MIN);
+    const auto diffBits = base.valLink.measureDiffBits(src.valLink);
+    ser.reset();
+    assert(base.valLink.serializeDiff(ser, src.valLink));
+    assert(ser.tell() == diffBits);
+    ser.reset();
+    assert(base.valLink.deserializeDiff(ser));
+    assert(base.valLink.equal(src.valLink));
+  }
+}
+
+void test_float_values()
+{
+  constexpr auto Packed = record::ArrayFormat::Packed;
+  struct Transform
+  {
+    record::ValueLink valLink;
+    record::ValueFloat x_{0.0f, valLink};
+    record::ValueDouble time_{0.0, valLink};
+    record::ValueFloat angle_{0.0f, valLink};
+    record::ValueArray<float, 3> pos_{0.0f, valLink};
+    record::ValueArray<double, 20, Packed> samples_{0.0, valLink};
+    record::ValueArray<float, 4> rot_{0.0f, valLink};
+  };
+  auto setup = [](Transform &rec)
+  {
+    rec.angle_.setQuantize({-180.0, 180.0, 0.01});
+    rec.rot_.setQuantize({-1.0, 1.0, 1.0 / 4096});
+  };
+
+  // ビット列そのままで往復する
+  const float specials[] = {-0.0f, 1.5f, -3.25e-40f,
+                            std::numeric_limits<float>::infinity(),
+                            std::numeric_limits<float>::quiet_NaN()};
+  record::Serializer ser{4096};
+  Transform src;
+  setup(src);
+  for (auto value : specials)
+  {
+    src.x_ = value;
+    src.time_ = double(value) * 3.0;
+    src.pos_.set(1, value);
+    ser.reset();
+    assert(src.valLink.serialize(ser));
+    Transform dst;
+    setup(dst);
+    ser.reset();
+    assert(dst.valLink.deserialize(ser));
+    assert(dst.x_.equal(src.x_) && dst.time_.equal(src.time_));
+    assert(std::memcmp(dst.pos_.data(), src.pos_.data(), 12) == 0);
+  }
+
+  // XOR差分: 近い値は短く、変化なしはBBZeroだけ
+  Transform from;
+  Transform to;
+  from.time_ = 1000.0;
+  to.time_ = 1000.0 + 1.0 / 1024;
+  ser.reset();
+  assert(from.time_.serializeDiff(ser, to.time_));
+  assert(ser.tell() < 2 + 6 + 64);
+  ser.reset();
+  assert(from.time_.deserializeDiff(ser));
+  assert(from.time_() == to.time_());
+  ser.reset();
+  assert(from.time_.serializeDiff(ser, to.time_));
+  assert(ser.tell() == 2);
+
+  // 量子化: 精度内で復元され、小さな変化は小さな差分になる
+  setup(from);
+  setup(to);
+  from.angle_ = 45.0f;
+  to.angle_ = 45.03f;
+  ser.reset();
+  assert(from.angle_.serialize(ser));
+  assert(ser.tell() <= 2 + 6 + 16);
+  ser.reset();
+  assert(from.angle_.serializeDiff(ser, to.angle_));
+  assert(ser.tell() == 2 + 6 + 4);
+  ser.reset();
+  assert(from.angle_.deserializeDiff(ser));
+  assert(std::abs(from.angle_() - 45.03f) < 0.006f);
+  to.angle_ = 500.0f;
+  ser.reset();
+  assert(to.angle_.serialize(ser));
+  ser.reset();
+  assert(from.angle_.deserialize(ser));
+  assert(std::abs(from.angle_() - 180.0f) < 0.006f);
+
+  // 配列: 各フォーマットと差分の往復
+  Transform next;
+  setup(next);
+  next.valLink.copy(src.valLink);
+  for (size_t i = 0; i < 20; i++)
+  {
+    src.samples_.set(i, 0.5 * double(i));
+    next.samples_.set(i, 0.5 * double(i) + (i % 3 == 0 ? 0.125 : 0.0));
+  }
+  for (size_t i = 0; i < 4; i++)
+  {
+    src.rot_.set(i, 0.25f * float(i));
+    next.rot_.set(i, 0.25f * float(i) - 0.01f);
+  }
+  next.pos_.set(0, 12.5f);
+  next.x_ = 2.0f;
+  for (auto format : {record::DiffFormat::Plain, record::DiffFormat::RunLength})
+  {
+    ser.reset();
+    assert(src.valLink.serializeDiff(ser, next.valLink, format));
+    Transform applied;
+    setup(applied);
+    applied.valLink.copy(src.valLink);
+    ser.reset();
+    assert(applied.valLink.deserializeDiff(ser, format));
+    assert(applied.samples_.equal(next.samples_));
+    assert(applied.pos_.equal(next.pos_) && applied.x_.equal(next.x_));
+    for (size_t i = 0; i < 4; i++)
+    {
+      assert(std::abs(applied.rot_.get(i) - next.rot_.get(i)) < 0.0002f);
+    }
+  }
+}
+
+void test_long_string()
+{
+  struct Named
+  {
+    record::ValueLink valLink;
+    record::ValueBool flag_{true, valLink};
+    record::ValueString name_{"", valLink};
+  };
+
+  // 63バイト未満は従来通り 6bit長 + バイト列
+  Named shortName;
+  shortName.name_ = "abc";
+  record::Serializer ser{16 * 1024};
+  record::Serializer ref{16 * 1024};
+  assert(shortName.name_.serialize(ser));
+  ref.writeBits64(3, 2);
+  ref.writeBits64(3, 6);
+  for (char c : std::string("abc"))
+  {
+    ref.writeBits64(uint8_t(c), 8);
+  }
+  assert(sameStream(ser, ref));
+
+  // 長い文字列(バイト境界でない位置から)
+  for (size_t len : {0, 62, 63, 64, 190, 191, 5000})
+  {
+    Named src;
+    std::string text(len, ' ');
+    for (size_t i = 0; i < len; i++)
+    {
+      text[i] = char('a' + i % 26);
+    }
+    src.name_ = text;
+    ser.reset();
+    assert(src.valLink.serialize(ser));
+    Named dst;
+    dst.name_ = "old";
+    ser.reset();
+    assert(dst.valLink.deserialize(ser));
+    assert(dst.name_() == text);
+
+    Named base;
+    ser.reset();
+    assert(base.valLink.serializeDiff(ser, src.valLink));
+    ser.reset();
+    assert(base.valLink.deserializeDiff(ser));
+    assert(base.name_() == text);
+  }
+
+  // 長さが読めても中身が足りないデータは失敗する
+  Named big;
+  big.name_ = std::string(300, 'x');
+  ser.reset();
+  assert(big.name_.serialize(ser));
+  std::array<uint64_t, 4> head{};
+  std::memcpy(head.data(), ser.data(), sizeof(head));
+  record::Serializer cut{std::span<uint64_t>(head)};
+  assert(!big.name_.deserialize(cut));
+}
+
+void test_string_patch_and_dictionary()
+{
+  // 前後の一致部分を除いた差し替え
+  const std::vector<std::pair<std::string, std::string>> cases = {
+      {"name_1_1", "name_1_2"},
+      {"name_1_1", "name_1_123"},
+      {"prefix_long_string", "long_string"},
+      {"abcdefghijklmnop", "abcdXYZmnop"},
+      {"abcdefgh", "abcdefghabcdefgh"},
+      {"same", "totally different"},
+      {"", "new"},
+      {"old", ""},
+  };
+  struct Text
+  {
+    record::ValueLink valLink;
+    record::ValueString value_{"", valLink};
+  };
+  Text fromText;
+  Text toText;
+  auto &from = fromText.value_;
+  auto &to = toText.value_;
+  record::Serializer ser{4096};
+
+  // 既定の差分は従来通り丸ごと
+  from = "name_1_1";
+  to = "name_1_2";
+  assert(from.serializeDiff(ser, to));
+  record::Serializer whole{4096};
+  assert(to.serialize(whole));
+  assert(sameStream(ser, whole));
+
+  from.setSpliceDiff(true);
+  for (const auto &[before, after] : cases)
+  {
+    from = before;
+    to = after;
+    ser.reset();
+    assert(from.serializeDiff(ser, to));
+    const auto diffBits = ser.tell();
+    record::Serializer full{4096};
+    assert(to.serialize(full));
+    assert(diffBits <= full.tell());
+
+    Text applyText;
+    auto &applied = applyText.value_;
+    applied = before;
+    ser.reset();
+    assert(applied.deserializeDiff(ser));
+    assert(applied() == after);
+    assert(ser.tell() == diffBits);
+  }
+  // 末尾1文字の変更は丸ごとより大幅に小さい
+  from = "name_12_1";
+  to = "name_12_2";
+  ser.reset();
+  assert(from.serializeDiff(ser, to));
+  assert(ser.tell() < 40);
+
+  // 辞書: 登録済みの値は番号で送る
+  record::StringDictionary dict;
+  dict.add("RedTeam");
+  dict.add("BlueTeam");
+  assert(dict.add("RedTeam") == 0);
+  from.setDictionary(&dict);
+  to.setDictionary(&dict);
+  from = "RedTeam";
+  to = "BlueTeam";
+  record::Serializer fullSer{4096};
+  assert(to.serialize(fullSer));
+  assert(fullSer.tell() < 16);
+  ser.reset();
+  assert(from.serializeDiff(ser, to));
+  assert(ser.tell() < 16);
+
+  Text readText;
+  auto &reader = readText.value_;
+  fullSer.reset();
+  assert(!reader.deserialize(fullSer));
+  reader.setDictionary(&dict);
+  fullSer.reset();
+  assert(reader.deserialize(fullSer));
+  assert(reader() == "BlueTeam");
+  reader = "RedTeam";
+  ser.reset();
+  assert(reader.deserializeDiff(ser));
+  assert(reader() == "BlueTeam");
+
+  // 差し替えは丸ごとの読み込みでは受け付けない
+  from.setDictionary(nullptr);
+  from = "name_1_1";
+  to = "name_1_2";
+  ser.reset();
+  assert(from.serializeDiff(ser, to));
+  ser.reset();
+  assert(!reader.deserialize(ser));
+}
+
+void test_string_truncated()
+{
+  // 途中で切れたデータを読んでも元の値は残す
+  struct Text
+  {
+    record::ValueLink valLink;
+    record::ValueString value_{"", valLink};
+    record::ValueFixedString<64> fixed_{"", valLink};
+  };
+  Text fromText;
+  Text toText;
+  const std::string head = "head";
+  const std::string tail = "tail";
+  fromText.value_ = head + std::string(40, 'a') + tail;
+  toText.value_ = head + std::string(40, 'b') + tail;
+  toText.fixed_ = std::string(48, 'c');
+
+  // 丸ごと
+  record::Serializer full{4096};
+  assert(toText.value_.serialize(full));
+  auto cut = record::Serializer::view(full.data(), 48);
+  Text readText;
+  readText.value_ = "keep";
+  assert(!readText.value_.deserialize(cut));
+  assert(readText.value_() == "keep");
+
+  full.reset();
+  assert(toText.fixed_.serialize(full));
+  cut = record::Serializer::view(full.data(), 48);
+  readText.fixed_ = "keep";
+  assert(!readText.fixed_.deserialize(cut));
+  assert(readText.fixed_() == "keep");
+
+  // 差し替え
+  fromText.value_.setSpliceDiff(true);
+  record::Serializer diff{4096};
+  assert(fromText.value_.serializeDiff(diff, toText.value_));
+  cut = record::Serializer::view(diff.data(), 40);
+  readText.value_ = fromText.value_();
+  assert(!readText.value_.deserializeDiff(cut));
+  assert(readText.value_() == fromText.value_());
+  diff.reset();
+  assert(readText.value_.deserializeDiff(diff));
+  assert(readText.value_() == toText.value_());
+}
+
+void test_fixed_string()
+{
+  struct Fixed
+  {
+    record::ValueLink valLink;
+    record::ValueFixedString<16> name_{"Namae", valLink};
+    record::Value<uint8_t> age_{20, valLink};
+  };
+  struct Dynamic
+  {
+    record::ValueLink valLink;
+    record::ValueString name_{"Namae", valLink};
+    record::Value<uint8_t> age_{20, valLink};
+  };
+  using FixedSchema = record::Schema<&Fixed::name_, &Fixed::age_>;
+
+  // ValueStringと同じビット列
+  Fixed fixed;
+  Dynamic dynamic;
+  fixed.name_ = "name_1_1";
+  dynamic.name_ = "name_1_1";
+  record::Serializer fser{1024};
+  record::Serializer dser{1024};
+  assert(fixed.valLink.serialize(fser));
+  assert(dynamic.valLink.serialize(dser));
+  assert(sameStream(fser, dser));
+  record::Serializer schemaSer{1024};
+  assert(FixedSchema::serialize(schemaSer, fixed));
+  assert(sameStream(fser, schemaSer));
+
+  Fixed decoded;
+  dser.reset();
+  assert(decoded.valLink.deserialize(dser));
+  assert(decoded.name_() == "name_1_1");
+
+  // 差分(差し替え)とコピー
+  Fixed next;
+  next.name_ = "name_1_22";
+  fser.reset();
+  assert(decoded.valLink.serializeDiff(fser, next.valLink));
+  fser.reset();
+  assert(decoded.valLink.deserializeDiff(fser));
+  assert(decoded.name_() == "name_1_22");
+  assert(decoded.valLink.equal(next.valLink));
+  Fixed copied;
+  copied.name_ = next.name_;
+  assert(copied.name_ == next.name_);
+
+  // 容量を超える代入は切り詰め、読み込みは失敗
+  fixed.name_ = "0123456789abcdefXYZ";
+  assert(fixed.name_.size() == 16);
+  assert(fixed.name_() == "0123456789abcdef");
+  dynamic.name_ = "0123456789abcdefXYZ";
+  dser.reset();
+  assert(dynamic.name_.serialize(dser));
+  dser.reset();
+  assert(!fixed.name_.deserialize(dser));
+}
+
+void test_static_schema_matches_link()
+{
+  TestVer2 base;
+  TestVer2 next;
+  next.enabled_ = true;
+  next.count_ = 12345;
+  next.name_ = "SchemaName";
+  next.age_ = 3;
+  next.points_.set(3, 999);
+  next.points_.set(15, 70000);
+  next.bits_.set(7, true);
+  next.code_ = -300;
+  next.number_ = 1;
+
+  static_assert(TestVer2Schema::getDataVersion() == 1);
+  assert(TestVer2Schema::getDataVersion() == next.valLink.getDataVersion());
+
+  record::Serializer linkSer{10 * 1000};
+  record::Serializer schemaSer{10 * 1000};
+  assert(next.serialize(linkSer));
+  assert(TestVer2Schema::serialize(schemaSer, next));
+  assert(sameStream(linkSer, schemaSer));
+
+  linkSer.reset();
+  schemaSer.reset();
+  assert(base.serializeDiff(linkSer, next));
+  assert(TestVer2Schema::serializeDiff(schemaSer, base, next));
+  assert(sameStream(linkSer, schemaSer));
+
+  // schemaで書いたものをValueLinkで読む
+  TestVer2 applied;
+  schemaSer.reset();
+  assert(applied.deserializeDiff(schemaSer));
+  assert(applied.valLink.equal(next.valLink) ==
+         TestVer2Schema::equal(applied, next));
+  assert(applied.points_.get(15) == 70000);
+  assert(applied.code_() == -300);
+
+  // ValueLinkで書いたものをschemaで読む
+  TestVer2 loaded;
+  linkSer.reset();
+  assert(next.serialize(linkSer));
+  linkSer.reset();
+  assert(TestVer2Schema::deserialize(linkSer, loaded));
+  assert(loaded.name_() == "SchemaName");
+  assert(loaded.number_() == 1);
+
+  // 旧バージョンのデータを新しいスキーマで読む
+  Test old;
+  old.count_ = 77;
+  record::Serializer oldSer{10 * 1000};
+  assert(old.serialize(oldSer));
+  oldSer.reset();
+  assert(TestVer2Schema::deserialize(oldSer, loaded));
+  assert(loaded.count_() == 77);
+  assert(loaded.number_() == 1);
+
+  // 新しいデータを旧スキーマで読むと失敗する
+  linkSer.reset();
+  assert(!TestSchema::deserialize(linkSer, old));
+
+  TestVer2 copied;
+  assert(TestVer2Schema::serializeDiffAndCopy(schemaSer, copied, next));
+  assert(copied.name_() == "SchemaName");
+  assert(copied.points_.get(3) == 999);
+  assert(copied.number_() == 1);
+}
+
+void test_dirty_tracking()
+{
+  TestVer2 sent;
+  TestVer2 live;
+  live.valLink.enableDirtyTracking();
+  assert(live.valLink.isDirty(0));
+
+  // 有効化直後は全フィールド変更扱い
+  record::Serializer dirtySer{10 * 1000};
+  record::Serializer diffSer{10 * 1000};
+  live.name_ = "Dirty";
+  assert(live.valLink.serializeDirty(dirtySer, sent.valLink));
+  assert(sent.serializeDiff(diffSer, live));
+  assert(sameStream(dirtySer, diffSer));
+  sent.valLink.copyDirty(live.valLink);
+  live.valLink.clearDirty();
+  assert(!live.valLink.isDirty(2));
+
+  // 変更したフィールドだけ立つ
+  live.count_ = 5;
+  live.points_.set(4, 400);
+  live.bits_.set(2, true);
+  assert(!live.valLink.isDirty(0));
+  assert(live.valLink.isDirty(1));
+  assert(!live.valLink.isDirty(2));
+  assert(live.valLink.isDirty(4));
+  assert(live.valLink.isDirty(5));
+
+  dirtySer.reset();
+  diffSer.reset();
+  assert(live.valLink.serializeDirty(dirtySer, sent.valLink));
+  assert(sent.serializeDiff(diffSer, live));
+  assert(sameStream(dirtySer, diffSer));
+
+  TestVer2 applied;
+  applied.valLink.copy(sent.valLink);
+  dirtySer.reset();
+  assert(applied.deserializeDiff(dirtySer));
+  assert(applied.count_() == 5);
+  assert(applied.points_.get(4) == 400);
+  assert(applied.bits_.get(2));
+  assert(applied.name_() == "Dirty");
+
+  // 変更なしならBBZeroと固定値のみ
+  sent.valLink.copyDirty(live.valLink);
+  live.valLink.clearDirty();
+  dirtySer.reset();
+  diffSer.reset();
+  assert(live.valLink.serializeDirty(dirtySer, sent.valLink));
+  assert(sent.serializeDiff(diffSer, live));
+  assert(sameStream(dirtySer, diffSer));
+
+  // ValueLinkから遠いフィールドは変更を追えないので常に変更扱い
+  HeapField farSent;
+  HeapField farLive;
+  farLive.valLink.enableDirtyTracking();
+  farLive.valLink.clearDirty();
+  assert(!farLive.valLink.isDirty(0));
+  assert(farLive.valLink.isDirty(1) == farLive.distant());
+  *farLive.far_ = 40;
+  assert(farLive.valLink.isDirty(1));
+  dirtySer.reset();
+  diffSer.reset();
+  assert(farLive.valLink.serializeDirty(dirtySer, farSent.valLink));
+  assert(farSent.valLink.serializeDiff(diffSer, farLive.valLink));
+  assert(sameStream(dirtySer, diffSer));
+  dirtySer.seek(0);
+  assert(farSent.valLink.deserializeDiff(dirtySer));
+  assert((*farSent.far_)() == 40 && farSent.near_() == 7);
+
+  // 追跡していないレコードのsetterはValueLinkに書き込まない
+  Test untracked;
+  const auto untrackedGen = untracked.valLink.generation();
+  untracked.count_ = 5;
+  assert(untracked.valLink.generation() == untrackedGen);
+
+  // コピーは追跡を引き継がず、コピー元にも通知しない
+  live.valLink.clearDirty();
+  auto copied = live;
+  assert(!copied.valLink.isDirtyTracking());
+  copied.count_ = 77;
+  auto copiedField = live.count_;
+  copiedField = 78;
+  assert(!live.valLink.isDirty(1) && live.count_() != 77);
+
+  // レコードの外のフィールドは、ムーブ元が破棄されたら通知しない
+  for (bool tracking : {false, true})
+  {
+    auto *source = new HeapField;
+    if (tracking)
+    {
+      source->valLink.enableDirtyTracking();
+    }
+    HeapField moved{std::move(*source)};
+    delete source;
+    std::vector<unsigned char> reuse(sizeof(HeapField), 0xab);
+    *moved.far_ = 42;
+    assert((*moved.far_)() == 42 && moved.near_() == 7);
+    assert(std::all_of(reuse.begin(), reuse.end(),
+                       [](unsigned char c) { return c == 0xab; }));
+  }
+}
+
+void test_encode_stats()
+{
+  Test base;
+  Test next;
+  next.count_ = 1001;
+  record::Serializer ser{4096};
+  assert(base.serialize(ser));
+  assert(base.serializeDiff(ser, next));
+  auto fields = base.valLink.fieldStats();
+  auto stats = ser.stats();
+  if constexpr (!record::StatsEnabled)
+  {
+    // 無効なら何も集計しない
+    assert(fields.empty());
+    assert(stats.highWater == 0 && stats.rollbacks == 0);
+    return;
+  }
+
+  assert(fields.size() == base.valLink.size());
+  uint64_t bits = 0;
+  for (size_t i = 0; i < fields.size(); i++)
+  {
+    bits += fields[i].bits;
+    assert(fields[i].writes == 2 && fields[i].diffs == 1);
+    // count_(1番目)だけが変化している
+    assert(fields[i].zeroDiffs == (i == 1 ? 0U : 1U));
+  }
+  // 終端(2bit)以外はすべてフィールドのビット
+  assert(bits + 4 == ser.tell());
+  assert(stats.highWater == ser.tell());
+  // 1000は16bit、差分1((1<<1)=2)は8bit
+  assert(stats.numberBits[8] >= 1 && stats.numberBits[4] >= 1);
+  assert(stats.arrayTypes[0] >= 32);
+
+  // 容量不足は巻き戻しとして数える
+  record::Serializer tiny{8};
+  assert(!base.serialize(tiny));
+  auto tinyStats = tiny.stats();
+  assert(tinyStats.rollbacks == 1 && tinyStats.overflows == 1);
+  assert(tinyStats.highWater > 0 && tiny.tell() == 0);
+  tiny.resetStats();
+  base.valLink.resetFieldStats();
+  assert(tiny.stats().rollbacks == 0);
+  assert(base.valLink.fieldStats()[0].writes == 0);
+}
+
+void test_measure_bits()
+{
+  constexpr auto Packed = record::ArrayFormat::Packed;
+  struct Mixed
+  {
+    record::ValueLink valLink;
+    record::Value<uint8_t> u8_{0, valLink};
+    record::Value<uint64_t> u64_{0, valLink};
+    record::Value<int32_t> i32_{0, valLink};
+    record::ValueBool flag_{false, valLink};
+    record::ValueString name_{"", valLink};
+    record::ValueFixedString<16> tag_{"", valLink};
+    record::ValueFloat x_{0.0f, valLink};
+    record::ValueFloat angle_{0.0f, valLink};
+    record::ValueDouble time_{0.0, valLink};
+    record::ValueVersion ver_{valLink};
+    record::ValueArray<uint16_t, 8> tagged_{0, valLink};
+    record::ValueArray<int32_t, 20, Packed> packed_{0, valLink};
+    record::ValueArray<float, 4> rot_{0.0f, valLink};
+    record::ValueBits<uint32_t> bits_{0, valLink};
+  };
+  record::StringDictionary dict;
+  dict.add("RedTeam");
+  auto setup = [&dict](Mixed &rec)
+  {
+    rec.angle_.setQuantize({-180.0, 180.0, 0.01});
+    rec.rot_.setQuantize({-1.0, 1.0, 1.0 / 4096});
+    rec.name_.setDictionary(&dict);
+    rec.name_.setSpliceDiff(true);
+    rec.tag_.setSpliceDiff(true);
+  };
+  Mixed from;
+  Mixed to;
+  setup(from);
+  setup(to);
+
+  // 書いたビット数と一致する
+  record::Serializer ser{4096};
+  auto check = [&ser](const Mixed &a, const Mixed &b)
+  {
+    ser.reset();
+    assert(b.valLink.serialize(ser));
+    assert(b.valLink.measureBits() == ser.tell());
+    assert(b.valLink.needTotalSize() == (ser.tell() + 7) / 8);
+    ser.reset();
+    assert(a.valLink.serializeDiff(ser, b.valLink));
+    assert(a.valLink.measureDiffBits(b.valLink) == ser.tell());
+    auto each = [&ser](const auto &x, const auto &y)
+    {
+      ser.reset();
+      assert(y.serialize(ser));
+      assert(y.measureBits() == ser.tell());
+      ser.reset();
+      assert(x.serializeDiff(ser, y));
+      assert(x.measureDiffBits(y) == ser.tell());
+    };
+    each(a.u8_, b.u8_);
+    each(a.u64_, b.u64_);
+    each(a.i32_, b.i32_);
+    each(a.flag_, b.flag_);
+    each(a.name_, b.name_);
+    each(a.tag_, b.tag_);
+    each(a.x_, b.x_);
+    each(a.angle_, b.angle_);
+    each(a.time_, b.time_);
+    each(a.tagged_, b.tagged_);
+    each(a.packed_, b.packed_);
+    each(a.rot_, b.rot_);
+    each(a.bits_, b.bits_);
+  };
+  check(from, to);
+
+  to.u8_ = 15;
+  to.u64_ = 0x123456789ULL;
+  to.i32_ = -70000;
+  to.flag_ = true;
+  to.name_ = "RedTeam";
+  to.tag_ = "tag_1";
+  to.x_ = 1.5f;
+  to.angle_ = 45.0f;
+  to.time_ = 1000.0 + 1.0 / 1024;
+  to.tagged_.set(3, 300);
+  to.packed_.set(7, -5);
+  to.packed_.set(8, 100000);
+  to.rot_.set(1, 0.5f);
+  to.bits_ = 0x5a5a;
+  check(from, to);
+  check(to, from);
+
+  // 文字列の差し替え・辞書外の値
+  from.name_ = "name_1_1";
+  to.name_ = "name_1_2";
+  from.tag_ = "prefix_long";
+  to.tag_ = "long";
+  from.u8_ = 200;
+  from.i32_ = 70000;
+  from.time_ = 1000.0;
+  check(from, to);
+  check(to, from);
+
+  // キャッシュ有効時もキャッシュのサイズが一致する
+  TestVer2 cached;
+  cached.valLink.enableEncodeCache();
+  cached.name_ = "Cache";
+  ser.reset();
+  assert(cached.serialize(ser));
+  assert(cached.valLink.measureBits() == ser.tell());
+  cached.count_ = 12345;
+  ser.reset();
+  assert(cached.serialize(ser));
+  assert(cached.valLink.measureBits() == ser.tell());
+
+  // 正確なサイズのバッファに収まる
+  record::Serializer exact{cached.valLink.needTotalSize()};
+  assert(cached.serialize(exact));
+
+  // フィールド数が違う差分は0
+  Test base;
+  assert(base.valLink.measureDiffBits(cached.valLink) == 0);
+}
+
+void test_field_index()
+{
+  constexpr auto Packed = record::ArrayFormat::Packed;
+  struct Archive
+  {
+    record::ValueLink valLink;
+    record::Value<uint32_t> id_{0, valLink};
+    record::ValueString name_{"", valLink};
+    record::ValueString team_{"", valLink};
+    record::ValueFixedString<16> tag_{"", valLink};
+    record::ValueBool alive_{false, valLink};
+    record::ValueFloat angle_{0.0f, valLink};
+    record::ValueDouble time_{0.0, valLink};
+    record::ValueArray<uint16_t, 8> slots_{0, valLink};
+    record::ValueArray<int32_t, 40, Packed> path_{0, valLink};
+    record::ValueBits<uint32_t> flags_{0, valLink};
+    record::ValueVersion ver_{valLink};
+    record::Value<int64_t> score_{0, valLink};
+  };
+  record::StringDictionary dict;
+  dict.add("Red");
+  auto setup = [&dict](Archive &rec)
+  {
+    rec.team_.setDictionary(&dict);
+    rec.angle_.setQuantize({-180.0, 180.0, 0.01});
+  };
+
+  // 3レコード続けて書き、真ん中のレコードのフィールドだけ読む
+  record::Serializer ser{8192};
+  std::vector<size_t> starts;
+  for (uint32_t n = 0; n < 3; n++)
+  {
+    Archive rec;
+    setup(rec);
+    rec.id_ = 100 + n;
+    rec.name_ = std::string(40 + n, char('a' + n));
+    rec.team_ = n == 1 ? "Red" : "Blue";
+    rec.tag_ = "tag";
+    rec.alive_ = n == 1;
+    rec.angle_ = 12.5f * float(n);
+    rec.time_ = 0.25 * n;
+    rec.slots_.set(n, 4000);
+    for (size_t i = 0; i < 40; i++)
+    {
+      rec.path_.set(i, int32_t(i * n) - 20);
+    }
+    rec.flags_ = 0xf0 + n;
+    rec.score_ = -1000000000LL * n;
+    starts.push_back(ser.tell());
+    assert(rec.valLink.serialize(ser));
+  }
+  const auto endPos = ser.tell();
+
+  Archive reader;
+  setup(reader);
+  record::FieldIndex index;
+  ser.seek(starts[1]);
+  assert(reader.valLink.buildFieldIndex(ser, index));
+  assert(ser.tell() == starts[2] && index.end == starts[2]);
+  assert(index.begin == starts[1] && index.size() == reader.valLink.size());
+  // 走査だけでは値は変わらない
+  assert(reader.id_() == 0 && reader.name_().empty());
+
+  // 各フィールドの終わりは次のフィールドの先頭
+  for (size_t i = 0; i < index.size(); i++)
+  {
+    assert(reader.valLink.deserializeField(ser, index, i));
+    auto next = i + 1 < index.size() ? index.position(i + 1) : index.end - 2;
+    assert(ser.tell() == next);
+  }
+  assert(reader.id_() == 101 && reader.name_() == std::string(41, 'b'));
+  assert(reader.team_() == "Red" && reader.alive_());
+  assert(reader.path_.get(39) == 19 && reader.score_() == -1000000000LL);
+
+  // 1フィールドだけ読むと他は変わらない
+  Archive single;
+  setup(single);
+  assert(single.valLink.deserializeField(ser, index, 8));
+  assert(single.path_.get(39) == 19 && single.id_() == 0);
+  assert(!single.valLink.deserializeField(ser, index, index.size()));
+
+  // 全レコードを走査で数える
+  ser.reset();
+  size_t count = 0;
+  while (ser.tell() < endPos && reader.valLink.buildFieldIndex(ser, index))
+  {
+    count++;
+  }
+  assert(count == 3 && ser.tell() == endPos);
+
+  // 旧バージョンのレコードは後ろのフィールドが無い
+  Test old;
+  record::Serializer oldSer{1024};
+  assert(old.serialize(oldSer));
+  TestVer2 newer;
+  oldSer.reset();
+  assert(newer.valLink.buildFieldIndex(oldSer, index));
+  assert(index.size() == old.valLink.size());
+  assert(oldSer.tell() == index.end);
+
+  // 型が合わなければ失敗して位置は戻る
+  oldSer.reset();
+  assert(!reader.valLink.buildFieldIndex(oldSer, index));
+  assert(oldSer.tell() == 0);
+}
+
+void test_skip_scan()
+{
+  struct Frame
+  {
+    record::ValueLink valLink;
+    record::Value<uint32_t> tick_{0, valLink};
+    record::ValueString name_{"player", valLink};
+    record::ValueFloat x_{0.0f, valLink};
+    record::ValueFloat angle_{0.0f, valLink};
+    record::ValueArray<int16_t, 24> cells_{0, valLink};
+    record::ValueArray<float, 8, record::ArrayFormat::Packed> pos_{0.0f,
+                                                                  valLink};
+    record::ValueBool alive_{true, valLink};
+    record::ValueVersion ver_{valLink};
+    record::ValueFixedString<8> tag_{"t", valLink};
+  };
+  auto setup = [](Frame &rec)
+  { rec.angle_.setQuantize({-180.0, 180.0, 0.01}); };
+  auto step = [](Frame &rec, uint32_t n)
+  {
+    rec.tick_ = n;
+    rec.name_ = "player_" + std::to_string(n % 3);
+    rec.x_ = 0.5f * float(n);
+    rec.angle_ = float(n % 90);
+    rec.cells_.set(n % 24, int16_t(n * 7) - 100);
+    rec.pos_.set(n % 8, float(n));
+    rec.alive_ = n % 5 != 0;
+    rec.tag_ = n % 2 ? "odd" : "even";
+  };
+
+  // キーフレーム + Plain/RunLength差分を交互に並べたリプレイ
+  constexpr uint32_t Frames = 40;
+  record::Serializer ser{64 * 1024};
+  std::vector<size_t> starts;
+  Frame prev;
+  Frame next;
+  setup(prev);
+  setup(next);
+  starts.push_back(ser.tell());
+  assert(prev.valLink.serialize(ser));
+  auto formatOf = [](uint32_t n)
+  {
+    return n % 2 ? record::DiffFormat::Plain : record::DiffFormat::RunLength;
+  };
+  for (uint32_t n = 1; n < Frames; n++)
+  {
+    step(next, n);
+    starts.push_back(ser.tell());
+    assert(prev.valLink.serializeDiffAndCopy(ser, next.valLink, formatOf(n)));
+  }
+  const auto endPos = ser.tell();
+
+  // 値を作らずにフレーム境界が求まる
+  Frame scan;
+  setup(scan);
+  ser.reset();
+  assert(scan.valLink.skipRecord(ser));
+  for (uint32_t n = 1; n < Frames; n++)
+  {
+    assert(ser.tell() == starts[n]);
+    assert(scan.valLink.skipDiffRecord(ser, formatOf(n)));
+  }
+  assert(ser.tell() == endPos && scan.tick_() == 0);
+
+  // 途中のフレームへ飛んでから読む: キーフレーム + 差分の適用と同じ結果
+  Frame replay;
+  setup(replay);
+  ser.reset();
+  assert(replay.valLink.deserialize(ser));
+  for (uint32_t n = 1; n <= 30; n++)
+  {
+    assert(replay.valLink.deserializeDiff(ser, formatOf(n)));
+  }
+  assert(replay.tick_() == 30 && replay.name_() == "player_0");
+  assert(ser.tell() == starts[31]);
+
+  // フィールド単位の読み飛ばし
+  ser.reset();
+  for (size_t i = 0; i < 4; i++)
+  {
+    assert(scan.valLink.skipField(ser, i));
+  }
+  auto cellsPos = ser.tell();
+  assert(scan.valLink.skipField(ser, 4));
+  assert(ser.tell() > cellsPos);
+  assert(!scan.valLink.skipField(ser, scan.valLink.size()));
+
+  // 形式が違えば失敗して位置は戻る
+  ser.seek(starts[2]);
+  assert(!scan.valLink.skipDiffRecord(ser, record::DiffFormat::Plain));
+  assert(ser.tell() == starts[2]);
+  ser.seek(starts[1]);
+  assert(!scan.valLink.skipRecord(ser));
+  assert(ser.tell() == starts[1]);
+}
+
+void test_encode_cache()
+{
+  TestVer2 plain;
+  TestVer2 cached;
+  cached.valLink.enableEncodeCache();
+
+  record::Serializer ref{4096};
+  record::Serializer ser{4096};
+  assert(plain.serialize(ref));
+  // 1回目はエンコード、2回目はキャッシュの連結(位置がずれていても同じ)
+  for (size_t head : {0, 3})
+  {
+    ser.reset();
+    ser.writeBits64(0, head);
+    ref.reset();
+    ref.writeBits64(0, head);
+    assert(plain.serialize(ref));
+    const auto gen = cached.valLink.generation();
+    assert(cached.serialize(ser));
+    assert(sameStream(ser, ref));
+    assert(cached.valLink.generation() == gen);
+  }
+
+  // 変更で世代が進み、エンコードし直す
+  auto gen = cached.valLink.generation();
+  cached.count_ = 77;
+  cached.name_ = "Cache";
+  cached.points_.set(4, 1234);
+  plain.count_ = 77;
+  plain.name_ = "Cache";
+  plain.points_.set(4, 1234);
+  assert(cached.valLink.generation() > gen);
+  ser.reset();
+  ref.reset();
+  assert(cached.serialize(ser));
+  assert(plain.serialize(ref));
+  assert(sameStream(ser, ref));
+
+  // 読み込みでも世代が進む
+  gen = cached.valLink.generation();
+  TestVer2 other;
+  other.age_ = 3;
+  ref.reset();
+  assert(other.serialize(ref));
+  ref.reset();
+  assert(cached.deserialize(ref));
+  assert(cached.valLink.generation() > gen);
+  ser.reset();
+  assert(cached.serialize(ser));
+  assert(sameStream(ser, ref));
+
+  // 容量不足なら失敗し位置は戻る
+  record::Serializer small{4};
+  assert(!cached.serialize(small));
+  assert(small.tell() == 0);
+
+  cached.valLink.disableEncodeCache();
+  ser.reset();
+  assert(cached.serialize(ser));
+  assert(sameStream(ser, ref));
+
+#if !defined(RECORD_STATS)
+  // 同じレコードを複数スレッドから同時にserializeしてもよい
+  // (RECORD_STATSでは統計を書き込むので対象外)
+  for (size_t round = 0; round < 4; round++)
+  {
+    // 毎回キャッシュを作り直すところから競わせる
+    cached.count_ = static_cast<uint32_t>(round);
+    record::Serializer once{4096};
+    assert(cached.serialize(once));
+    cached.valLink.enableEncodeCache();
+    // data()は書き込み途中のビットを吐き出すので、スレッドからは触らない
+    const auto *onceBytes = static_cast<const uint8_t *>(once.data());
+    const std::vector<uint8_t> expect(onceBytes, onceBytes + once.size());
+    const auto expectBits = once.tell();
+    std::atomic<bool> same{true};
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < 4; t++)
+    {
+      threads.emplace_back(
+          [&]()
+          {
+            record::Serializer out{4096};
+            for (size_t n = 0; n < 50; n++)
+            {
+              out.reset();
+              if (!cached.serialize(out) || out.tell() != expectBits ||
+                  std::memcmp(out.data(), expect.data(), expect.size()) != 0)
+              {
+                same = false;
+              }
+            }
+          });
+    }
+    for (auto &thread : threads)
+    {
+      thread.join();
+    }
+    assert(same);
+  }
+#endif
+
+  // 変更通知の届かないフィールドがあっても古い結果を返さない
+  HeapField farCached;
+  HeapField farPlain;
+  farCached.valLink.enableEncodeCache();
+  ser.reset();
+  assert(farCached.valLink.serialize(ser));
+  *farCached.far_ = 99;
+  *farPlain.far_ = 99;
+  ser.reset();
+  ref.reset();
+  assert(farCached.valLink.serialize(ser));
+  assert(farPlain.valLink.serialize(ref));
+  assert(sameStream(ser, ref));
+
+  // 量子化の設定変更でもエンコードし直す
+  struct Angles
+  {
+    record::ValueLink valLink;
+    record::ValueFloat angle_{1.3f, valLink};
+    record::ValueArray<float, 4> rot_{0.6f, valLink};
+  };
+  Angles quantCached;
+  quantCached.valLink.enableEncodeCache();
+  ser.reset();
+  assert(quantCached.valLink.serialize(ser));
+  quantCached.angle_.setQuantize({-10.0, 10.0, 0.25});
+  quantCached.rot_.setQuantize({-10.0, 10.0, 0.25});
+  Angles quantPlain;
+  quantPlain.angle_.setQuantize({-10.0, 10.0, 0.25});
+  quantPlain.rot_.setQuantize({-10.0, 10.0, 0.25});
+  // 短くなるので前回の端数ビットが残らない新しいバッファで比べる
+  record::Serializer quantSer{4096};
+  record::Serializer quantRef{4096};
+  assert(quantCached.valLink.serialize(quantSer));
+  assert(quantPlain.valLink.serialize(quantRef));
+  assert(sameStream(quantSer, quantRef));
+
+  // 辞書の設定と、設定済みの辞書への登録の追加でもエンコードし直す
+  struct Names
+  {
+    record::ValueLink valLink;
+    record::ValueString name_{"BlueTeam", valLink};
+    record::ValueFixedString<16> tag_{"BlueTeam", valLink};
+  };
+  record::StringDictionary dict;
+  dict.add("RedTeam");
+  Names dictCached;
+  dictCached.valLink.enableEncodeCache();
+  auto sameAsFresh = [&dict, &dictCached]()
+  {
+    Names fresh;
+    fresh.name_.setDictionary(&dict);
+    fresh.tag_.setDictionary(&dict);
+    record::Serializer cachedSer{4096};
+    record::Serializer freshSer{4096};
+    return dictCached.valLink.serialize(cachedSer) &&
+           fresh.valLink.serialize(freshSer) && sameStream(cachedSer, freshSer);
+  };
+  ser.reset();
+  assert(dictCached.valLink.serialize(ser));
+  dictCached.name_.setDictionary(&dict);
+  dictCached.tag_.setDictionary(&dict);
+  assert(sameAsFresh());
+  dict.add("BlueTeam");
+  dictCached.name_.setDictionary(&dict);
+  dictCached.tag_.setDictionary(&dict);
+  assert(sameAsFresh());
+}
+
+void test_run_length_diff()
+{
+  constexpr auto RunLength = record::DiffFormat::RunLength;
+  TestVer2 base;
+  TestVer2 next;
+
+  // 変化なしなら数ビットで済む
+  record::Serializer plainSer{10 * 1000};
+  record::Serializer runSer{10 * 1000};
+  assert(base.serializeDiff(plainSer, next));
+  assert(base.valLink.serializeDiff(runSer, next.valLink, RunLength));
+  assert(runSer.tell() < 24);
+  assert(runSer.tell() * 4 < plainSer.tell());
+
+  next.count_ = 4000;
+  next.points_.set(1, 5);
+  next.points_.set(9, 0x12345678);
+  next.code_ = 12;
+  next.number_ = 99;
+  runSer.reset();
+  assert(base.valLink.serializeDiff(runSer, next.valLink, RunLength));
+  const auto runBits = runSer.tell();
+
+  TestVer2 applied;
+  runSer.reset();
+  assert(applied.valLink.deserializeDiff(runSer, RunLength));
+  assert(runSer.tell() == runBits);
+  assert(applied.count_() == 4000);
+  assert(applied.points_.get(0) == 0);
+  assert(applied.points_.get(1) == 5);
+  assert(applied.points_.get(9) == 0x12345678);
+  assert(applied.code_() == 12);
+  assert(applied.number_() == 99);
+  assert(applied.name_() == "Namae");
+
+  // dirty trackingからも同じ出力
+  TestVer2 live;
+  live.valLink.enableDirtyTracking();
+  live.valLink.clearDirty();
+  live.count_ = 4000;
+  live.points_.set(1, 5);
+  live.points_.set(9, 0x12345678);
+  live.code_ = 12;
+  live.number_ = 99;
+  record::Serializer dirtySer{10 * 1000};
+  assert(live.valLink.serializeDirty(dirtySer, base.valLink, RunLength));
+  assert(sameStream(runSer, dirtySer));
+
+  // 旧バージョンのデータは新しい型で読める
+  Test oldBase;
+  Test oldNext;
+  oldNext.age_ = 60;
+  record::Serializer oldSer{10 * 1000};
+  assert(oldBase.valLink.serializeDiff(oldSer, oldNext.valLink, RunLength));
+  oldSer.reset();
+  TestVer2 upgraded;
+  assert(upgraded.valLink.deserializeDiff(oldSer, RunLength));
+  assert(upgraded.age_() == 60);
+
+  // 新しいデータは旧バージョンでは失敗する
+  runSer.reset();
+  Test older;
+  assert(!older.valLink.deserializeDiff(runSer, RunLength));
+
+  // フォーマットを取り違えて読むと失敗する
+  TestVer2 wrong;
+  runSer.reset();
+  assert(!wrong.valLink.deserializeDiff(runSer));
+  assert(!wrong.valLink.skipDiffRecord(runSer));
+  assert(runSer.tell() == 0);
+  plainSer.reset();
+  assert(!wrong.valLink.deserializeDiff(plainSer, RunLength));
+  assert(!wrong.valLink.skipDiffRecord(plainSer, RunLength));
+  assert(plainSer.tell() == 0);
+
+  // copy付き
+  TestVer2 current;
+  runSer.reset();
+  assert(current.valLink.serializeDiffAndCopy(runSer, next.valLink, RunLength));
+  assert(current.count_() == 4000);
+  assert(current.points_.get(9) == 0x12345678);
+}
+
+void setupBatchSample(TestVer2 &v, size_t index, uint32_t seed)
+{
+  v.enabled_ = ((index + seed) % 3) == 0;
+  v.count_ = 100 + static_cast<uint32_t>(index * 3 + seed);
+  v.name_ = "name_" + std::to_string(index % 4);
+  v.age_ = static_cast<uint8_t>(18 + (index + seed) % 50);
+  v.points_.set(index % 16, static_cast<uint32_t>(index * seed));
+  v.code_ = static_cast<int16_t>((index % 40) - 20);
+  v.number_ = 1000 + static_cast<uint32_t>(index * 7 + seed * 11);
+  v.bits_ = static_cast<uint32_t>((index * 17) ^ (seed * 13));
+}
+
+void test_batch_columns()
+{
+  constexpr size_t Count = 40;
+  std::vector<TestVer2> src(Count);
+  std::vector<TestVer2> next(Count);
+  for (size_t i = 0; i < Count; i++)
+  {
+    setupBatchSample(src[i], i, 1);
+    setupBatchSample(next[i], i, 2);
+  }
+
+  record::Serializer ser{100 * 1000};
+  assert(TestVer2Schema::serializeBatch(ser, src.data(), src.size()));
+  const auto batchBits = ser.tell();
+
+  // レコードごとに書くより小さくなる
+  record::Serializer each{100 * 1000};
+  for (const auto &v : src)
+  {
+    assert(v.serialize(each));
+  }
+  assert(batchBits < each.tell());
+
+  std::vector<TestVer2> dst(Count + 2);
+  size_t num = dst.size();
+  ser.reset();
+  assert(TestVer2Schema::deserializeBatch(ser, dst.data(), num));
+  assert(num == Count);
+  assert(ser.tell() == batchBits);
+  for (size_t i = 0; i < Count; i++)
+  {
+    assert(dst[i].enabled_() == src[i].enabled_());
+    assert(dst[i].count_() == src[i].count_());
+    assert(dst[i].name_() == src[i].name_());
+    assert(dst[i].points_.get(i % 16) == src[i].points_.get(i % 16));
+    assert(dst[i].code_() == src[i].code_());
+    assert(dst[i].number_() == src[i].number_());
+  }
+
+  // 容量不足なら失敗
+  size_t small = Count - 1;
+  ser.reset();
+  assert(!TestVer2Schema::deserializeBatch(ser, dst.data(), small));
+  assert(ser.tell() == 0);
+
+  // 差分
+  record::Serializer diffSer{100 * 1000};
+  assert(TestVer2Schema::serializeBatchDiff(diffSer, src.data(), next.data(),
+                                            Count));
+  diffSer.reset();
+  assert(TestVer2Schema::deserializeBatchDiff(diffSer, dst.data(), Count));
+  for (size_t i = 0; i < Count; i++)
+  {
+    assert(dst[i].count_() == next[i].count_());
+    assert(dst[i].bits_() == next[i].bits_());
+    assert(dst[i].points_.get(i % 16) == next[i].points_.get(i % 16));
+    assert(dst[i].number_() == next[i].number_());
+  }
+
+  // 旧バージョンの一括データを新しいスキーマで読む
+  std::vector<Test> oldSrc(3);
+  oldSrc[2].age_ = 77;
+  record::Serializer oldSer{10 * 1000};
+  assert(TestSchema::serializeBatch(oldSer, oldSrc.data(), oldSrc.size()));
+  oldSer.reset();
+  num = dst.size();
+  assert(TestVer2Schema::deserializeBatch(oldSer, dst.data(), num));
+  assert(num == 3);
+  assert(dst[2].age_() == 77);
+
+  // 新しいデータは旧スキーマでは読めない
+  std::vector<Test> oldDst(Count);
+  ser.reset();
+  num = oldDst.size();
+  assert(!TestSchema::deserializeBatch(ser, oldDst.data(), num));
+}
+
 } // namespace
 
+void test_record_pool()
+{
+  record::RecordPool<TestVer2, 64> pool;
+  for (size_t i = 0; i < 150; i++)
+  {
+    auto &rec = pool.emplace();
+    rec.count_ = i;
+    rec.number_ = i * 3;
+  }
+  assert(pool.size() == 150);
+  assert(pool.slabCount() == 3);
+  auto [top, num] = pool.slab(2);
+  assert(top == &pool[128] && num == 22);
+  // レイアウトは最初のインスタンスで確定して共有される
+  assert(decltype(pool)::layout().sealed());
+  assert(decltype(pool)::layout().size() == pool[0].valLink.size());
+
+  // 個別に作ったレコードと同じ結果
+  TestVer2 single;
+  single.count_ = 77;
+  single.number_ = 77 * 3;
+  record::Serializer ser{4096};
+  record::Serializer ref{4096};
+  assert(pool[77].serialize(ser));
+  assert(single.serialize(ref));
+  assert(sameStream(ser, ref));
+
+  ser.reset();
+  assert(single.serializeDiff(ser, pool[10]));
+  ser.reset();
+  assert(single.deserializeDiff(ser));
+  assert(single.count_() == 10);
+  ser.reset();
+  assert(pool[10].valLink.serializeDiff(ser, pool[20].valLink));
+  ser.reset();
+  assert(pool[10].deserializeDiff(ser));
+  assert(pool[10].count_() == 20);
+
+  // 追加の後でも既存のレコードは動かない
+  auto *first = &pool[0];
+  pool.emplace();
+  assert(first == &pool[0]);
+  pool.clear();
+  assert(pool.empty());
+
+  // 共有レイアウトと配置が違うインスタンスは自前の一覧を使う
+  record::RecordLayout shared;
+  {
+    record::RecordLayout::Scope scope{shared};
+    Test base;
+  }
+  assert(shared.sealed() && shared.size() == 7);
+  {
+    record::RecordLayout::Scope scope{shared};
+    TestVer2 longer;
+    longer.count_ = 9;
+    longer.number_ = 300;
+    ser.reset();
+    assert(longer.serialize(ser));
+  }
+  ser.seek(0);
+  TestVer2 read;
+  assert(read.deserialize(ser));
+  assert(read.count_() == 9 && read.number_() == 300);
+  assert(shared.size() == 7);
+
+  // ValueLinkから遠いフィールド(別に確保したもの)も扱える
+  struct NearField
+  {
+    record::ValueLink valLink;
+    record::Value<uint32_t> near_{7, valLink};
+    record::Value<int32_t> far_{-5, valLink};
+  } expect;
+  ref.reset();
+  assert(expect.valLink.serialize(ref));
+  HeapField local;
+  record::RecordPool<HeapField> heapPool;
+  heapPool.emplace();
+  heapPool.emplace();
+  for (const auto *rec : {&local, &heapPool[0], &heapPool[1]})
+  {
+    assert(rec->valLink.size() == 2);
+    ser.reset();
+    assert(rec->valLink.serialize(ser));
+    assert(sameStream(ser, ref));
+  }
+}
+
+void test_packetizer()
+{
+  constexpr size_t Count = 300;
+  constexpr size_t PacketBytes = 256;
+  std::vector<TestVer2> current(Count);
+  std::vector<TestVer2> target(Count);
+  std::vector<TestVer2> remote(Count);
+  for (size_t i = 0; i < Count; i++)
+  {
+    setupBatchSample(target[i], i, 3);
+  }
+
+  // 1tickあたり2パケットまで、続きは次のtickで送る
+  record::Packetizer packetizer{PacketBytes};
+  record::PacketCursor cursor;
+  size_t ticks = 0;
+  size_t sent = 0;
+  auto send = [&](const record::Serializer &packet,
+                  const record::PacketInfo &info)
+  {
+    assert(info.first == sent && info.count > 0);
+    assert(packet.tell() == info.bits);
+    assert(info.bits <= PacketBytes * 8);
+    record::Serializer in{packet.size()};
+    assert(in.appendBits(packet.data(), packet.tell()));
+    in.reset();
+    record::PacketInfo readInfo;
+    assert(record::Packetizer::unpack(in, remote.data(), Count, readInfo));
+    assert(readInfo.first == info.first && readInfo.count == info.count);
+    assert(readInfo.bits == info.bits);
+    sent += info.count;
+    return true;
+  };
+  while (!cursor.finished(Count))
+  {
+    auto packets = packetizer.packetize(current.data(), target.data(), Count,
+                                        cursor, 2, send);
+    assert(packets > 0 && packets <= 2);
+    assert(cursor.next == sent);
+    ticks++;
+  }
+  assert(ticks > 1);
+  const TestVer2 same;
+  const auto unchangedBits = same.valLink.measureDiffBits(same.valLink);
+  for (size_t i = 0; i < Count; i++)
+  {
+    // Atomic: 送ったレコードはcurrentへコピー済み
+    assert(current[i].measureDiffBits(target[i]) == unchangedBits);
+    assert(remote[i].count_() == target[i].count_());
+    assert(remote[i].name_() == target[i].name_());
+    assert(remote[i].number_() == target[i].number_());
+  }
+
+  // DiffOnly: 書くだけでcurrentは変わらない
+  record::Packetizer peek{PacketBytes, record::PacketMode::DiffOnly};
+  target[5].count_ = 5555;
+  record::Serializer packet{PacketBytes};
+  record::PacketCursor from{5};
+  record::PacketInfo info;
+  assert(peek.fill(packet, current.data(), target.data(), Count, from, info));
+  assert(info.first == 5 && from.next == 5 + info.count);
+  assert(current[5].count_() != 5555);
+
+  // パケットに入らないレコードは失敗して位置は戻る
+  record::Packetizer tiny{4};
+  packet.reset();
+  record::PacketCursor stuck{5};
+  assert(!tiny.fill(packet, current.data(), target.data(), Count, stuck, info));
+  assert(stuck.next == 5 && packet.tell() == 0);
+
+  // 範囲外のパケットは読まない
+  packet.reset();
+  from = {Count - 1};
+  assert(peek.fill(packet, current.data(), target.data(), Count, from, info));
+  packet.reset();
+  assert(!record::Packetizer::unpack(packet, remote.data(), Count - 1, info));
+  assert(packet.tell() == 0);
+
+  // 書き済みの分と容量も予算に含める
+  for (size_t i = 10; i < 40; i++)
+  {
+    target[i].count_ = uint32_t(9000 + i);
+  }
+  packet.reset();
+  assert(packet.writeBits(0U, 32));
+  assert(packet.writeBits(0U, 32));
+  from = {10};
+  assert(peek.fill(packet, current.data(), target.data(), Count, from, info));
+  assert(packet.tell() <= PacketBytes * 8 && info.bits == packet.tell() - 64);
+  record::Serializer small{64};
+  from = {10};
+  assert(peek.fill(small, current.data(), target.data(), Count, from, info));
+  assert(info.count > 0 && small.tell() <= 64 * 8);
+
+  // Atomicで途中が失敗したらコピー済みの分だけ送る
+  size_t calls = 0;
+  auto failThird = [&](record::Serializer &ser, TestVer2 &cur,
+                       const TestVer2 &tgt, record::PacketMode mode)
+  {
+    return ++calls != 3 && record::RecordDiffWriter{}(ser, cur, tgt, mode);
+  };
+  packet.reset();
+  record::PacketCursor atomic{10};
+  assert(packetizer.fill(packet, current.data(), target.data(), Count, atomic,
+                         info, failThird));
+  assert(info.first == 10 && info.count == 2 && atomic.next == 12);
+  assert(packet.tell() == info.bits);
+  assert(current[11].count_() == 9011 && current[12].count_() != 9012);
+  record::Serializer in{packet.size()};
+  assert(in.appendBits(packet.data(), packet.tell()));
+  in.reset();
+  record::PacketInfo readInfo;
+  assert(record::Packetizer::unpack(in, remote.data(), Count, readInfo));
+  assert(readInfo.count == 2 && remote[11].count_() == 9011);
+  assert(in.tell() == info.bits);
+
+  // 先頭が失敗したら何も書かない
+  calls = 2;
+  packet.reset();
+  assert(!packetizer.fill(packet, current.data(), target.data(), Count, atomic,
+                          info, failThird));
+  assert(atomic.next == 12 && packet.tell() == 0);
+}
+
+void test_baseline_ring()
+{
+  constexpr size_t Count = 20;
+  std::vector<TestVer2> world(Count);
+  record::BaselineRing<TestVer2, 4> server;
+  record::BaselineRing<TestVer2, 4> client;
+
+  // seq 1..3 を送る(クライアントは受信した状態を同じように保存)
+  for (uint32_t seq = 1; seq <= 3; seq++)
+  {
+    for (size_t i = 0; i < Count; i++)
+    {
+      setupBatchSample(world[i], i, seq);
+    }
+    assert(server.push(seq, world.data(), Count));
+    assert(client.push(seq, world.data(), Count));
+  }
+  assert(server.contains(1) && server.size(3) == Count);
+  assert(!server.contains(9) && server.size(9) == 0);
+
+  // クライアントがseq 1までしかackしていなくても、そこからの差分を作れる
+  TestVer2 scratch;
+  record::Serializer ser{4096};
+  for (size_t i = 0; i < Count; i++)
+  {
+    ser.reset();
+    assert(server.serializeDiff(ser, 1, i, world[i], scratch));
+    const auto diffBits = ser.tell();
+    record::Serializer full{4096};
+    assert(world[i].serialize(full));
+    assert(diffBits <= full.tell());
+
+    TestVer2 applied;
+    assert(client.load(1, i, applied));
+    ser.reset();
+    assert(applied.deserializeDiff(ser));
+    assert(applied.count_() == world[i].count_());
+    assert(applied.name_() == world[i].name_());
+    assert(applied.number_() == world[i].number_());
+    assert(applied.bits_() == world[i].bits_());
+  }
+  // 最新のベースラインからの差分は変化なし
+  TestVer2 same;
+  ser.reset();
+  assert(server.serializeDiff(ser, 3, 7, world[7], scratch));
+  assert(ser.tell() == same.valLink.measureDiffBits(same.valLink));
+
+  // Depthを超えた古いベースラインは消え、範囲外も失敗
+  for (uint32_t seq = 4; seq <= 5; seq++)
+  {
+    assert(server.push(seq, world.data(), Count));
+  }
+  assert(!server.contains(1) && server.contains(2) && server.contains(5));
+  ser.reset();
+  assert(!server.serializeDiff(ser, 1, 0, world[0], scratch));
+  assert(!server.load(5, Count, scratch));
+  assert(server.memoryBytes() > 0);
+
+  server.clear();
+  assert(!server.contains(5));
+}
+
+void test_record_archive()
+{
+  constexpr size_t Frames = 12;
+  auto stateOf = [](size_t n, TestVer2 &rec)
+  {
+    rec.count_ = 1000 + uint32_t(n) * 3;
+    rec.name_ = "frame_" + std::to_string(n % 4);
+    rec.points_.set(n % 16, uint32_t(n * n));
+    rec.number_ = uint32_t(n);
+  };
+
+  // 0と6がキーフレーム、残りは直前からの差分(Plain/RunLength交互)
+  record::ArchiveWriter writer;
+  TestVer2 base;
+  TestVer2 next;
+  for (size_t n = 0; n < Frames; n++)
+  {
+    stateOf(n, next);
+    if (n % 6 == 0)
+    {
+      assert(writer.addKeyframe(next.valLink));
+    }
+    else
+    {
+      auto format =
+          n % 2 ? record::DiffFormat::Plain : record::DiffFormat::RunLength;
+      assert(writer.addDelta(base.valLink, next.valLink, format));
+    }
+    base.valLink.copy(next.valLink);
+  }
+  assert(writer.frameCount() == Frames);
+
+  auto path = std::filesystem::temp_directory_path() /
+              ("record_archive_test_" + std::to_string(::getpid()) + ".bin");
+  assert(writer.save(path.c_str()));
+
+  auto check = [&](const record::ArchiveView &archive)
+  {
+    assert(archive.valid() && archive.frameCount() == Frames);
+    assert(archive.frame(0).keyframe() && !archive.frame(1).keyframe());
+    assert(archive.frame(4).format() == record::DiffFormat::RunLength);
+    assert(archive.frame(3).dataVersion == base.valLink.getDataVersion());
+    assert(archive.keyframeBefore(5) == 0 && archive.keyframeBefore(9) == 6);
+    assert(archive.keyframeBefore(Frames) == Frames);
+    // 任意のフレームへ(順番に関係なく)
+    for (size_t n : {7, 2, 11, 0, 6, 5})
+    {
+      TestVer2 rec;
+      TestVer2 expect;
+      stateOf(n, expect);
+      assert(archive.seek(n, rec.valLink));
+      assert(rec.count_() == expect.count_());
+      assert(rec.name_() == expect.name_());
+      assert(rec.points_.get(n % 16) == expect.points_.get(n % 16));
+      assert(rec.number_() == expect.number_());
+    }
+    TestVer2 rec;
+    assert(!archive.seek(Frames, rec.valLink));
+    // 読み込み専用ビューには書けない
+    auto payload = archive.payload();
+    assert(!payload.writeBits(1U, 1));
+  };
+
+  // mmap
+  auto archive = record::ArchiveView::open(path.c_str());
+  check(archive);
+  auto moved = std::move(archive);
+  assert(!archive.valid());
+  check(moved);
+
+  // メモリ上のイメージ
+  auto bytes = std::filesystem::file_size(path);
+  std::vector<uint64_t> image((bytes + 7) / 8);
+  auto *file = std::fopen(path.c_str(), "rb");
+  assert(file != nullptr);
+  assert(std::fread(image.data(), 1, bytes, file) == bytes);
+  std::fclose(file);
+  check(record::ArchiveView{image.data(), bytes});
+
+  // 壊れたイメージ・存在しないファイル
+  assert(!record::ArchiveView(image.data(), bytes - 1).valid());
+  image[0] ^= 1;
+  assert(!record::ArchiveView(image.data(), bytes).valid());
+  std::filesystem::remove(path);
+  assert(!record::ArchiveView::open(path.c_str()).valid());
+}
+
+void test_compress()
+{
+  constexpr size_t Count = 300;
+  auto stateOf = [](size_t n, TestVer2 &rec)
+  {
+    rec.count_ = 1000 + uint32_t(n % 8);
+    rec.name_ = "player_name_" + std::to_string(n % 5);
+    rec.points_.set(n % 16, uint32_t(n % 3));
+    rec.number_ = uint32_t(n);
+  };
+  record::Serializer snapshot{4096, record::Serializer::Policy::AutoGrow};
+  for (size_t n = 0; n < Count; n++)
+  {
+    TestVer2 rec;
+    stateOf(n, rec);
+    assert(rec.valLink.serialize(snapshot));
+  }
+
+  // 小さいブロックで圧縮し、細切れにfeedして復元
+  constexpr size_t BlockBytes = 1024;
+  auto roundTrip = [&](bool enabled, size_t chunk)
+  {
+    std::vector<uint8_t> packed;
+    record::CompressWriter writer{[&](const uint8_t *data, size_t bytes)
+                                  {
+                                    packed.insert(packed.end(), data,
+                                                  data + bytes);
+                                    return true;
+                                  },
+                                  enabled, BlockBytes};
+    assert(writer.write(snapshot) && writer.finish());
+    assert(writer.stats().rawBytes == snapshot.size());
+    assert(writer.stats().packedBytes == packed.size());
+    assert(writer.stats().blocks == (snapshot.size() + BlockBytes - 1) /
+                                        BlockBytes);
+
+    record::Serializer restored{4096, record::Serializer::Policy::AutoGrow};
+    record::CompressReader reader{[&](const uint8_t *data, size_t bytes)
+                                  { return restored.writeBytes(data, bytes); },
+                                  BlockBytes};
+    for (size_t pos = 0; pos < packed.size(); pos += chunk)
+    {
+      assert(reader.feed(packed.data() + pos,
+                         std::min(chunk, packed.size() - pos)));
+    }
+    assert(reader.idle());
+    assert(reader.stats().rawBytes == snapshot.size());
+    assert(restored.size() == snapshot.size());
+    restored.seek(0);
+    for (size_t n = 0; n < Count; n++)
+    {
+      TestVer2 rec;
+      TestVer2 expect;
+      stateOf(n, expect);
+      assert(rec.valLink.deserialize(restored));
+      assert(rec.name_() == expect.name_());
+      assert(rec.number_() == expect.number_());
+      assert(rec.points_.get(n % 16) == expect.points_.get(n % 16));
+    }
+    return writer.stats();
+  };
+  auto packed = roundTrip(true, 7);
+  assert(packed.ratio() < 0.5 && packed.storedBlocks == 0);
+  roundTrip(true, 100000);
+  // 無効なら全ブロックを無圧縮で格納
+  auto stored = roundTrip(false, 13);
+  assert(stored.storedBlocks == stored.blocks && stored.ratio() > 1.0);
+
+  // コーデック単体: 縮まないデーターと壊れたデーター
+  const auto &codec = record::Lz4BlockCodec::instance();
+  std::vector<uint8_t> noise(4096);
+  uint32_t seed = 12345;
+  for (auto &byte : noise)
+  {
+    seed = seed * 1664525 + 1013904223;
+    byte = uint8_t(seed >> 24);
+  }
+  std::vector<uint8_t> work(codec.bound(noise.size()));
+  auto bytes = codec.compress(noise.data(), noise.size(), work.data(),
+                              work.size());
+  assert(bytes > 0 && bytes <= codec.bound(noise.size()));
+  std::vector<uint8_t> back(noise.size());
+  assert(codec.decompress(work.data(), bytes, back.data(), back.size()));
+  assert(back == noise);
+  assert(codec.compress(noise.data(), noise.size(), work.data(), 16) == 0);
+
+  std::vector<uint8_t> frame;
+  record::CompressWriter noisy{[&](const uint8_t *data, size_t num)
+                               {
+                                 frame.insert(frame.end(), data, data + num);
+                                 return true;
+                               }};
+  assert(noisy.write(noise.data(), noise.size()) && noisy.finish());
+  assert(noisy.stats().storedBlocks == 1);
+
+  std::vector<uint8_t> text(3000, 'a');
+  bytes = codec.compress(text.data(), text.size(), work.data(), work.size());
+  assert(bytes > 0 && bytes < 64);
+  back.resize(text.size());
+  assert(codec.decompress(work.data(), bytes, back.data(), back.size()));
+  assert(std::equal(text.begin(), text.end(), back.begin()));
+  assert(!codec.decompress(work.data(), bytes - 1, back.data(), back.size()));
+  assert(!codec.decompress(work.data(), bytes, back.data(), back.size() - 1));
+
+  // 壊れたヘッダー(元のサイズが上限超え)は拒否
+  frame.clear();
+  record::CompressWriter big{[&](const uint8_t *data, size_t num)
+                             {
+                               frame.insert(frame.end(), data, data + num);
+                               return true;
+                             }};
+  assert(big.write(text.data(), text.size()) && big.finish());
+  record::CompressReader small{[](const uint8_t *, size_t) { return true; },
+                               1024};
+  assert(!small.feed(frame.data(), frame.size()));
+  record::CompressReader reader{[](const uint8_t *, size_t) { return true; }};
+  frame[4] = frame[5] = frame[6] = frame[7] = 0;
+  assert(!reader.feed(frame.data(), frame.size()));
+}
+
+void test_stream_reader()
+{
+  constexpr size_t Count = 40;
+  auto stateOf = [](size_t n, TestVer2 &rec)
+  {
+    rec.count_ = 500 + uint32_t(n);
+    rec.name_ = "stream_" + std::to_string(n % 6);
+    rec.points_.set(n % 16, uint32_t(n * 7));
+    rec.number_ = uint32_t(n * 3);
+  };
+
+  // スナップショット(Count個) + 0番目への差分(RunLength)を続けて書く
+  record::Serializer sender{4096, record::Serializer::Policy::AutoGrow};
+  for (size_t n = 0; n < Count; n++)
+  {
+    TestVer2 rec;
+    stateOf(n, rec);
+    assert(rec.valLink.serialize(sender));
+  }
+  TestVer2 first;
+  TestVer2 changed;
+  stateOf(0, first);
+  stateOf(0, changed);
+  changed.name_ = "stream_changed";
+  changed.number_ = 99;
+  assert(first.valLink.serializeDiff(sender, changed.valLink,
+                                     record::DiffFormat::RunLength));
+  const auto *bytes = static_cast<const uint8_t *>(sender.data());
+
+  for (size_t chunk : {1, 3, 64, 100000})
+  {
+    record::StreamReader reader;
+    size_t decoded = 0;
+    bool diffDone = false;
+    TestVer2 rec;
+    for (size_t pos = 0; pos < sender.size(); pos += chunk)
+    {
+      assert(reader.feed(bytes + pos, std::min(chunk, sender.size() - pos)));
+      while (decoded < Count)
+      {
+        auto status = reader.next(rec.valLink);
+        assert(status != record::StreamStatus::Broken);
+        if (status == record::StreamStatus::NeedMore)
+        {
+          break;
+        }
+        TestVer2 expect;
+        stateOf(decoded, expect);
+        assert(rec.count_() == expect.count_());
+        assert(rec.name_() == expect.name_());
+        assert(rec.points_.get(decoded % 16) ==
+               expect.points_.get(decoded % 16));
+        decoded++;
+      }
+      if (decoded == Count && !diffDone)
+      {
+        // 差分はベースライン(0番目)に適用
+        TestVer2 base;
+        stateOf(0, base);
+        auto status =
+            reader.nextDiff(base.valLink, record::DiffFormat::RunLength);
+        assert(status != record::StreamStatus::Broken);
+        if (status == record::StreamStatus::Record)
+        {
+          assert(base.name_() == "stream_changed" && base.number_() == 99);
+          diffDone = true;
+        }
+        else
+        {
+          // 届いていない差分でベースラインを書き換えていない
+          assert(base.name_() == "stream_0" && base.number_() == 0);
+        }
+      }
+    }
+    assert(decoded == Count && diffDone && reader.idle());
+    assert(reader.next(rec.valLink) == record::StreamStatus::NeedMore);
+  }
+
+  // 途中までしか届いていなければlinkはそのまま
+  record::StreamReader partial;
+  assert(partial.feed(bytes, 5));
+  TestVer2 rec;
+  stateOf(7, rec);
+  assert(partial.next(rec.valLink) == record::StreamStatus::NeedMore);
+  assert(rec.number_() == 21 && !partial.idle());
+  partial.reset();
+  assert(partial.idle() && partial.pendingBytes() == 0);
+
+  // 未読みが上限を超えたら受け付けない
+  record::StreamReader limited{16};
+  assert(limited.feed(bytes, 16));
+  assert(!limited.feed(bytes + 16, 1));
+
+  // 長い文字列が届ききるまでは壊れたデータ扱いしない
+  TestVer2 longRec;
+  longRec.name_ = std::string(3000, 'L');
+  record::Serializer longSer{64, record::Serializer::Policy::AutoGrow};
+  assert(longRec.valLink.serialize(longSer));
+  const auto *longBytes = static_cast<const uint8_t *>(longSer.data());
+  record::StreamReader slow;
+  for (size_t pos = 0; pos < longSer.size(); pos += 64)
+  {
+    assert(slow.next(rec.valLink) == record::StreamStatus::NeedMore);
+    auto len = std::min<size_t>(64, longSer.size() - pos);
+    assert(slow.feed(longBytes + pos, len));
+  }
+  assert(slow.next(rec.valLink) == record::StreamStatus::Record);
+  assert(rec.name_() == longRec.name_());
+
+  // 受信済みの範囲で読めないレコードは待たずに壊れていると返す
+  struct Other
+  {
+    record::ValueLink valLink;
+    record::ValueString text_{"other record", valLink};
+  };
+  Other other;
+  record::Serializer otherSer{256};
+  for (int i = 0; i < 4; i++)
+  {
+    assert(other.valLink.serialize(otherSer));
+  }
+  record::StreamReader wrong;
+  assert(wrong.feed(otherSer.data(), otherSer.size()));
+  assert(wrong.next(rec.valLink) == record::StreamStatus::Broken);
+}
+
+void test_snapshot_slot()
+{
+  // 書き込みスレッドが更新しながら公開し、読み込みスレッドは常に
+  // 一貫した状態(number == count * 2, nameもcountと一致)を読む
+  auto stateOf = [](uint32_t n, TestVer2 &rec)
+  {
+    rec.count_ = n;
+    rec.number_ = n * 2;
+    rec.name_ = "snapshot_" + std::to_string(n);
+    rec.points_.set(n % 16, n);
+  };
+  record::SnapshotSlot slot;
+  TestVer2 empty;
+  record::Serializer out{256};
+  assert(!slot.read(out) && out.tell() == 0);
+  assert(!slot.load(empty.valLink) && slot.generation() == 0);
+
+  constexpr uint32_t Updates = 20000;
+  constexpr size_t Readers = 3;
+  TestVer2 live;
+  stateOf(0, live);
+  assert(slot.publish(live.valLink) && slot.generation() == 1);
+
+  std::atomic<bool> done{false};
+  std::vector<std::thread> readers;
+  std::vector<size_t> reads(Readers, 0);
+  for (size_t r = 0; r < Readers; r++)
+  {
+    readers.emplace_back(
+        [&, r]()
+        {
+          TestVer2 rec;
+          uint32_t last = 0;
+          while (!done.load(std::memory_order_acquire) || reads[r] == 0)
+          {
+            assert(slot.load(rec.valLink));
+            auto count = rec.count_();
+            assert(rec.number_() == count * 2);
+            assert(rec.name_() == "snapshot_" + std::to_string(count));
+            assert(rec.points_.get(count % 16) == count);
+            assert(count >= last);
+            last = count;
+            reads[r]++;
+          }
+        });
+  }
+  for (uint32_t n = 1; n <= Updates; n++)
+  {
+    stateOf(n, live);
+    assert(slot.publish(live.valLink));
+  }
+  done.store(true, std::memory_order_release);
+  for (auto &reader : readers)
+  {
+    reader.join();
+  }
+  assert(slot.generation() == Updates + 1);
+
+  // 読み込みは書き足し(先頭の位置はそのまま)
+  assert(out.writeBits(5U, 3) && slot.read(out));
+  out.seek(3);
+  TestVer2 rec;
+  assert(rec.valLink.deserialize(out) && rec.count_() == Updates);
+
+  // 上限を超えるレコードは公開しない(前の公開分が残る)
+  record::SnapshotSlot small{(empty.valLink.measureBits() + 7) / 8};
+  assert(small.publish(empty.valLink));
+  live.name_ = std::string(64, 'x');
+  assert(!small.publish(live.valLink) && small.generation() == 1);
+  assert(small.load(rec.valLink) && rec.name_() == empty.name_());
+}
+
+// 全フィールドがバイト列として扱えるレコード
+struct PlainRecord
+{
+  record::ValueLink valLink;
+  record::Value<uint32_t> count_{0, valLink};
+  record::Value<uint8_t> age_{0, valLink};
+  record::ValueBool enabled_{false, valLink};
+  record::ValueArray<int16_t, 8> points_{0, valLink};
+  record::ValueVersion ver_1{valLink};
+  record::Value<uint64_t> id_{0, valLink};
+  record::ValueBits<uint32_t> bits_{0, valLink};
+};
+
+// 下位ビットを無視して比べる値(派生型)
+class CoarseValue : public record::Value<uint32_t>
+{
+public:
+  uint32_t scale_ = 1;
+
+  CoarseValue(record::ValueLink &link) : record::Value<uint32_t>(0, link) {}
+  using record::Value<uint32_t>::operator=;
+  [[nodiscard]] bool equal(const ValueInterface &other) const override
+  {
+    const auto *oval = dynamic_cast<const CoarseValue *>(&other);
+    return oval != nullptr && scale_ == oval->scale_ &&
+           (*this)() / 8 == (*oval)() / 8;
+  }
+};
+
+struct DerivedRecord
+{
+  record::ValueLink valLink;
+  record::Value<uint32_t> count_{0, valLink};
+  CoarseValue level_{valLink};
+};
+
+struct FloatRecord
+{
+  record::ValueLink valLink;
+  record::Value<uint32_t> count_{0, valLink};
+  record::ValueFloat speed_{0.0f, valLink};
+};
+
+void test_bulk_copy()
+{
+  auto fill = [](PlainRecord &rec, uint32_t n)
+  {
+    rec.count_ = n;
+    rec.age_ = uint8_t(n + 1);
+    rec.enabled_ = (n % 2) != 0;
+    rec.points_.set(n % 8, int16_t(-int(n)));
+    rec.id_ = 0x123456789ULL * n;
+    rec.bits_.set(n % 32, true);
+  };
+
+  record::RecordPool<PlainRecord> pool;
+  auto &src = pool.emplace();
+  auto &dst = pool.emplace();
+  assert(src.valLink.isBulkCopyable() && dst.valLink.isBulkCopyable());
+  fill(src, 7);
+  assert(!dst.valLink.equal(src.valLink));
+
+  dst.valLink.enableDirtyTracking();
+  dst.valLink.clearDirty();
+  auto generation = dst.valLink.generation();
+  dst.valLink.copy(src.valLink);
+  assert(dst.valLink.equal(src.valLink));
+  assert(dst.count_() == 7 && dst.age_() == 8 && dst.enabled_());
+  assert(dst.points_.get(7) == -7 && dst.id_() == 0x123456789ULL * 7);
+  assert(dst.bits_.get(7));
+  assert(dst.valLink.generation() != generation);
+  for (size_t i = 0; i < dst.valLink.size(); i++)
+  {
+    assert(dst.valLink.isDirty(i));
+  }
+  // 値だけを写すので、コピー先のフィールドは追跡の通知先を保つ
+  dst.valLink.clearDirty();
+  dst.age_ = 9;
+  assert(dst.valLink.isDirty(1) && !dst.valLink.isDirty(0));
+  dst.age_ = 8;
+  // エンコード結果もフィールドごとのコピーと同じ
+  record::Serializer a{256};
+  record::Serializer b{256};
+  assert(src.valLink.serialize(a) && dst.valLink.serialize(b));
+  assert(sameStream(a, b));
+
+  // どのフィールドの違いも検出する
+  auto differs = [&](auto change)
+  {
+    dst.valLink.copy(src.valLink);
+    change(dst);
+    return !dst.valLink.equal(src.valLink) && !src.valLink.equal(dst.valLink);
+  };
+  assert(differs([](PlainRecord &rec) { rec.count_ = 8; }));
+  assert(differs([](PlainRecord &rec) { rec.age_ = 0; }));
+  assert(differs([](PlainRecord &rec) { rec.enabled_ = false; }));
+  assert(differs([](PlainRecord &rec) { rec.points_.set(0, 1); }));
+  assert(differs([](PlainRecord &rec) { rec.id_ = 1; }));
+  assert(differs([](PlainRecord &rec) { rec.bits_.set(31, true); }));
+
+  // パディングの内容は比較に影響しない
+  alignas(PlainRecord) unsigned char storage[sizeof(PlainRecord)];
+  std::memset(storage, 0xab, sizeof(storage));
+  PlainRecord *dirty;
+  {
+    record::RecordLayout::Scope scope{record::RecordLayout::of<PlainRecord>()};
+    dirty = new (storage) PlainRecord;
+  }
+  assert(dirty->valLink.isBulkCopyable());
+  fill(*dirty, 7);
+  assert(dirty->valLink.equal(src.valLink));
+  dirty->~PlainRecord();
+
+  // 共有レイアウトでなければフィールドごと(結果は同じ)
+  PlainRecord local;
+  assert(!local.valLink.isBulkCopyable());
+  local.valLink.copy(src.valLink);
+  assert(local.valLink.equal(src.valLink) && local.id_() == src.id_());
+
+  // 派生した型はバイト列として扱わない(上書きした比較を使う)
+  record::RecordPool<DerivedRecord> derived;
+  auto &d0 = derived.emplace();
+  auto &d1 = derived.emplace();
+  assert(!d0.valLink.isBulkCopyable());
+  d1.level_ = 5;
+  assert(d0.valLink.equal(d1.valLink));
+  d1.level_.scale_ = 2;
+  assert(!d0.valLink.equal(d1.valLink));
+
+  // 対象外の型を含むレコード
+  record::RecordPool<Test> tests;
+  assert(!tests.emplace().valLink.isBulkCopyable());
+  record::RecordPool<FloatRecord> floats;
+  auto &f0 = floats.emplace();
+  auto &f1 = floats.emplace();
+  assert(!f0.valLink.isBulkCopyable());
+  f1.speed_ = 1.5f;
+  f0.valLink.copy(f1.valLink);
+  assert(f0.valLink.equal(f1.valLink) && f0.speed_() == 1.5f);
+}
+
+void test_parallel_serialize()
+{
+  constexpr size_t Count = 257;
+  std::vector<TestVer2> records(Count);
+  for (size_t i = 0; i < Count; i++)
+  {
+    auto &rec = records[i];
+    rec.count_ = i * 31;
+    rec.age_ = i % 200;
+    rec.points_.set(i % 16, i);
+    rec.enabled_ = (i & 1) != 0;
+    rec.number_ = i * i;
+  }
+
+  // 逐次書き込みの結果と同じビット列・オフセットになる
+  record::Serializer seqSer{256 * 1024};
+  std::vector<size_t> seqOffsets;
+  seqSer.writeBits64(5, 3);
+  for (const auto &rec : records)
+  {
+    seqOffsets.push_back(seqSer.tell());
+    assert(rec.serialize(seqSer));
+  }
+  for (size_t workers : {1, 3, 8})
+  {
+    record::Serializer ser{256 * 1024};
+    ser.writeBits64(5, 3);
+    std::vector<size_t> offsets;
+    assert(record::serializeParallel(ser, records.data(), Count, offsets,
+                                     workers));
+    assert(offsets == seqOffsets);
+    assert(sameStream(ser, seqSer));
+
+    std::vector<TestVer2> decoded(Count);
+    ser.seek(0);
+    assert(record::deserializeParallel(ser, decoded.data(), offsets, workers));
+    assert(ser.tell() == seqSer.tell());
+    for (size_t i = 0; i < Count; i++)
+    {
+      // 区切りはequalで一致扱いにならないのでフィールドごとに比べる
+      assert(TestSchema::equal(decoded[i], records[i]));
+      assert(decoded[i].number_() == records[i].number_());
+    }
+  }
+
+  // 書き込み関数を指定(静的スキーマ)
+  record::Serializer schemaSer{256 * 1024};
+  std::vector<size_t> offsets;
+  assert(record::serializeParallel(
+      schemaSer, records.data(), Count, offsets, 4,
+      [](record::Serializer &ser, const TestVer2 &rec)
+      { return TestVer2Schema::serialize(ser, rec); }));
+  std::vector<TestVer2> decoded(Count);
+  assert(record::deserializeParallel(
+      schemaSer, decoded.data(), offsets, 4,
+      [](record::Serializer &ser, TestVer2 &rec)
+      { return TestVer2Schema::deserialize(ser, rec); }));
+  assert(TestSchema::equal(decoded[Count - 1], records[Count - 1]));
+  assert(decoded[Count - 1].number_() == records[Count - 1].number_());
+
+  // 容量不足は失敗し、位置は戻る
+  record::Serializer small{64};
+  assert(!record::serializeParallel(small, records.data(), Count, offsets, 2));
+  assert(small.tell() == 0);
+
+  // 使い回すワーカー群でも同じ結果になる
+  record::WorkerPool pool{2};
+  assert(pool.concurrency() == 3);
+  for (size_t round = 0; round < 2; round++)
+  {
+    record::Serializer ser{256 * 1024};
+    ser.writeBits64(5, 3);
+    assert(
+        record::serializeParallel(pool, ser, records.data(), Count, offsets));
+    assert(offsets == seqOffsets);
+    assert(sameStream(ser, seqSer));
+    std::vector<TestVer2> pooled(Count);
+    ser.seek(0);
+    assert(record::deserializeParallel(pool, ser, pooled.data(), offsets));
+    assert(TestSchema::equal(pooled[Count - 1], records[Count - 1]));
+  }
+  // ワーカー数がスレッド数より多くても全番号を1回ずつ実行する
+  std::vector<std::atomic<int>> visits(16);
+  assert(pool.run(visits.size(),
+                  [&](size_t w)
+                  {
+                    visits[w]++;
+                    return true;
+                  }));
+  for (const auto &visit : visits)
+  {
+    assert(visit == 1);
+  }
+
+  // 書き込み関数の例外は全スレッドを待ってから呼び出し側へ投げ直す
+  auto throwing = [](record::Serializer &ser, const TestVer2 &rec)
+  {
+    if (rec.count_() == 200 * 31)
+    {
+      throw std::runtime_error("writer");
+    }
+    return rec.serialize(ser);
+  };
+  auto throws = [&](auto call)
+  {
+    try
+    {
+      call();
+    }
+    catch (const std::runtime_error &)
+    {
+      return true;
+    }
+    return false;
+  };
+  assert(throws(
+      [&]()
+      {
+        record::Serializer ser{256 * 1024};
+        record::serializeParallel(ser, records.data(), Count, offsets, 4,
+                                  throwing);
+      }));
+  assert(throws(
+      [&]()
+      {
+        record::Serializer ser{256 * 1024};
+        record::serializeParallel(pool, ser, records.data(), Count, offsets,
+                                  throwing);
+      }));
+  // 例外の後もワーカー群は使える
+  record::Serializer after{256 * 1024};
+  after.writeBits64(5, 3);
+  assert(
+      record::serializeParallel(pool, after, records.data(), Count, offsets));
+  assert(sameStream(after, seqSer));
+}
+
 int main()
 {
   test_bool_io();
+  test_bit_stream_words();
+  test_append_streams();
+  test_external_and_growable_buffer();
   test_cross_version_serialize_deserialize();
   test_diff_roundtrip();
   test_diff_and_copy();
   test_bitfield_size_migration();
+  test_bulk_array_and_bitfield();
+  test_packed_array();
+  test_signed_zigzag();
+  test_float_values();
+  test_long_string();
+  test_string_patch_and_dictionary();
+  test_string_truncated();
+  test_fixed_string();
+  test_static_schema_matches_link();
+  test_dirty_tracking();
+  test_run_length_diff();
+  test_encode_cache();
+  test_encode_stats();
+  test_measure_bits();
+  test_field_index();
+  test_skip_scan();
+  test_batch_columns();
+  test_parallel_serialize();
+  test_packetizer();
+  test_baseline_ring();
+  test_record_archive();
+  test_compress();
+  test_stream_reader();
+  test_snapshot_slot();
+  test_bulk_copy();
+  test_record_pool();
   return 0;
 }
@@ -0,0 +1,635 @@
+#include "record.h"
+#include "record_bits.h"
+#include "serialize.h"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <format>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+//
+// エンコーダーごとのマイクロベンチマーク
+// 各ケースは目標時間に届くまで反復回数を増やして計測し(Google Benchmark風)、
+// ns/op・bytes/op・bits/field をテキストかJSONで出力する
+//
+
+namespace
+{
+
+enum class Distribution
+{
+  Zero,
+  Small,
+  Random,
+};
+
+constexpr std::array<Distribution, 3> kDistributions = {
+    Distribution::Zero, Distribution::Small, Distribution::Random};
+
+std::string_view distributionName(Distribution dist)
+{
+  switch (dist)
+  {
+  case Distribution::Zero:
+    return "zero";
+  case Distribution::Small:
+    return "small";
+  case Distribution::Random:
+    return "random";
+  }
+  return "";
+}
+
+constexpr size_t kItemCount = 256;
+constexpr size_t kBufferBytes = 4 * 1024 * 1024;
+constexpr uint64_t kDefaultMinTimeMs = 20;
+constexpr uint64_t kMaxIterations = 1ULL << 30;
+constexpr uint64_t kSeed = 12345;
+
+using Rng = std::mt19937_64;
+
+struct BenchResult
+{
+  std::string name;
+  uint64_t iterations;
+  double nsPerOp;
+  double bytesPerOp;
+  double bitsPerField;
+};
+
+struct Options
+{
+  bool json = false;
+  std::string filter;
+  uint64_t minTimeNs = kDefaultMinTimeMs * 1000 * 1000;
+};
+
+void require(bool result, std::string_view name)
+{
+  if (!result)
+  {
+    std::cerr << std::format("benchmark failed: {}\n", name);
+    std::exit(1);
+  }
+}
+
+template <class Func>
+uint64_t measureNs(Func func)
+{
+  const auto start = std::chrono::steady_clock::now();
+  func();
+  const auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+      .count();
+}
+
+class Runner
+{
+  Options options_;
+  std::vector<BenchResult> results_;
+
+public:
+  explicit Runner(Options options) : options_(std::move(options)) {}
+
+  [[nodiscard]] bool enabled(std::string_view name) const
+  {
+    return options_.filter.empty() ||
+           name.find(options_.filter) != std::string_view::npos;
+  }
+
+  // pass: ops個の処理を1回行い、処理したビット数を返す(失敗時はfalse)
+  template <class Pass>
+  void run(const std::string &name, size_t ops, size_t fieldsPerOp, Pass pass)
+  {
+    if (!enabled(name))
+    {
+      return;
+    }
+    size_t bits = 0;
+    require(pass(bits), name);
+
+    uint64_t iterations = 1;
+    uint64_t total = 0;
+    for (;;)
+    {
+      total = measureNs(
+          [&]()
+          {
+            for (uint64_t iter = 0; iter < iterations; ++iter)
+            {
+              size_t passBits = 0;
+              require(pass(passBits), name);
+            }
+          });
+      if (total >= options_.minTimeNs || iterations >= kMaxIterations)
+      {
+        break;
+      }
+      // 目標時間を少し超える回数まで増やす(最大10倍ずつ)
+      auto scaled = total == 0 ? iterations * 10
+                               : iterations * options_.minTimeNs * 14 /
+                                         (total * 10) +
+                                     1;
+      iterations = std::min({scaled, iterations * 10, kMaxIterations});
+    }
+
+    const auto totalOps =
+        static_cast<double>(iterations) * static_cast<double>(ops);
+    results_.push_back(
+        {name, iterations, static_cast<double>(total) / totalOps,
+         static_cast<double>(bits) / 8.0 / static_cast<double>(ops),
+         static_cast<double>(bits) / static_cast<double>(ops * fieldsPerOp)});
+    if (!options_.json)
+    {
+      printText(results_.back());
+    }
+  }
+
+  static void printText(const BenchResult &result)
+  {
+    std::cout << std::format(
+        "{:<44} {:>10.2f} ns/op {:>9.2f} B/op {:>7.2f} bits/field"
+        " {:>10} iters\n",
+        result.name, result.nsPerOp, result.bytesPerOp, result.bitsPerField,
+        result.iterations);
+  }
+
+  // Google Benchmarkの--benchmark_format=jsonに近い形式
+  void printJson(std::string_view executable) const
+  {
+    std::cout << "{\n  \"context\": {\n";
+    std::cout << std::format("    \"executable\": \"{}\",\n", executable);
+    std::cout << std::format("    \"items\": {},\n", kItemCount);
+    std::cout << std::format("    \"min_time_ns\": {}\n", options_.minTimeNs);
+    std::cout << "  },\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results_.size(); ++i)
+    {
+      const auto &result = results_[i];
+      std::cout << std::format(
+          "    {{\"name\": \"{}\", \"iterations\": {}, \"real_time\": {:.4f}, "
+          "\"time_unit\": \"ns\", \"bytes_per_op\": {:.4f}, "
+          "\"bits_per_field\": {:.4f}}}{}\n",
+          result.name, result.iterations, result.nsPerOp, result.bytesPerOp,
+          result.bitsPerField, i + 1 < results_.size() ? "," : "");
+    }
+    std::cout << "  ]\n}\n";
+  }
+};
+
+//
+// データ生成
+//
+template <class NType>
+NType sampleNumber(Distribution dist, Rng &rng)
+{
+  if (dist == Distribution::Zero)
+  {
+    return NType{};
+  }
+  if constexpr (std::is_floating_point_v<NType>)
+  {
+    if (dist == Distribution::Small)
+    {
+      return NType(std::uniform_real_distribution<double>(-0.01, 0.01)(rng));
+    }
+    return NType(std::uniform_real_distribution<double>(-1.0e6, 1.0e6)(rng));
+  }
+  else
+  {
+    if (dist == Distribution::Small)
+    {
+      if constexpr (std::is_signed_v<NType>)
+      {
+        return NType(std::uniform_int_distribution<int>(-8, 8)(rng));
+      }
+      return NType(std::uniform_int_distribution<int>(0, 15)(rng));
+    }
+    return NType(rng());
+  }
+}
+
+// 折り返しありの加算(符号付きのオーバーフローを避ける)
+template <class NType>
+NType addNumber(NType base, NType delta)
+{
+  if constexpr (std::is_floating_point_v<NType>)
+  {
+    return base + delta;
+  }
+  else
+  {
+    using UType = std::make_unsigned_t<NType>;
+    return NType(UType(UType(base) + UType(delta)));
+  }
+}
+
+std::string sampleString(size_t length, Rng &rng)
+{
+  std::uniform_int_distribution<int> letter('a', 'z');
+  std::string text(length, ' ');
+  for (auto &ch : text)
+  {
+    ch = char(letter(rng));
+  }
+  return text;
+}
+
+//
+// 単体フィールドのベンチマーク
+// value: 分布どおりの値(serialize/deserialize)
+// base -> next: 分布どおりの差分(serializeDiff/deserializeDiff)
+// fields: 1フィールドあたりの要素数(bits/fieldは要素あたり)
+//
+template <class Field>
+struct FieldHolder
+{
+  record::ValueLink valLink;
+  Field value{{}, valLink};
+};
+
+template <class Field>
+using FieldList = std::vector<FieldHolder<Field>>;
+
+template <class Field, class Fill>
+void runFieldBenches(Runner &runner, std::string_view type, size_t fields,
+                     Fill fill)
+{
+  for (auto dist : kDistributions)
+  {
+    auto name = [&](std::string_view op)
+    { return std::format("{}/{}/{}", type, op, distributionName(dist)); };
+    Rng rng{kSeed};
+    FieldList<Field> values(kItemCount);
+    FieldList<Field> base(kItemCount);
+    FieldList<Field> next(kItemCount);
+    for (size_t i = 0; i < kItemCount; ++i)
+    {
+      fill(values[i].value, base[i].value, next[i].value, dist, rng);
+    }
+
+    record::Serializer ser{kBufferBytes};
+    runner.run(name("serialize"), kItemCount, fields,
+               [&](size_t &bits)
+               {
+                 ser.reset();
+                 for (const auto &item : values)
+                 {
+                   if (!item.value.serialize(ser))
+                   {
+                     return false;
+                   }
+                 }
+                 bits = ser.tell();
+                 return true;
+               });
+    runner.run(name("serializeDiff"), kItemCount, fields,
+               [&](size_t &bits)
+               {
+                 ser.reset();
+                 for (size_t i = 0; i < kItemCount; ++i)
+                 {
+                   if (!base[i].value.serializeDiff(ser, next[i].value))
+                   {
+                     return false;
+                   }
+                 }
+                 bits = ser.tell();
+                 return true;
+               });
+
+    record::Serializer encoded{kBufferBytes};
+    record::Serializer encodedDiff{kBufferBytes};
+    for (size_t i = 0; i < kItemCount; ++i)
+    {
+      require(values[i].value.serialize(encoded) &&
+                  base[i].value.serializeDiff(encodedDiff, next[i].value),
+              type);
+    }
+    FieldList<Field> decoded(kItemCount);
+    runner.run(name("deserialize"), kItemCount, fields,
+               [&](size_t &bits)
+               {
+                 encoded.reset();
+                 for (auto &item : decoded)
+                 {
+                   if (!item.value.deserialize(encoded))
+                   {
+                     return false;
+                   }
+                 }
+                 bits = encoded.tell();
+                 return true;
+               });
+    // 差分は同じ基準値に毎回適用する
+    runner.run(name("deserializeDiff"), kItemCount, fields,
+               [&](size_t &bits)
+               {
+                 encodedDiff.reset();
+                 for (size_t i = 0; i < kItemCount; ++i)
+                 {
+                   decoded[i].value.copy(base[i].value);
+                   if (!decoded[i].value.deserializeDiff(encodedDiff))
+                   {
+                     return false;
+                   }
+                 }
+                 bits = encodedDiff.tell();
+                 return true;
+               });
+    // 値を作らない読み飛ばし
+    runner.run(name("skip"), kItemCount, fields,
+               [&](size_t &bits)
+               {
+                 encoded.reset();
+                 for (const auto &item : decoded)
+                 {
+                   if (!item.value.skip(encoded))
+                   {
+                     return false;
+                   }
+                 }
+                 bits = encoded.tell();
+                 return true;
+               });
+    runner.run(name("skipDiff"), kItemCount, fields,
+               [&](size_t &bits)
+               {
+                 encodedDiff.reset();
+                 for (const auto &item : decoded)
+                 {
+                   if (!item.value.skipDiff(encodedDiff))
+                   {
+                     return false;
+                   }
+                 }
+                 bits = encodedDiff.tell();
+                 return true;
+               });
+  }
+}
+
+template <class NType>
+void runNumberBenches(Runner &runner, std::string_view type)
+{
+  using Field = std::conditional_t<std::is_floating_point_v<NType>,
+                                   record::ValueReal<NType>,
+                                   record::Value<NType>>;
+  runFieldBenches<Field>(
+      runner, type, 1,
+      [](Field &value, Field &base, Field &next, Distribution dist, Rng &rng)
+      {
+        value = sampleNumber<NType>(dist, rng);
+        auto from = sampleNumber<NType>(Distribution::Random, rng);
+        base = from;
+        next = addNumber(from, sampleNumber<NType>(dist, rng));
+      });
+}
+
+void runStringBenches(Runner &runner, size_t length)
+{
+  using Field = record::ValueString;
+  runFieldBenches<Field>(
+      runner, std::format("ValueString<{}>", length), 1,
+      [length](Field &value, Field &base, Field &next, Distribution dist,
+               Rng &rng)
+      {
+        auto from = sampleString(length, rng);
+        value = from;
+        base = from;
+        if (dist == Distribution::Small)
+        {
+          from[from.size() / 2] = '#';
+        }
+        else if (dist == Distribution::Random)
+        {
+          from = sampleString(length, rng);
+        }
+        next = from;
+      });
+}
+
+template <class Array>
+void runArrayBenches(Runner &runner, std::string_view type)
+{
+  using NType = std::remove_cvref_t<decltype(std::declval<Array &>().get(0))>;
+  runFieldBenches<Array>(
+      runner, type, Array::size(),
+      [](Array &value, Array &base, Array &next, Distribution dist, Rng &rng)
+      {
+        for (size_t i = 0; i < Array::size(); ++i)
+        {
+          value.set(i, sampleNumber<NType>(dist, rng));
+          auto from = sampleNumber<NType>(Distribution::Random, rng);
+          base.set(i, from);
+          next.set(i, addNumber(from, sampleNumber<NType>(dist, rng)));
+        }
+      });
+}
+
+//
+// serializeBitField
+//
+struct BitRecord
+{
+  uint32_t kind : 4;
+  uint32_t flags : 12;
+  uint32_t value : 16;
+};
+
+void runBitFieldBenches(Runner &runner)
+{
+  for (auto dist : kDistributions)
+  {
+    Rng rng{kSeed};
+    std::vector<BitRecord> data(kItemCount);
+    for (auto &item : data)
+    {
+      auto word = dist == Distribution::Random ? rng() : 0;
+      if (dist == Distribution::Small)
+      {
+        word = sampleNumber<uint32_t>(dist, rng);
+      }
+      item.kind = word & 0xf;
+      item.flags = (word >> 4) & 0xfff;
+      item.value = (word >> 16) & 0xffff;
+    }
+    record::Serializer ser{kBufferBytes};
+    runner.run(std::format("serializeBitField/{}", distributionName(dist)),
+               kItemCount, 1,
+               [&](size_t &bits)
+               {
+                 ser.reset();
+                 if (!record::serializeBitField(ser, data.data(), data.size()))
+                 {
+                   return false;
+                 }
+                 bits = ser.tell();
+                 return true;
+               });
+    std::vector<BitRecord> decoded(kItemCount);
+    runner.run(std::format("deserializeBitField/{}", distributionName(dist)),
+               kItemCount, 1,
+               [&](size_t &bits)
+               {
+                 ser.reset();
+                 size_t num = decoded.size();
+                 if (!record::deserializeBitField(ser, decoded.data(), num))
+                 {
+                   return false;
+                 }
+                 bits = ser.tell();
+                 return num == decoded.size();
+               });
+  }
+}
+
+//
+// writeBits64/readBits64: ワード境界にそろった場合と毎回またぐ場合
+//
+void runBitStreamBenches(Runner &runner)
+{
+  Rng rng{kSeed};
+  std::vector<uint64_t> words(kItemCount);
+  for (auto &word : words)
+  {
+    word = rng();
+  }
+  for (size_t shift : {0, 3})
+  {
+    const auto *kind = shift == 0 ? "aligned" : "straddle";
+    record::Serializer ser{kBufferBytes};
+    runner.run(std::format("writeBits64/{}", kind), kItemCount, 1,
+               [&](size_t &bits)
+               {
+                 ser.reset();
+                 if (shift > 0 && !ser.writeBits64(0, shift))
+                 {
+                   return false;
+                 }
+                 for (auto word : words)
+                 {
+                   if (!ser.writeBits64(word, 64))
+                   {
+                     return false;
+                   }
+                 }
+                 bits = ser.tell() - shift;
+                 return true;
+               });
+    runner.run(std::format("readBits64/{}", kind), kItemCount, 1,
+               [&](size_t &bits)
+               {
+                 ser.seek(shift);
+                 uint64_t sum = 0;
+                 for (size_t i = 0; i < kItemCount; ++i)
+                 {
+                   uint64_t word;
+                   if (!ser.readBits64(word, 64))
+                   {
+                     return false;
+                   }
+                   sum ^= word;
+                 }
+                 bits = ser.tell() - shift;
+                 return sum != 0;
+               });
+  }
+}
+
+bool parseNumber(std::string_view text, uint64_t &out)
+{
+  const std::string arg{text};
+  char *end = nullptr;
+  const auto val = std::strtoull(arg.c_str(), &end, 10);
+  if (end == arg.c_str() || *end != '\0')
+  {
+    return false;
+  }
+  out = val;
+  return true;
+}
+
+void printUsage(const char *progName)
+{
+  std::cout << "Usage: " << progName
+            << " [--json] [--filter=<substring>] [--min_time_ms=<ms>]\n";
+  std::cout << std::format("  defaults: min_time_ms={}\n", kDefaultMinTimeMs);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  Options options;
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string_view arg{argv[i]};
+    uint64_t ms = 0;
+    if (arg == "--json")
+    {
+      options.json = true;
+    }
+    else if (arg.starts_with("--filter="))
+    {
+      options.filter = arg.substr(std::string_view("--filter=").size());
+    }
+    else if (arg.starts_with("--min_time_ms=") &&
+             parseNumber(arg.substr(std::string_view("--min_time_ms=").size()),
+                         ms))
+    {
+      options.minTimeNs = ms * 1000 * 1000;
+    }
+    else
+    {
+      printUsage(argv[0]);
+      return arg == "-h" || arg == "--help" ? 0 : 1;
+    }
+  }
+
+  Runner runner{options};
+  runNumberBenches<uint8_t>(runner, "Value<uint8_t>");
+  runNumberBenches<uint16_t>(runner, "Value<uint16_t>");
+  runNumberBenches<uint32_t>(runner, "Value<uint32_t>");
+  runNumberBenches<uint64_t>(runner, "Value<uint64_t>");
+  runNumberBenches<int8_t>(runner, "Value<int8_t>");
+  runNumberBenches<int16_t>(runner, "Value<int16_t>");
+  runNumberBenches<int32_t>(runner, "Value<int32_t>");
+  runNumberBenches<int64_t>(runner, "Value<int64_t>");
+  runNumberBenches<float>(runner, "ValueFloat");
+  runNumberBenches<double>(runner, "ValueDouble");
+  for (size_t length : {8, 32, 128, 1024})
+  {
+    runStringBenches(runner, length);
+  }
+  runArrayBenches<record::ValueArray<uint8_t, 32>>(runner,
+                                                   "ValueArray<uint8_t,32>");
+  runArrayBenches<record::ValueArray<uint16_t, 32>>(runner,
+                                                    "ValueArray<uint16_t,32>");
+  runArrayBenches<record::ValueArray<uint32_t, 32>>(runner,
+                                                    "ValueArray<uint32_t,32>");
+  runArrayBenches<record::ValueArray<uint64_t, 32>>(runner,
+                                                    "ValueArray<uint64_t,32>");
+  runArrayBenches<record::ValueArray<int32_t, 32>>(runner,
+                                                   "ValueArray<int32_t,32>");
+  runArrayBenches<
+      record::ValueArray<uint32_t, 32, record::ArrayFormat::Packed>>(
+      runner, "ValueArray<uint32_t,32,Packed>");
+  runArrayBenches<record::ValueArray<float, 32>>(runner,
+                                                 "ValueArray<float,32>");
+  runBitFieldBenches(runner);
+  runBitStreamBenches(runner);
+
+  if (options.json)
+  {
+    runner.printJson(argv[0]);
+  }
+  return 0;
+}
@@ -1,4 +1,5 @@
 #include "record.h"
+#include "record_schema.h"
 #include "serialize.h"
 
 #include <cassert>
@@ -58,6 +59,11 @@ struct TestVer2 : public Test
   vuint32_t number_{100, valLink};
 };
 
+using TestVer2Schema =
+    record::Schema<&Test::enabled_, &Test::count_, &Test::name_, &Test::age_,
+                   &Test::points_, &Test::bits_, &Test::code_,
+                   &TestVer2::ver_1, &TestVer2::number_>;
+
 struct BenchResult
 {
   std::string name;
@@ -121,6 +127,96 @@ BenchResult runSerializeBench(const std::vector<TestVer2> &src, size_t iteration
   return {"serialize", payloadSize, total};
 }
 
+BenchResult runSchemaSerializeBench(const std::vector<TestVer2> &src,
+                                    size_t iterations, size_t bufferBytes)
+{
+  record::Serializer ser{bufferBytes};
+  size_t payloadSize = 0;
+  const auto total = measureNs(
+      [&]()
+      {
+        for (size_t iter = 0; iter < iterations; ++iter)
+        {
+          ser.reset();
+          for (const auto &v : src)
+          {
+            assert(TestVer2Schema::serialize(ser, v));
+          }
+          payloadSize = ser.size();
+        }
+      });
+  return {"serialize(schema)", payloadSize, total};
+}
+
+BenchResult runCachedSerializeBench(std::vector<TestVer2> &src,
+                                   size_t iterations, size_t bufferBytes)
+{
+  // 変化のないレコードはキャッシュの連結だけになる
+  for (auto &v : src)
+  {
+    v.valLink.enableEncodeCache();
+  }
+  record::Serializer ser{bufferBytes};
+  size_t payloadSize = 0;
+  const auto total = measureNs(
+      [&]()
+      {
+        for (size_t iter = 0; iter < iterations; ++iter)
+        {
+          ser.reset();
+          for (const auto &v : src)
+          {
+            assert(v.serialize(ser));
+          }
+          payloadSize = ser.size();
+        }
+      });
+  for (auto &v : src)
+  {
+    v.valLink.disableEncodeCache();
+  }
+  return {"serialize(cached)", payloadSize, total};
+}
+
+BenchResult runBatchSerializeBench(const std::vector<TestVer2> &src,
+                                   size_t iterations, size_t bufferBytes)
+{
+  record::Serializer ser{bufferBytes};
+  size_t payloadSize = 0;
+  const auto total = measureNs(
+      [&]()
+      {
+        for (size_t iter = 0; iter < iterations; ++iter)
+        {
+          ser.reset();
+          assert(TestVer2Schema::serializeBatch(ser, src.data(), src.size()));
+          payloadSize = ser.size();
+        }
+      });
+  return {"serialize(batch)", payloadSize, total};
+}
+
+BenchResult runBatchDeserializeBench(const std::vector<TestVer2> &src,
+                                     size_t iterations, size_t bufferBytes)
+{
+  record::Serializer payloadSer{bufferBytes};
+  assert(TestVer2Schema::serializeBatch(payloadSer, src.data(), src.size()));
+  const size_t payloadSize = payloadSer.size();
+
+  std::vector<TestVer2> dst(src.size());
+  const auto total = measureNs(
+      [&]()
+      {
+        for (size_t iter = 0; iter < iterations; ++iter)
+        {
+          payloadSer.reset();
+          size_t num = dst.size();
+          assert(TestVer2Schema::deserializeBatch(payloadSer, dst.data(), num));
+        }
+      });
+  return {"deserialize(batch)", payloadSize, total};
+}
+
 BenchResult runDeserializeBench(const std::vector<TestVer2> &src,
                                 size_t iterations, size_t bufferBytes)
 {
@@ -170,6 +266,31 @@ BenchResult runSerializeDiffBench(const std::vector<TestVer2> &base,
   return {"serializeDiff", payloadSize, total};
 }
 
+BenchResult runSerializeRunLengthDiffBench(const std::vector<TestVer2> &base,
+                                          const std::vector<TestVer2> &next,
+                                          size_t iterations,
+                                          size_t bufferBytes)
+{
+  assert(base.size() == next.size());
+  record::Serializer ser{bufferBytes};
+  size_t payloadSize = 0;
+  const auto total = measureNs(
+      [&]()
+      {
+        for (size_t iter = 0; iter < iterations; ++iter)
+        {
+          ser.reset();
+          for (size_t i = 0; i < base.size(); ++i)
+          {
+            assert(base[i].valLink.serializeDiff(
+                ser, next[i].valLink, record::DiffFormat::RunLength));
+          }
+          payloadSize = ser.size();
+        }
+      });
+  return {"serializeDiff(runlength)", payloadSize, total};
+}
+
 BenchResult runSerializeDiffAndCopyBench(const std::vector<TestVer2> &base,
                                          const std::vector<TestVer2> &next,
                                          size_t iterations, size_t bufferBytes)
@@ -362,7 +483,12 @@ int main(int argc, char **argv)
   prepareDataset(baseForDiffCopy, nextForDiffCopy);
 
   const auto ser = runSerializeBench(base, iterations, bufferBytes);
+  const auto serSchema = runSchemaSerializeBench(base, iterations, bufferBytes);
+  const auto serBatch = runBatchSerializeBench(base, iterations, bufferBytes);
+  const auto serCached = runCachedSerializeBench(base, iterations, bufferBytes);
   const auto serDiff = runSerializeDiffBench(base, next, iterations, bufferBytes);
+  const auto serDiffRun =
+      runSerializeRunLengthDiffBench(base, next, iterations, bufferBytes);
   const auto serDiffCopy =
       runSerializeDiffAndCopyBench(baseForDiffCopy, nextForDiffCopy, iterations,
                                    bufferBytes);
@@ -371,6 +497,7 @@ int main(int argc, char **argv)
   const auto serDiffCopySplitPollute = runSerializeDiffThenCopyBench(
       baseForDiffCopy, nextForDiffCopy, iterations, bufferBytes, true);
   const auto des = runDeserializeBench(base, iterations, bufferBytes);
+  const auto desBatch = runBatchDeserializeBench(base, iterations, bufferBytes);
   const auto desDiff =
       runDeserializeDiffBench(base, next, iterations, bufferBytes);
   const size_t rawStructBytes = sizeof(TestVer2) * itemCount;
@@ -380,11 +507,16 @@ int main(int argc, char **argv)
   std::cout << std::format("struct(TestVer2) size={} bytes\n", sizeof(TestVer2));
   std::cout << std::format("raw struct total size={} bytes\n", rawStructBytes);
   printResult(ser, itemCount, iterations);
+  printResult(serSchema, itemCount, iterations);
+  printResult(serBatch, itemCount, iterations);
+  printResult(serCached, itemCount, iterations);
   printResult(serDiff, itemCount, iterations);
+  printResult(serDiffRun, itemCount, iterations);
   printResult(serDiffCopy, itemCount, iterations);
   printResult(serDiffCopySplit, itemCount, iterations);
   printResult(serDiffCopySplitPollute, itemCount, iterations);
   printResult(des, itemCount, iterations);
+  printResult(desBatch, itemCount, iterations);
   printResult(desDiff, itemCount, iterations);
 
   const auto ratio = static_cast<double>(serDiff.payloadBytes) /